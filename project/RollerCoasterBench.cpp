@@ -0,0 +1,230 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the benchmark of the track sampling. It compares the
+batched kernels at every level the build supports against the same maths
+done point by point with a vector class, and checks that all the kernels give
+the same numbers as the scalar fallback.
+*/
+
+#include "sampling.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#if defined(RCE_BENCH_OGRE)
+#include "OgreVector.h"
+#endif
+
+namespace
+{
+    // The per point code only needs these two from the vector class
+    float dot(const Vec3& a, const Vec3& b) { return a.dot(b); }
+    Vec3 cross(const Vec3& a, const Vec3& b) { return a.cross(b); }
+#if defined(RCE_BENCH_OGRE)
+    float dot(const Ogre::Vector3& a, const Ogre::Vector3& b) { return a.dotProduct(b); }
+    Ogre::Vector3 cross(const Ogre::Vector3& a, const Ogre::Vector3& b) { return a.crossProduct(b); }
+#endif
+
+    struct PointSample
+    {
+        float position[3];
+        float tangent[3];
+        float curvature[3];
+        float torsion;
+        float normal[3];
+    };
+
+    template<typename V>
+    void store(float* out, const V& v)
+    {
+        out[0] = v.x;
+        out[1] = v.y;
+        out[2] = v.z;
+    }
+
+    // What the track did before the kernels: one point at a time, array of structures
+    template<typename V>
+    void samplePerPoint(const BezierCurve& curve, const std::vector<float>& parameters, std::vector<PointSample>& out)
+    {
+        V b0 {curve.b0.x, curve.b0.y, curve.b0.z};
+        V b1 {curve.b1.x, curve.b1.y, curve.b1.z};
+        V b2 {curve.b2.x, curve.b2.y, curve.b2.z};
+        V b3 {curve.b3.x, curve.b3.y, curve.b3.z};
+        V d3 {(b3 - b2 * 3 + b1 * 3 - b0) * 6};
+        out.resize(parameters.size());
+
+        V normal {};
+        V previousPosition {};
+        V previousTangent {};
+        for (size_t k = 0; k < parameters.size(); ++k)
+        {
+            float t {parameters[k]};
+            float u {1 - t};
+            V position {b0 * (u * u * u) + b1 * (3 * u * u * t) + b2 * (3 * u * t * t) + b3 * (t * t * t)};
+            V d1 {(b1 - b0) * (3 * u * u) + (b2 - b1) * (6 * u * t) + (b3 - b2) * (3 * t * t)};
+            V d2 {(b2 - b1 * 2 + b0) * (6 * u) + (b3 - b2 * 2 + b1) * (6 * t)};
+            float speed2 {dot(d1, d1)};
+            V tangent {d1 / std::sqrt(speed2)};
+            V curvature {(d2 - tangent * dot(tangent, d2)) / speed2};
+            V binormal {cross(d1, d2)};
+            float area2 {dot(binormal, binormal)};
+            float torsion {area2 > 1e-12f ? dot(binormal, d3) / area2 : 0};
+
+            // Double reflection from the previous sample
+            if (k == 0)
+                normal = cross(cross(tangent, V{0, 1, 0}), tangent);
+            else
+            {
+                V v1 {position - previousPosition};
+                float c1 {dot(v1, v1)};
+                V reflected {previousTangent - v1 * (2 / c1 * dot(v1, previousTangent))};
+                normal = normal - v1 * (2 / c1 * dot(v1, normal));
+                V v2 {tangent - reflected};
+                float c2 {dot(v2, v2)};
+                if (c2 > 1e-12f)
+                    normal = normal - v2 * (2 / c2 * dot(v2, normal));
+            }
+            normal = normal - tangent * dot(tangent, normal);
+            normal = normal / std::sqrt(dot(normal, normal));
+
+            PointSample& sample {out[k]};
+            store(sample.position, position);
+            store(sample.tangent, tangent);
+            store(sample.curvature, curvature);
+            sample.torsion = torsion;
+            store(sample.normal, normal);
+            previousPosition = position;
+            previousTangent = tangent;
+        }
+    }
+
+    template<typename Function>
+    double bestSeconds(int repeats, Function function)
+    {
+        double best {1e30};
+        for (int r = 0; r < repeats; ++r)
+        {
+            auto start {std::chrono::steady_clock::now()};
+            function();
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+
+    bool sameBits(const std::vector<float>& a, const std::vector<float>& b, size_t count)
+    {
+        return std::memcmp(a.data(), b.data(), count * sizeof(float)) == 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t segments {1024};
+    size_t samples {256}; // Per segment
+    int repeats {5};
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string option {argv[i]};
+        if (option == "--segments" && i + 1 < argc)
+            segments = std::atoi(argv[++i]);
+        else if (option == "--samples" && i + 1 < argc)
+            samples = std::max(2, std::atoi(argv[++i]));
+        else if (option == "--repeats" && i + 1 < argc)
+            repeats = std::max(1, std::atoi(argv[++i]));
+        else
+        {
+            std::cerr << "Usage: rce-bench [--segments N] [--samples N] [--repeats N]\n";
+            return 1;
+        }
+    }
+
+    // Curves shaped like track segments: a few tens of meters with climbs and turns
+    std::mt19937 random {2023};
+    std::uniform_real_distribution<float> offset {-10, 10};
+    std::vector<BezierCurve> curves(segments);
+    for (BezierCurve& curve : curves)
+    {
+        curve.b0 = {offset(random), offset(random), offset(random)};
+        curve.b1 = curve.b0 + Vec3{10 + offset(random), offset(random), offset(random)};
+        curve.b2 = curve.b1 + Vec3{10 + offset(random), offset(random), offset(random)};
+        curve.b3 = curve.b2 + Vec3{10 + offset(random), offset(random), offset(random)};
+    }
+    std::vector<float> parameters(samples);
+    for (size_t k = 0; k < samples; ++k)
+        parameters[k] = float(k) / (samples - 1);
+
+    double total {double(segments * samples)};
+    std::cout << segments << " segments of " << samples << " samples, best of " << repeats << '\n';
+    auto report = [total](const std::string& name, double seconds, double baseline)
+    {
+        std::cout << "  " << name << ": " << total / seconds / 1e6 << " M samples/s";
+        if (baseline > 0)
+            std::cout << ", x" << baseline / seconds;
+        std::cout << '\n';
+    };
+
+    std::vector<PointSample> points;
+    double perPoint {bestSeconds(repeats, [&] {
+        for (const BezierCurve& curve : curves)
+            samplePerPoint<Vec3>(curve, parameters, points);
+    })};
+    report("per point Vec3", perPoint, 0);
+#if defined(RCE_BENCH_OGRE)
+    double perPointOgre {bestSeconds(repeats, [&] {
+        for (const BezierCurve& curve : curves)
+            samplePerPoint<Ogre::Vector3>(curve, parameters, points);
+    })};
+    report("per point Ogre::Vector3", perPointOgre, 0);
+    perPoint = perPointOgre;
+#endif
+
+    std::vector<SimdLevel> levels {SimdLevel::Scalar};
+    if (bestSimdLevel() >= SimdLevel::SSE)
+        levels.push_back(SimdLevel::SSE);
+    if (bestSimdLevel() >= SimdLevel::AVX2)
+        levels.push_back(SimdLevel::AVX2);
+
+    SampleArrays reference;
+    bool identical {true};
+    for (SimdLevel level : levels)
+    {
+        SampleArrays arrays;
+        arrays.resize(samples);
+        double batched {bestSeconds(repeats, [&] {
+            for (const BezierCurve& curve : curves)
+            {
+                std::copy(parameters.begin(), parameters.end(), arrays.t.begin());
+                evaluateBezier(curve, arrays, level);
+                rotationMinimizingFrames(arrays, (Vec3{curve.b1 - curve.b0}.cross({0, 1, 0})).cross(curve.b1 - curve.b0).normalised(), level);
+            }
+        })};
+        report(std::string("batched ") + simdName(level), batched, perPoint);
+
+        // The last curve is left in the arrays, every level must match the scalar one
+        if (level == SimdLevel::Scalar)
+            reference = arrays;
+        for (auto array : {&SampleArrays::px, &SampleArrays::py, &SampleArrays::pz, &SampleArrays::tx, &SampleArrays::ty, &SampleArrays::tz,
+                           &SampleArrays::kx, &SampleArrays::ky, &SampleArrays::kz, &SampleArrays::torsion, &SampleArrays::nx, &SampleArrays::ny, &SampleArrays::nz})
+            identical = identical && sameBits(arrays.*array, reference.*array, samples);
+    }
+
+    std::cout << (identical ? "All the levels match the scalar results\n" : "The levels give different results\n");
+    return identical ? 0 : 1;
+}
@@ -0,0 +1,436 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the offline cooking of the meshes, run by the cook-assets
+target. Every .mesh in the locations of resources.cfg is written again under
+another directory with the submeshes of the same material merged, tangents,
+the triangles and the vertices in cache order, the LODs of its entity type
+and an edge list. The meshes of the decoration groups get the distances of the
+decorations, the rest the ones of the world. No render system is needed, the
+buffers live in memory. The vertices transformed per triangle before and after
+are printed for every mesh and for the whole scene.
+
+The textures of the terrain, the skies and the decorations are written next to
+them as DDS files, block compressed with all their mipmaps. The six faces of a
+sky go in one cube map, and the colour and specular layers of a ground in one
+texture with the specular as alpha. The heightmaps are read by the terrain on
+the processor and are left as they are. The megabytes sent to the graphics
+card and the milliseconds taken to read every texture before and after are
+printed, and their totals.
+*/
+
+#include "lod.h"
+#include "blockcompress.h"
+#include "OgreDefaultHardwareBufferManager.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct CookStats
+    {
+        size_t triangles = 0;
+        double transformedBefore = 0; // Vertices a FIFO cache transforms to draw the triangles
+        double transformedAfter = 0;
+    };
+
+    struct TextureStats
+    {
+        size_t bytesBefore = 0; // Sent to the graphics card with the mipmaps, 4 bytes a pixel
+        size_t bytesAfter = 0;
+        double secondsBefore = 0; // Decoding the images
+        double secondsAfter = 0; // Reading the DDS
+    };
+
+    // Faces of the cube maps in the order of Ogre and of the DDS files: +X, -X, +Y, -Y, +Z, -Z
+    const char* const CUBE_SUFFIXES[6] {"_rt", "_lf", "_up", "_dn", "_fr", "_bk"};
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // The image decoded by the codecs of Ogre like the game does, as RGBA
+    RgbaImage readImage(const std::filesystem::path& path, double& seconds, bool* alpha = nullptr)
+    {
+        auto start {std::chrono::steady_clock::now()};
+        Ogre::Image image;
+        image.load(Ogre::Root::openFileStream(path.string()), path.extension().string().substr(1));
+        RgbaImage rgba;
+        rgba.width = image.getWidth();
+        rgba.height = image.getHeight();
+        rgba.pixels.resize(size_t(rgba.width) * rgba.height * 4);
+        Ogre::PixelUtil::bulkPixelConversion(image.getPixelBox(), Ogre::PixelBox(rgba.width, rgba.height, 1, Ogre::PF_BYTE_RGBA, rgba.pixels.data()));
+        seconds += secondsSince(start);
+        if (alpha != nullptr)
+            *alpha = Ogre::PixelUtil::hasAlpha(image.getFormat());
+        return rgba;
+    }
+
+    // The faces with their mipmaps in a DDS file, decoding them took the seconds given
+    void cookTexture(std::vector<RgbaImage> faces, BlockFormat format, double decodeSeconds, const std::filesystem::path& path, TextureStats& stats, std::ostream& out)
+    {
+        uint32_t width {faces.front().width};
+        uint32_t height {faces.front().height};
+        size_t before {0};
+        size_t after {0};
+        std::vector<std::vector<std::vector<uint8_t>>> blocks;
+        for (RgbaImage& face : faces)
+        {
+            if (face.width != width || face.height != height)
+                throw std::runtime_error("the faces are not of the same size");
+            blocks.emplace_back();
+            for (const RgbaImage& level : mipChain(std::move(face)))
+            {
+                before += level.pixels.size();
+                blocks.back().push_back(compressBlocks(level, format));
+                after += blocks.back().back().size();
+            }
+        }
+        std::filesystem::create_directories(path.parent_path());
+        {
+            std::ofstream file {path, std::ios::binary};
+            writeDds(file, width, height, format, blocks);
+            if (!file)
+                throw std::runtime_error("cannot write " + path.string());
+        }
+
+        // What the game does with it instead of decoding the images
+        auto start {std::chrono::steady_clock::now()};
+        Ogre::Image cooked;
+        cooked.load(Ogre::Root::openFileStream(path.string()), "dds");
+        double seconds {secondsSince(start)};
+
+        out << width << 'x' << height << (blocks.size() == 6 ? " cube, " : ", ") << (format == BlockFormat::BC1 ? "BC1, " : "BC3, ")
+            << before / 1048576.0 << " -> " << after / 1048576.0 << " MB, " << decodeSeconds * 1000 << " -> " << seconds * 1000 << " ms\n";
+        stats.bytesBefore += before;
+        stats.bytesAfter += after;
+        stats.secondsBefore += decodeSeconds;
+        stats.secondsAfter += seconds;
+    }
+
+    // Skies as cube maps, grounds with their specular, decorations by whether they have alpha; the rest is not cooked
+    void cookTextures(const Ogre::String& group, const std::filesystem::path& directory, const std::filesystem::path& location,
+        const std::filesystem::path& target, TextureStats& stats, std::ostream& out, int& failed)
+    {
+        bool sky {Ogre::StringUtil::startsWith(group, "Sky", false)};
+        bool terrain {group == "Terrain"};
+        bool decoration {Ogre::StringUtil::startsWith(group, "Decoration/", false)};
+        for (const auto& entry : std::filesystem::directory_iterator{directory})
+        {
+            std::string stem {entry.path().stem().string()};
+            std::string extension {entry.path().extension().string()};
+            if (!entry.is_regular_file() || (extension != ".jpg" && extension != ".png"))
+                continue;
+            double seconds {0};
+            try
+            {
+                if (sky && Ogre::StringUtil::endsWith(stem, CUBE_SUFFIXES[0], false))
+                {
+                    std::string base {stem.substr(0, stem.size() - 3)};
+                    std::filesystem::path relative {(location / (base + ".dds")).lexically_normal()};
+                    out << relative.string() << ": ";
+                    std::vector<RgbaImage> faces;
+                    for (const char* suffix : CUBE_SUFFIXES)
+                        faces.push_back(readImage(directory / (base + suffix + extension), seconds));
+                    cookTexture(std::move(faces), BlockFormat::BC1, seconds, target / relative, stats, out);
+                }
+                else if (terrain && Ogre::StringUtil::endsWith(stem, "_col", false))
+                {
+                    std::string base {stem.substr(0, stem.size() - 4)};
+                    std::filesystem::path relative {(location / (base + "_diffspec.dds")).lexically_normal()};
+                    out << relative.string() << ": ";
+                    RgbaImage diffspec {readImage(entry.path(), seconds)};
+                    RgbaImage specular {readImage(directory / (base + "_spec.png"), seconds)};
+                    if (specular.width != diffspec.width || specular.height != diffspec.height)
+                        throw std::runtime_error("the specular is not of the size of the colour");
+                    for (size_t p = 0; p < specular.pixels.size(); p += 4)
+                        diffspec.pixels[p + 3] = specular.pixels[p]; // Like loadTwoImagesAsRGBA, the grey of the specular
+                    cookTexture({std::move(diffspec)}, BlockFormat::BC3, seconds, target / relative, stats, out);
+                }
+                else if (decoration)
+                {
+                    std::filesystem::path relative {(location / (stem + ".dds")).lexically_normal()};
+                    out << relative.string() << ": ";
+                    bool alpha {false};
+                    RgbaImage image {readImage(entry.path(), seconds, &alpha)};
+                    cookTexture({std::move(image)}, alpha ? BlockFormat::BC3 : BlockFormat::BC1, seconds, target / relative, stats, out);
+                }
+            }
+            catch (const std::exception& e)
+            {
+                out << "not cooked, " << e.what() << '\n';
+                ++failed;
+            }
+        }
+    }
+
+    Ogre::VertexData* vertexDataOf(Ogre::Mesh* mesh, Ogre::SubMesh* submesh)
+    {
+        return submesh->useSharedVertices ? mesh->sharedVertexData : submesh->vertexData;
+    }
+
+    // A new buffer of the smallest type that holds the vertices
+    void replaceIndices(Ogre::IndexData* data, const std::vector<uint32_t>& indices, size_t vertexCount)
+    {
+        Ogre::HardwareIndexBuffer::IndexType type {vertexCount > 0xffff ? Ogre::HardwareIndexBuffer::IT_32BIT : Ogre::HardwareIndexBuffer::IT_16BIT};
+        data->indexBuffer = Ogre::HardwareBufferManager::getSingleton().createIndexBuffer(type, indices.size(), Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+        data->indexStart = 0;
+        data->indexCount = indices.size();
+        writeIndices(data, indices);
+    }
+
+    size_t vertexCountOf(const Ogre::VertexData* data, const std::vector<uint32_t>& indices)
+    {
+        size_t count {data->vertexCount};
+        for (uint32_t i : indices)
+            count = std::max<size_t>(count, i + 1);
+        return count;
+    }
+
+    bool canMerge(Ogre::Mesh* mesh, Ogre::SubMesh* a, Ogre::SubMesh* b)
+    {
+        if (a->getMaterialName() != b->getMaterialName() || a->useSharedVertices != b->useSharedVertices
+            || a->operationType != Ogre::RenderOperation::OT_TRIANGLE_LIST || b->operationType != Ogre::RenderOperation::OT_TRIANGLE_LIST)
+            return false;
+        if (a->useSharedVertices)
+            return true;
+        const Ogre::VertexData* first {vertexDataOf(mesh, a)};
+        const Ogre::VertexData* second {vertexDataOf(mesh, b)};
+        return first->vertexStart == 0 && second->vertexStart == 0
+            && first->vertexDeclaration->getElements() == second->vertexDeclaration->getElements();
+    }
+
+    // The vertices and the triangles of b go after the ones of a
+    void append(Ogre::Mesh* mesh, Ogre::SubMesh* a, Ogre::SubMesh* b)
+    {
+        std::vector<uint32_t> indices {readIndices(a->indexData)};
+        std::vector<uint32_t> more {readIndices(b->indexData)};
+        size_t base {0};
+        if (!a->useSharedVertices)
+        {
+            Ogre::VertexData* first {a->vertexData};
+            Ogre::VertexData* second {b->vertexData};
+            base = first->vertexCount;
+            for (const auto& binding : first->vertexBufferBinding->getBindings())
+            {
+                Ogre::HardwareVertexBuffer* from {binding.second.get()};
+                Ogre::HardwareVertexBuffer* after {second->vertexBufferBinding->getBuffer(binding.first).get()};
+                size_t size {from->getVertexSize()};
+                Ogre::HardwareVertexBufferSharedPtr buffer {Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(size, first->vertexCount + second->vertexCount, from->getUsage(), from->hasShadowBuffer())};
+                {
+                    Ogre::HardwareBufferLockGuard to {buffer.get(), Ogre::HardwareBuffer::HBL_DISCARD};
+                    Ogre::HardwareBufferLockGuard lockFirst {from, 0, first->vertexCount * size, Ogre::HardwareBuffer::HBL_READ_ONLY};
+                    Ogre::HardwareBufferLockGuard lockSecond {after, 0, second->vertexCount * size, Ogre::HardwareBuffer::HBL_READ_ONLY};
+                    std::memcpy(to.pData, lockFirst.pData, first->vertexCount * size);
+                    std::memcpy(static_cast<char*>(to.pData) + first->vertexCount * size, lockSecond.pData, second->vertexCount * size);
+                }
+                first->vertexBufferBinding->setBinding(binding.first, buffer);
+            }
+            first->vertexCount += second->vertexCount;
+        }
+        for (uint32_t i : more)
+            indices.push_back(uint32_t(i + base));
+        replaceIndices(a->indexData, indices, vertexCountOf(vertexDataOf(mesh, a), indices));
+    }
+
+    // Submeshes of the same material and vertex layout are drawn in one call
+    void mergeSubMeshes(Ogre::Mesh* mesh)
+    {
+        if (mesh->hasSkeleton() || mesh->hasVertexAnimation() || mesh->getPoseCount() > 0 || mesh->getNumLodLevels() > 1)
+            return; // Bone assignments, poses and LODs point to the vertices and the indices as they are
+        for (unsigned short i = 0; i < mesh->getNumSubMeshes(); ++i)
+        {
+            for (unsigned short j = i + 1; j < mesh->getNumSubMeshes();)
+            {
+                if (canMerge(mesh, mesh->getSubMesh(i), mesh->getSubMesh(j)))
+                {
+                    append(mesh, mesh->getSubMesh(i), mesh->getSubMesh(j));
+                    mesh->destroySubMesh(j);
+                }
+                else
+                    ++j;
+            }
+        }
+    }
+
+    void buildTangents(Ogre::Mesh* mesh)
+    {
+        bool uvs {true};
+        bool tangents {true};
+        for (Ogre::SubMesh* submesh : mesh->getSubMeshes())
+        {
+            const Ogre::VertexDeclaration* declaration {vertexDataOf(mesh, submesh)->vertexDeclaration};
+            uvs = uvs && declaration->findElementBySemantic(Ogre::VES_TEXTURE_COORDINATES) != nullptr;
+            tangents = tangents && declaration->findElementBySemantic(Ogre::VES_TANGENT) != nullptr;
+        }
+        if (uvs && !tangents)
+            mesh->buildTangentVectors(Ogre::VES_TANGENT);
+    }
+
+    // Every buffer of the vertex data is put in the new order
+    void reorderVertices(Ogre::VertexData* data, const std::vector<uint32_t>& remap)
+    {
+        for (const auto& binding : data->vertexBufferBinding->getBindings())
+        {
+            Ogre::HardwareVertexBuffer* buffer {binding.second.get()};
+            size_t size {buffer->getVertexSize()};
+            std::vector<char> ordered(data->vertexCount * size);
+            Ogre::HardwareBufferLockGuard lock {buffer, 0, ordered.size(), Ogre::HardwareBuffer::HBL_NORMAL};
+            const char* bytes {static_cast<const char*>(lock.pData)};
+            for (size_t v = 0; v < data->vertexCount; ++v)
+                std::memcpy(&ordered[remap[v] * size], bytes + v * size, size);
+            std::memcpy(lock.pData, ordered.data(), ordered.size());
+        }
+    }
+
+    // Returns the vertices transformed before and after
+    std::pair<double, double> optimiseIndices(Ogre::IndexData* indexData, Ogre::VertexData* vertexData, bool reorder)
+    {
+        std::vector<uint32_t> indices {readIndices(indexData)};
+        if (indices.size() < 3)
+            return {0, 0};
+        size_t vertexCount {vertexCountOf(vertexData, indices)};
+        size_t triangles {indices.size() / 3};
+        double before {cacheMissRatio(indices.data(), indices.size(), vertexCount) * double(triangles)};
+        optimiseVertexCache(indices.data(), indices.size(), vertexCount);
+        if (reorder && vertexCount == vertexData->vertexCount)
+            reorderVertices(vertexData, optimiseVertexFetch(indices.data(), indices.size(), vertexCount));
+        writeIndices(indexData, indices);
+        return {before, cacheMissRatio(indices.data(), indices.size(), vertexCount) * double(triangles)};
+    }
+
+    void cookMesh(Ogre::MeshPtr& mesh, const LodProfile& profile, CookStats& stats, std::ostream& out)
+    {
+        size_t submeshesBefore {mesh->getNumSubMeshes()};
+        mergeSubMeshes(mesh.get());
+        buildTangents(mesh.get());
+
+        // Vertices are only moved where nothing else points to them
+        bool reorder {!mesh->hasSkeleton() && !mesh->hasVertexAnimation() && mesh->getPoseCount() == 0 && mesh->getNumLodLevels() == 1};
+        size_t triangles {0};
+        double before {0};
+        double after {0};
+        for (Ogre::SubMesh* submesh : mesh->getSubMeshes())
+        {
+            if (submesh->operationType != Ogre::RenderOperation::OT_TRIANGLE_LIST)
+                continue;
+            auto transformed {optimiseIndices(submesh->indexData, vertexDataOf(mesh.get(), submesh), reorder && !submesh->useSharedVertices)};
+            before += transformed.first;
+            after += transformed.second;
+            triangles += submesh->indexData->indexCount / 3;
+        }
+
+        ensureLods(mesh, profile);
+        mesh->buildEdgeList();
+
+        stats.triangles += triangles;
+        stats.transformedBefore += before;
+        stats.transformedAfter += after;
+        if (triangles > 0)
+            out << triangles << " triangles, " << before / triangles << " -> " << after / triangles << " vertices per triangle, ";
+        out << submeshesBefore << " -> " << mesh->getNumSubMeshes() << " submeshes, " << mesh->getNumLodLevels() << " LODs\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: rce-cook <resources.cfg> <cooked directory>\n";
+        return 1;
+    }
+    std::filesystem::path resources {argv[1]};
+    std::filesystem::path target {argv[2]};
+
+    // Ogre without a window, only the managers the meshes need and a codec for the images
+    Ogre::LogManager logs;
+    logs.createLog("rce-cook.log", true, false, false);
+    Ogre::Root root {"", "", ""};
+    for (const char* codec : {"Codec_STBI", "Codec_FreeImage"})
+    {
+        try
+        {
+            root.loadPlugin(std::string{RCE_OGRE_PLUGIN_DIR} + "/" + codec);
+            break;
+        }
+        catch (const std::exception&)
+        {
+            // The next one, without any the textures are reported as not cooked
+        }
+    }
+    Ogre::DefaultHardwareBufferManager buffers;
+    Ogre::MeshLodGenerator lodGenerator;
+    Ogre::MeshSerializer serializer;
+
+    // The locations are read like the game does, one directory each without the ones inside
+    Ogre::ConfigFile config;
+    config.load(resources.string());
+    CookStats stats;
+    TextureStats textureStats;
+    int failed {0};
+    for (const auto& section : config.getSettingsBySection())
+    {
+        const LodProfile& profile {lodProfile(Ogre::StringUtil::startsWith(section.first, "Decoration/", false) ? EntityType::Decoration : EntityType::World)};
+        for (const auto& location : section.second)
+        {
+            std::filesystem::path directory {resources.parent_path() / location.second};
+            if (location.first != "FileSystem" || !std::filesystem::is_directory(directory))
+                continue;
+            cookTextures(section.first, directory, location.second, target, textureStats, std::cout, failed);
+            for (const auto& entry : std::filesystem::directory_iterator{directory})
+            {
+                if (!entry.is_regular_file() || entry.path().extension() != ".mesh")
+                    continue;
+                std::filesystem::path relative {(std::filesystem::path{location.second} / entry.path().filename()).lexically_normal()};
+                std::cout << relative.string() << ": ";
+                try
+                {
+                    Ogre::MeshPtr mesh {Ogre::MeshManager::getSingleton().createManual(relative.generic_string(), Ogre::RGN_DEFAULT)};
+                    serializer.importMesh(Ogre::Root::openFileStream(entry.path().string()), mesh.get());
+                    cookMesh(mesh, profile, stats, std::cout);
+                    std::filesystem::create_directories((target / relative).parent_path());
+                    serializer.exportMesh(mesh.get(), (target / relative).string());
+                    Ogre::MeshManager::getSingleton().remove(mesh);
+                }
+                catch (const std::exception& e)
+                {
+                    std::cout << "not cooked, " << e.what() << '\n';
+                    ++failed;
+                }
+            }
+        }
+    }
+    Ogre::MeshManager::getSingleton().removeAll(); // Before the buffer manager goes
+
+    if (stats.triangles > 0)
+    {
+        std::cout << "Scene: " << stats.triangles << " triangles, " << stats.transformedBefore / stats.triangles << " -> "
+            << stats.transformedAfter / stats.triangles << " vertices per triangle, x" << stats.transformedBefore / stats.transformedAfter
+            << " triangles per transformed vertex\n";
+    }
+    if (textureStats.bytesBefore > 0)
+    {
+        std::cout << "Textures: " << textureStats.bytesBefore / 1048576.0 << " -> " << textureStats.bytesAfter / 1048576.0 << " MB of the graphics card, "
+            << textureStats.secondsBefore * 1000 << " -> " << textureStats.secondsAfter * 1000 << " ms to read\n";
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -18,6 +18,24 @@ This file contains the design of GUI the game.
 */
 
 #include "settings.h"
+#include "bvh.h"
+#include "collider.h"
+#include "profiler.h"
+#include "lod.h"
+#include "instancing.h"
+#include "registry.h"
+#include "journal.h"
+#include "track.h"
+#include "trackmesh.h"
+#include "trackfile.h"
+#include "parkfile.h"
+#include "clearance.h"
+#include "connectors.h"
+#include "telemetry.h"
+#include "graph.h"
+#include "replay.h"
+#include "streaming.h"
+#include "terraincache.h"
 
 class RollerCoaster:
     public ApplicationContext,  // Base class responsible for setting up a common context for applications
@@ -39,10 +57,13 @@ class RollerCoaster:
 
         // Interface
         void play();
+        void updateTerrainBuild(float);
+        void showBuildMode();
         void rotateCamera(int , int ) noexcept;
         void buttonHit(Button*);
         void sliderMoved(Slider*);
         void itemSelected(SelectMenu*);
+        void checkBoxToggled(CheckBox*);
         void windowResize(int,int);
         bool mouseWheelRolled(const MouseWheelEvent &);
         bool mousePressed(const MouseButtonEvent &);
@@ -53,8 +74,16 @@ class RollerCoaster:
         void frameRendered(const Ogre::FrameEvent& evt);
         std::vector<std::pair<SceneNode*, Vector3>> get_intersections(SceneNode *, Ray &);
 
+        // Replay
+        void recordInput(const std::string& path) { recordPath = path; }
+        void replayInput(const std::string& path) { replayPath = path; }
+        std::string frameReport() const { return frameTimes.report(); }
+
         // Tool
         void loadResource();
+        void streamResources();
+        void updateLoadingBar();
+        void showSky(int);
         int randomNumber(int,int);
 
     protected:
@@ -67,32 +96,80 @@ class RollerCoaster:
     private:
         // Create world
         void createWorld();
-        void createNodeWorld(std::string, std::string, float, float, float, float);
+        void createNodeWorld(std::string, float, float, float, float);
+        void bakeStaticWorld();
+        void unbakeStaticWorld();
+        void releaseStaticNode(SceneNode*);
 
         // Menu GUI Build
         void updateAccount();
         void createRail();
         void createDecoration();
         void undoEntity();
+        void redoEntity();
         void deleteEntity();
         void map();
+
+        // Entities
+        EntityHandle placeEntity(const NodeState&);
+        void restoreEntity(EntityHandle, const NodeState&);
+        void removeEntity(EntityHandle);
+        SceneNode* buildNode(const NodeState&);
+        NodeState captureState(EntityHandle);
+        void applyTransform(EntityHandle, const NodeState&);
+        DecorationPool* decorationPool(const std::string&);
+
+        // Park
+        void saveParkFile();
+        void loadParkFile();
+
+        // Track
+        long trackIndex(EntityHandle);
+        ControlPoint controlPoint(EntityHandle);
+        void updateTrackPoint(EntityHandle);
+        void railConnectors(EntityHandle, Connector& entry, Connector& exit);
+        void updateConnectors(EntityHandle);
+        uint32_t chainStart(uint32_t piece);
+        void orderChangedChains();
+        void orderChain(uint32_t piece);
+        void orderRailPoints();
+        void snapRail(EntityHandle);
+        void updateClearance();
+
+        // Ride
+        void toggleRide();
+        void showRideGraph();
+        void updateRideGraph();
+
+        // Replay
+        template<typename InputEvent> bool acceptInput(const InputEvent&);
+        void startReplay();
+        void replayFrame(const Ogre::FrameEvent&);
     
         // Terrain
         void getTerrainImage(bool, bool, Ogre::Image&);
-        void defineTerrain(long, long);
+        bool defineTerrain(long, long);
         void initBlendMaps(Ogre::Terrain*);
         void configureTerrainDefaults(Ogre::Light*);
+        ContentHash terrainCacheKey();
+        void saveTerrainCache();
 
         // Interface
         void rotateScene(int , int ) noexcept;
         void resetHighlightedNode(void) noexcept;
-        void setHighlightedNode(SceneNode*) noexcept;
-        void get_intersections(SceneNode *, Ray &, std::map<Real, SceneNode*>&);
+        void setHighlightedNode(EntityHandle) noexcept;
         void translateHighlightedNode(Vector3);
         void rotateHighlightedNode(float , bool);
 
+        // Picking
+        void addPickable(EntityHandle);
+        void removePickable(EntityHandle);
+        void updatePickable(EntityHandle);
+        void updateObstacle(EntityHandle);
+
         // Resource File
         std::string resourcesFile = "resources.cfg";
+        ResourceStreamer streamer; // What the menu does not need, loaded behind the progress bar
         
         // Basic
         SceneManager* scnMgr;
@@ -103,17 +180,18 @@ class RollerCoaster:
         int fxVolume;      
         int musicVolume;
         int sky;
+        int skyShown; // Index of the skybox in the scene, its group is loaded
         bool pause;
-        Ogre::Timer timer;
-        Ogre::Timer timer2;
+        float skyTime; // Seconds since the sky changed
+        float clockTime; // Seconds since the clock ticked
         bool cameraMode;
         bool buttonDelete;
         bool buttonUndo;
         bool buttonMap;
         bool mapStatus;
-        int entity;
         int time;
         int cash;
+        static constexpr int DELETE_REFUND = 10;
         Vector3 savePosition;
         Vector3 saveDirection;
         Label* clock;
@@ -128,10 +206,73 @@ class RollerCoaster:
         bool mMovableFound;
         const float rotationSpeed;
         std::pair<SceneNode*, Vector3> intersectedNode;
-        SceneNode* highlightedNode;
+        EntityHandle highlighted;
+        SceneNode* highlightedNode; // Node of the highlighted entity, cached
+
+        // Cached nodes, looked up by name only once in setup()
+        SceneNode* worldNode;
+        SceneNode* camNode;
+        Camera* myCam;
+
+        // Entities
+        EntityRegistry entities; // Everything placed under worldNode
+        EditJournal journal; // Undo and redo of the edits
+
+        // Track
+        Track track; // Spline through the rails
+        std::unique_ptr<TrackMesh> trackMesh; // Rails, spine and ties extruded along the track
+        ClearanceChecker clearance; // Envelope of the riders against the decorations and the terrain
+        static constexpr float SNAP_RADIUS = 1.0f; // Meters, under the step of translateHighlightedNode so a joined piece can leave
+        ConnectorIndex connectors {SNAP_RADIUS}; // Ends of the rail pieces, joined where they meet
+        std::vector<EntityHandle> railPoints; // Rails in track order, retired ones keep their place for undo
+        struct RailPlace
+        {
+            size_t slot; // In railPoints
+            EntityHandle handle;
+            ControlPoint point;
+        };
+        std::vector<RailPlace> railScratch; // Kept between the orderings so a drag does not allocate
+        std::vector<RailPlace> railOrder;
+        std::vector<uint32_t> railRank; // Place of each piece in its chain, by the index of its handle
+        bool loadingPark; // The rails are joined as they are placed and ordered once at the end
+
+        // Ride
+        std::unique_ptr<RideSession> ride; // Train simulated on its own thread while the graphs are shown
+        TelemetryHistory telemetry;
+        static constexpr float DISPATCH_SPEED = 20; // Meters per second
+
+        // Replay
+        std::string recordPath;
+        std::string replayPath;
+        std::unique_ptr<InputRecorder> recorder; // Input of the session with the seed of the random generator
+        std::unique_ptr<InputPlayer> player; // Live input is ignored while a log is played
+        bool replaying; // The events of the log are being dispatched
+        uint32_t frameIndex;
+        FrameTimeHistogram frameTimes;
+
+        // Picking
+        BoundingVolumeHierarchy<EntityHandle> pickTree; // World AABBs of the worldNode leaves
+        MeshColliderCache colliders; // Triangles of each mesh for precise picking
+        bool precisePicking; // Refine the AABB hits against the triangles
+
+        // Static world
+        bool staticWorld; // Bake the pieces of createWorld into StaticGeometry at play()
+        bool staticWorldBaked;
+        StaticGeometry* staticGeometry;
+        std::vector<SceneNode*> staticNodes; // Side table: baked nodes keep a hidden entity to be picked
+        FrameProfiler profiler;
+
+        // Decorations
+        std::unordered_map<std::string, std::unique_ptr<DecorationPool>> decorationPools; // Instances of each decoration mesh
+        std::unique_ptr<MeshLodGenerator> lodGenerator; // Levels of detail of the meshes that were not cooked
 
         // Terrain
-        bool mTerrainsImported;
+        enum class TerrainBuild { None, Building, Ready };
+        TerrainBuild terrainBuild; // Advanced by frameRendered while the derived data is built in the background
+        float terrainBuildTime; // Seconds since play()
+        bool mTerrainsImported; // The terrain of play() is ready
+        bool terrainGenerated; // Imported from the heightmap instead of read from the cache, it is saved once built
+        ContentHash terrainKey;
         Ogre::TerrainGroup* mTerrainGroup;
         Ogre::TerrainGlobalOptions* mTerrainGlobals;
 };
@@ -145,6 +286,10 @@ RollerCoaster::RollerCoaster() :
     musicVolume{100},
     widthApp{800},
     heightApp{600},
+    terrainBuild{TerrainBuild::None},
+    terrainBuildTime{0},
+    mTerrainsImported{false},
+    terrainGenerated{false},
     mTerrainGroup{0},
     mTerrainGlobals{0},
     worldWasClicked{false},
@@ -153,17 +298,30 @@ RollerCoaster::RollerCoaster() :
     shiftKey(false),
     rotationSpeed{0.5f},
     highlightedNode{nullptr},
+    worldNode{nullptr},
+    camNode{nullptr},
+    myCam{nullptr},
+    journal{Settings::JOURNAL_MEMORY, [this](EntityHandle handle) { entities.release(handle); }},
+    precisePicking{true},
+    staticWorld{true},
+    staticWorldBaked{false},
+    staticGeometry{nullptr},
     mRayScnQuery{0},
     sky{1},
+    skyShown{0},
     pause{true},
+    skyTime{0},
+    clockTime{0},
     cameraMode{1},
-    entity{0},
     buttonDelete{0},
     buttonUndo{0},
     buttonMap{0},
     mapStatus{0},
     time{300},
-    cash{5000}
+    cash{5000},
+    replaying{false},
+    frameIndex{0},
+    loadingPark{false}
 {}
 
 void RollerCoaster::setup()
@@ -172,11 +330,31 @@ void RollerCoaster::setup()
     Ogre::NameValuePairList parms;
     parms["border"] = "none";
 
+    // The seed goes in the log, so a replay draws the same random numbers
+    if (!replayPath.empty())
+    {
+        player = std::make_unique<InputPlayer>(replayPath);
+        gen.seed(player->getHeader().seed);
+        this->widthApp = player->getHeader().width; // Mouse positions are only valid on the same window
+        this->heightApp = player->getHeader().height;
+    }
+    else if (!recordPath.empty())
+    {
+        InputLogHeader header;
+        header.seed = rd();
+        header.frameDelta = Settings::REPLAY_FRAME_DELTA;
+        header.width = this->widthApp;
+        header.height = this->heightApp;
+        gen.seed(header.seed);
+        recorder = std::make_unique<InputRecorder>(recordPath, header);
+    }
+
     // Initialize root and create window
     mRoot->initialise(false);
     createWindow(mAppName,this->widthApp,this->heightApp,parms);
 
     // Locate and load resources
+    lodGenerator = std::make_unique<MeshLodGenerator>();
     locateResources();
     initialiseRTShaderSystem();
     loadResources();
@@ -193,7 +371,8 @@ void RollerCoaster::setup()
     RTShader::ShaderGenerator* shadergen = RTShader::ShaderGenerator::getSingletonPtr();
     shadergen->addSceneManager(scnMgr);
     scnMgr->setAmbientLight(ColourValue(0.5, 0.5, 0.5));
-    SceneNode* worldNode = scnMgr->getRootSceneNode()->createChildSceneNode("worldNode");
+    worldNode = scnMgr->getRootSceneNode()->createChildSceneNode("worldNode");
+    trackMesh = std::make_unique<TrackMesh>(scnMgr, worldNode);
 
     // Light
     Light* light = scnMgr->createLight("MainLight");
@@ -202,8 +381,8 @@ void RollerCoaster::setup()
     lightNode->setPosition(0, 0, 0);
 
     // Camera
-    SceneNode* camNode = scnMgr->getRootSceneNode()->createChildSceneNode("camNode");
-    Camera* cam = scnMgr->createCamera("myCam");
+    camNode = scnMgr->getRootSceneNode()->createChildSceneNode("camNode");
+    Camera* cam = myCam = scnMgr->createCamera("myCam");
     cam->setNearClipDistance(5);
     cam->setAutoAspectRatio(true);
     camNode->attachObject(cam);
@@ -229,64 +408,115 @@ void RollerCoaster::setup()
     trayMgr = new TrayManager("InterfaceRCE", getRenderWindow(), this);
     addInputListener(trayMgr);
     trayMgr->hideCursor(); // Hide cursor of Ogre
+    if (player)
+        startReplay();
 
     // Load sounds and resources
+    auto start {std::chrono::steady_clock::now()};
     Settings::loadSounds();
     this->loadResource();
     Settings::playMainMenuMusic();
     this->menuGUI();
+    std::cout << "Menu shown in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s\n";
 }
 
 // END BASIC
 
-void RollerCoaster::createNodeWorld(std::string nameNode, std::string nameMesh, float posX,float posY,float posZ, float angle)
+void RollerCoaster::createNodeWorld(std::string nameMesh, float posX,float posY,float posZ, float angle)
 {
-    SceneNode* worldNode {scnMgr->getSceneNode("worldNode")};
-    SceneNode* node {worldNode->createChildSceneNode(nameNode)};
+    SceneNode* node {worldNode->createChildSceneNode()};
+    ensureLods(MeshManager::getSingleton().load(nameMesh, ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME), lodProfile(EntityType::World));
     Entity* mesh = scnMgr->createEntity(nameMesh);
     node->attachObject(mesh);
     node->pitch(Degree(angle));
     node->setPosition(posX, posY, posZ);
+    EntityHandle handle {entities.create(EntityType::World, 0, node)};
+    addPickable(handle);
+    staticNodes.push_back(node);
 }
 
 void RollerCoaster::createWorld()
 {
     float posX {0}, posY {1},posZ {2010};
     
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0000.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0001.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0002.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0003.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0004.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0005.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0006.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0007.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0008.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0009.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0010.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0011.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0012.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0013.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0014.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Theta.0015.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Zeta.0000.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Rails.0000.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Rails.0001.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Rails.0002.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Rails.0003.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Rails.0004.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Rails.0005.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Posts.0000.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Posts.0001.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Posts.0002.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Posts.0003.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Posts.0004.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Posts.0005.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Gamma.0000.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Epsilon.0000.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Delta.0000.mesh", posX, posY, posZ, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Cube.001.mesh", 28.8, posY, posZ+0.2, -90);
-    createNodeWorld("ogreEntity"+std::to_string(this->entity++), "Cube.001.mesh", 101.38, posY, posZ-11.6, -90);
+    createNodeWorld("Theta.0000.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0001.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0002.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0003.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0004.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0005.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0006.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0007.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0008.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0009.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0010.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0011.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0012.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0013.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0014.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Theta.0015.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Zeta.0000.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Rails.0000.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Rails.0001.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Rails.0002.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Rails.0003.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Rails.0004.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Rails.0005.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Posts.0000.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Posts.0001.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Posts.0002.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Posts.0003.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Posts.0004.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Posts.0005.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Gamma.0000.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Epsilon.0000.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Delta.0000.mesh", posX, posY, posZ, -90);
+    createNodeWorld("Cube.001.mesh", 28.8, posY, posZ+0.2, -90);
+    createNodeWorld("Cube.001.mesh", 101.38, posY, posZ-11.6, -90);
+
+    if (staticWorld)
+        bakeStaticWorld();
+}
+
+// All the pieces of the world share a transform and never move, so they are batched by region
+void RollerCoaster::bakeStaticWorld()
+{
+    if (staticGeometry == nullptr)
+    {
+        staticGeometry = scnMgr->createStaticGeometry("StaticWorld");
+        staticGeometry->setRegionDimensions(Vector3(250, 250, 250));
+    }
+    staticGeometry->reset();
+    for (SceneNode* node : staticNodes)
+    {
+        Entity* mesh {static_cast<Entity*>(node->getAttachedObject(0))};
+        staticGeometry->addEntity(mesh, node->_getDerivedPosition(), node->_getDerivedOrientation(), node->_getDerivedScale());
+        mesh->setVisible(false); // The node stays for picking, the batch draws it
+    }
+    staticGeometry->build();
+    staticWorldBaked = true;
+}
+
+void RollerCoaster::unbakeStaticWorld()
+{
+    for (SceneNode* node : staticNodes)
+        node->getAttachedObject(0)->setVisible(true);
+    if (staticGeometry != nullptr)
+        staticGeometry->reset();
+    staticWorldBaked = false;
+}
+
+// A baked piece that is going to be edited goes back to be a regular node
+void RollerCoaster::releaseStaticNode(SceneNode* node)
+{
+    auto staticNode {std::find(staticNodes.begin(), staticNodes.end(), node)};
+    if (staticNode == staticNodes.end())
+        return;
+
+    staticNodes.erase(staticNode);
+    node->getAttachedObject(0)->setVisible(true);
+    if (staticWorldBaked)
+        bakeStaticWorld();
 }
 
 // START GUI
@@ -300,9 +530,16 @@ void RollerCoaster::menuGUI()
     {
         this->sky = this->randomNumber(1,4);
 		// The child background does not exist
+
+        // Only the background shown is loaded from the group of the menu
+        streamer.add("Texture", "rail"+std::to_string(this->sky)+".jpg", "Menu", LOAD_MENU);
+        streamer.finish(LOAD_MENU);
 	
-        // Create background material
-        MaterialPtr material = MaterialManager::getSingleton().create("BackgroundMenu", "General");
+        // Create background material, it is kept by the group of the menu when it is unloaded
+        MaterialPtr material = MaterialManager::getSingleton().getByName("BackgroundMenu", "Menu");
+        if (!material)
+            material = MaterialManager::getSingleton().create("BackgroundMenu", "Menu");
+        material->getTechnique(0)->getPass(0)->removeAllTextureUnitStates();
         material->getTechnique(0)->getPass(0)->createTextureUnitState("rail"+std::to_string(this->sky)+".jpg");
         material->getTechnique(0)->getPass(0)->setDepthCheckEnabled(false);
         material->getTechnique(0)->getPass(0)->setDepthWriteEnabled(false);
@@ -327,6 +564,12 @@ void RollerCoaster::menuGUI()
 
         // Background scrolling
         material->getTechnique(0)->getPass(0)->getTextureUnitState(0)->setScrollAnimation(0.0, 0.25);
+
+        // What play() needs is streamed while the menu is shown
+        streamer.addGroup("Build", LOAD_WORLD);
+        streamer.addGroup("Terrain", LOAD_WORLD);
+        streamer.addGroup("Sky"+std::to_string(this->sky), LOAD_WORLD);
+        std::cout << "Memory at the menu: " << memoryReport() << '\n';
     }
     else
     {    
@@ -341,6 +584,8 @@ void RollerCoaster::menuGUI()
     trayMgr->createButton(TL_CENTER, "CreditsButton", "CREDITS", buttonWidth);
     trayMgr->createButton(TL_CENTER, "ExitButton", "EXIT", buttonWidth);
     trayMgr->moveWidgetToTray(trayMgr->createDecorWidget(TL_NONE, "LogoAlkelean", "SdkTrays/LogoAlkelean"), TL_BOTTOMRIGHT, 2000); // Show Logo of ALKELEAN GAMES
+    if (!streamer.finished())
+        trayMgr->createProgressBar(TL_BOTTOM, "LoadingBar", "Loading", buttonWidth, buttonWidth * 0.7);
 }
 
 void RollerCoaster::settingsGUI()
@@ -360,6 +605,8 @@ void RollerCoaster::settingsGUI()
     OgreBites::Slider *music = trayMgr->createThickSlider(TL_CENTER, "music", "Music Volume", labelWidth, 50, 0, 100, 101);
     fx->setValue(this->fxVolume);
     music->setValue(this->musicVolume);
+    // CheckBox (Position, ID, Caption, width)
+    trayMgr->createCheckBox(TL_CENTER, "staticWorld", "Static World Batching", labelWidth)->setChecked(this->staticWorld, false);
     // Buttons (Position, ID, Value)
     float buttonWidth = getRenderWindow()->getViewport(0)->getActualWidth() * 0.60;
     if(this->mTerrainsImported)
@@ -421,7 +668,7 @@ void RollerCoaster::instructionsGUI()
     //TextBox (Position, ID, caption, width, height
     TextBox* howToPlay = trayMgr->createTextBox(TL_CENTER, "howToPlay", "HOW TO PLAY", labelWidth, labelHeight);
     // Set the body text
-    howToPlay->appendText("MOUSE:\nWith the mouse you can rotate the camera to move freely.\n\nKEYBOARD:\nW,A,S,D - Moves the camera or an object if selected\nArrows - Rotate the camera or rotate an object if selected,\nEscape - Pause\nE - Place an object\nR - Place a decoration\nU - Undo the last action\nQ - Delete an object if it is selected\nM - Shows the map\nC - Change the camera mode\nSpace - Deselect an object");
+    howToPlay->appendText("MOUSE:\nWith the mouse you can rotate the camera to move freely.\n\nKEYBOARD:\nW,A,S,D - Moves the camera or an object if selected\nArrows - Rotate the camera or rotate an object if selected,\nEscape - Pause\nE - Place an object\nR - Place a decoration\nU - Undo the last action\nY - Redo the last undone action\nQ - Delete an object if it is selected\nM - Shows the map\nP - Change between precise and box picking\nB - Switch the static world batching\nT - Save the track for the simulator\nC - Change the camera mode\nSpace - Deselect an object");
     
     // Buttons (Position, ID, Value)
     float buttonWidth = getRenderWindow()->getViewport(0)->getActualWidth() * 0.60;
@@ -447,12 +694,18 @@ void RollerCoaster::buildGUI()
     trayMgr->createButton(TL_RIGHT, "DecorationButton", "Decor.",100);
     trayMgr->moveWidgetToTray(trayMgr->createDecorWidget(TL_NONE, "Return", "SdkTrays/Return"), TL_RIGHT, 2000); // Show Icon Return
     trayMgr->createButton(TL_RIGHT, "UndoButton", "Undo",100);
+    trayMgr->createButton(TL_RIGHT, "RedoButton", "Redo",100);
     trayMgr->moveWidgetToTray(trayMgr->createDecorWidget(TL_NONE, "Map", "SdkTrays/Map"), TL_RIGHT, 2000); // Show Icon Map
     trayMgr->createButton(TL_RIGHT, "MapButton", "Map",100);
     trayMgr->moveWidgetToTray(trayMgr->createDecorWidget(TL_NONE, "Repair", "SdkTrays/Repair"), TL_RIGHT, 2000); // Show Icon Repair
     trayMgr->createButton(TL_RIGHT, "RepairButton", "Repair",100);
     trayMgr->moveWidgetToTray(trayMgr->createDecorWidget(TL_NONE, "Setting", "SdkTrays/Setting"), TL_BOTTOMLEFT, 2000); // Show Icon Setting
     trayMgr->createButton(TL_BOTTOMLEFT, "SettingButton", "Settings",130);
+    trayMgr->createLabel(TL_BOTTOMRIGHT, "ClearanceLabel", "", 130);
+    trayMgr->createButton(TL_BOTTOMRIGHT, "SimulateButton", "Simulate",130);
+    updateClearance();
+    if (ride)
+        showRideGraph();
 }
 
 // END GUI
@@ -468,22 +721,69 @@ void RollerCoaster::play()
     this->scnMgr->destroySceneNode("Background");
     this->trayMgr->destroyAllWidgets();
 
+    // The menu is left, what play() needs and did not stream in while it was shown is loaded now
+    streamer.unloadGroup("Menu");
+    streamer.finish(LOAD_WORLD);
+    for (const String& group : ResourceGroupManager::getSingleton().getResourceGroups())
+    {
+        if (StringUtil::startsWith(group, "Decoration/", false))
+            streamer.addGroup(group, LOAD_REST); // Ready before the first decoration is placed
+    }
+
     //Skybox
-    scnMgr->setSkyBox(true, "Sky/SkyBox"+std::to_string(this->sky));
+    this->showSky(this->sky);
     RTShader::ShaderGenerator* shadergen = RTShader::ShaderGenerator::getSingletonPtr();
     shadergen->addSceneManager(scnMgr);
     scnMgr->setAmbientLight(ColourValue(0.5, 0.5, 0.5));
 
-    // Create terrain
+    // Create terrain, its derived data is built in the background while the frames go on
     this->createScene();
+    terrainBuild = TerrainBuild::Building;
+    terrainBuildTime = 0;
+    if (recorder || player)
+    {
+        // The input is replayed by frame, so the build mode has to appear on the same frame on every machine
+        while (mTerrainGroup->isDerivedDataUpdateInProgress())
+        {
+            OGRE_THREAD_SLEEP(1);
+            Root::getSingleton().getWorkQueue()->processResponses();
+        }
+    }
+    float labelWidth = getRenderWindow()->getViewport(0)->getActualWidth() * 0.60;
+    trayMgr->createLabel(TL_CENTER, "TerrainLabel", "Building terrain...", labelWidth);
+}
 
-    while(mTerrainGroup->isDerivedDataUpdateInProgress())
+// Called every frame until the derived data of the terrain is built, the build mode is shown the same frame it is.
+// The buttons, keys and clicks are ignored meanwhile, so the screen is still the one play() left
+void RollerCoaster::updateTerrainBuild(float delta)
+{
+    terrainBuildTime += delta;
+    Root::getSingleton().getWorkQueue()->processResponses();
+    auto label {dynamic_cast<Label*>(trayMgr->getWidget("TerrainLabel"))};
+    if (mTerrainGroup->isDerivedDataUpdateInProgress())
     {
-        std::cout<<"Building terrain...\n";
-        // we need to wait for this to finish
-        OGRE_THREAD_SLEEP(1000);
-        Root::getSingleton().getWorkQueue()->processResponses();
+        std::ostringstream caption;
+        caption << "Building terrain... " << std::fixed << std::setprecision(1) << terrainBuildTime << " s";
+        if (label != nullptr)
+            label->setCaption(caption.str());
+        return;
     }
+    terrainBuild = TerrainBuild::Ready;
+    if (label != nullptr)
+        trayMgr->destroyWidget(label);
+    std::cout << "Terrain built in " << terrainBuildTime << " s\n";
+    showBuildMode();
+}
+
+void RollerCoaster::showBuildMode()
+{
+    if (terrainGenerated)
+        saveTerrainCache();
+    clearance.setTerrain([this](float x, float z) { return mTerrainGroup->getHeightAtWorldPosition(x, 0, z); });
+    skyTime = 0; //For the skybox
+    clockTime = 0; //For the clock
+    mTerrainsImported = true;
+    std::cout << "Memory at play: " << memoryReport() << '\n';
 
     // Labels (Position, ID, Value)
     float labelWidth = getRenderWindow()->getViewport(0)->getActualWidth() * 0.60;
@@ -509,14 +809,17 @@ void RollerCoaster::play()
 // Aply a rotation based on mouse speed
 void RollerCoaster::rotateCamera(int speedX, int speedY) noexcept
 {
-    auto cameraNode = scnMgr->getSceneNode("camNode");
-    cameraNode->pitch(Degree(-speedY), Node::TS_LOCAL);
-    cameraNode->yaw(Degree(-speedX), Node::TS_WORLD);
+    camNode->pitch(Degree(-speedY), Node::TS_LOCAL);
+    camNode->yaw(Degree(-speedX), Node::TS_WORLD);
 }
 
 // Override from TrayListener to manage click events in buttons
 void RollerCoaster::buttonHit(Button * button)
 {
+    if (player && !replaying)
+        return;
+    if (terrainBuild == TerrainBuild::Building) // The build mode replaces the screen of play() when the terrain is ready
+        return;
     Settings::sounds["click"].play();
     if(button->getCaption() == "PLAY")
     {
@@ -573,6 +876,18 @@ void RollerCoaster::buttonHit(Button * button)
         Settings::sounds["set"].play();
     }
 
+    if(button->getCaption() == "Redo")
+    {
+        this->redoEntity();
+        Settings::sounds["set"].play();
+    }
+
+    if(button->getCaption() == "Simulate")
+    {
+        this->toggleRide();
+        Settings::sounds["set"].play();
+    }
+
     if(button->getCaption() == "Map")
     {
         buttonMap = true;
@@ -584,6 +899,8 @@ void RollerCoaster::buttonHit(Button * button)
 // Override from TrayListener to manage slide events
 void RollerCoaster::sliderMoved(Slider * slider)
 {
+    if (player && !replaying)
+        return;
     if (slider->getName().compare("effects") == 0)
     {
         Settings::setFxVolume(this->fxVolume);
@@ -600,6 +917,8 @@ void RollerCoaster::sliderMoved(Slider * slider)
 // Override from TrayListener to manage slide events
 void RollerCoaster::itemSelected(SelectMenu *menu)
 {
+    if (player && !replaying)
+        return;
     if (menu->getName().compare("resolution") == 0)
     {
         std::string resolution = menu->getSelectedItem();
@@ -609,11 +928,31 @@ void RollerCoaster::itemSelected(SelectMenu *menu)
     }
 }
 
+// Override from TrayListener to manage check box events
+void RollerCoaster::checkBoxToggled(CheckBox *box)
+{
+    if (player && !replaying)
+        return;
+    if (box->getName().compare("staticWorld") == 0)
+    {
+        this->staticWorld = box->isChecked();
+        // Already playing: apply it now
+        if (this->mTerrainsImported && this->staticWorld != this->staticWorldBaked)
+        {
+            if (this->staticWorld)
+                bakeStaticWorld();
+            else
+                unbakeStaticWorld();
+        }
+    }
+    Settings::sounds["click"].play();
+}
+
 void RollerCoaster::windowResize(int width, int height)
 {
     getRenderWindow()->resize(width,height);
     // Set the aspect ratio for the new size
-    scnMgr->getCamera("myCam")->setAspectRatio(width / height);
+    myCam->setAspectRatio(width / height);
     // Letting Ogre know the window has been resized
     this->windowResized(getRenderWindow());
     //getRenderWindow()->windowMovedOrResized();
@@ -622,11 +961,12 @@ void RollerCoaster::windowResize(int width, int height)
 // Handle mouse wheel events (Zoom in or Zoom out)
 bool RollerCoaster::mouseWheelRolled(const MouseWheelEvent &evt) // Zoom in/out
 {
+    if (!acceptInput(evt))
+        return false;
     if(this->mTerrainsImported && !pause)
     {
-        auto direction {scnMgr->getCamera("myCam")->getRealDirection()};
-        auto cameraNode {scnMgr->getSceneNode("camNode")};
-        cameraNode->translate(evt.y * direction * 1.5);
+        auto direction {myCam->getRealDirection()};
+        camNode->translate(evt.y * direction * 1.5);
         return true;
     }
     return false;
@@ -635,8 +975,10 @@ bool RollerCoaster::mouseWheelRolled(const MouseWheelEvent &evt) // Zoom in/out
 // Handle click events (Save click position)
 bool RollerCoaster::mousePressed(const MouseButtonEvent &evt)
 {
-    Camera* myCam {scnMgr->getCamera("myCam")};
-    
+    if (!acceptInput(evt))
+        return false;
+    if (terrainBuild == TerrainBuild::Building)
+        return false;
     Ray mouseRay {
         myCam->getCameraToViewportRay(
             evt.x / float(myCam->getViewport()->getActualWidth()),
@@ -644,10 +986,21 @@ bool RollerCoaster::mousePressed(const MouseButtonEvent &evt)
             )
         };
 
-    std::vector<std::pair<SceneNode*, Vector3>> result {get_intersections(scnMgr->getSceneNode("worldNode"), mouseRay)};
-    if (not result.empty()) // Have colisions
+    BoundingVolumeHierarchy<EntityHandle>::Hit hit;
+    bool picked {false};
+    if (precisePicking)
     {
-        setHighlightedNode(result[0].first);
+        // Boxes are visited front to back and only the ones closer than the best triangle are refined
+        picked = pickTree.raycastNearest(mouseRay, hit, [this, &mouseRay](EntityHandle handle, Real) {
+            return colliders.intersects(entities.node(handle), mouseRay, std::numeric_limits<Real>::max());
+        });
+    }
+    else
+        picked = pickTree.raycastNearest(mouseRay, hit);
+
+    if (picked) // Have colisions
+    {
+        setHighlightedNode(hit.item);
         mMovableFound = true; // Flag to mark a selection
     }
     else // Click over world
@@ -661,6 +1014,8 @@ bool RollerCoaster::mousePressed(const MouseButtonEvent &evt)
 // Handle realese events (Save realese position)
 bool RollerCoaster::mouseReleased(const MouseButtonEvent &evt)
 {
+    if (!acceptInput(evt))
+        return false;
     if(worldWasClicked)
     {
         if(buttonDelete)
@@ -678,11 +1033,11 @@ bool RollerCoaster::mouseReleased(const MouseButtonEvent &evt)
 // Handle mouse movement events (Rotation direction, or move a node)
 bool RollerCoaster::mouseMoved(const MouseMotionEvent &evt)
 {    
+    if (!acceptInput(evt))
+        return false;
     if(this->mTerrainsImported && !pause)
     {
         // evt: type, windowID, x, y, xrel, yrel
-        Camera* myCam {scnMgr->getCamera("myCam")};
-        
         Ray mouseRay {
             myCam->getCameraToViewportRay(
                 evt.x / float(myCam->getViewport()->getActualWidth()),
@@ -709,6 +1064,8 @@ bool RollerCoaster::mouseMoved(const MouseMotionEvent &evt)
 
 bool RollerCoaster::keyReleased(const KeyboardEvent& evt)
 {
+    if (!acceptInput(evt))
+        return false;
     if (evt.keysym.sym == 1073742049)
     {
         shiftKey = false;
@@ -723,6 +1080,8 @@ bool RollerCoaster::keyReleased(const KeyboardEvent& evt)
 // Handle keyboard events (Translate or rotate camera)
 bool RollerCoaster::keyPressed(const KeyboardEvent& evt)
 {
+    if (!acceptInput(evt))
+        return false;
     if (ctrlKey and shiftKey and evt.keysym.sym == 101) // Exit game
     {
         delete trayMgr;
@@ -736,6 +1095,10 @@ bool RollerCoaster::keyPressed(const KeyboardEvent& evt)
     {
         ctrlKey = true;
     }
+    else if (terrainBuild == TerrainBuild::Building) // Nothing to build on or pause until the build mode is shown
+    {
+        return false;
+    }
     else if (evt.keysym.sym == SDLK_ESCAPE) // Press Esc
     {
         if(!this->pause)
@@ -746,63 +1109,55 @@ bool RollerCoaster::keyPressed(const KeyboardEvent& evt)
     }
     else if (evt.keysym.sym == SDLK_UP) // Up arrow : rotate x+ camera
     {
-        auto cameraNode = scnMgr->getSceneNode("camNode");
         if (highlightedNode == nullptr)
-            cameraNode->pitch(Degree(5), Node::TS_LOCAL);
+            camNode->pitch(Degree(5), Node::TS_LOCAL);
         else
             rotateHighlightedNode(90, true);
     }
     else if (evt.keysym.sym == SDLK_DOWN) // Down arrow : rotate x- camera
     {
-        auto cameraNode = scnMgr->getSceneNode("camNode");
         if (highlightedNode == nullptr)
-            cameraNode->pitch(Degree(-5), Node::TS_LOCAL);
+            camNode->pitch(Degree(-5), Node::TS_LOCAL);
         else
             rotateHighlightedNode(-90, true);
     }
     else if (evt.keysym.sym == SDLK_LEFT) // Left arrow : rotate y- camera
     {
-        auto cameraNode = scnMgr->getSceneNode("camNode");
         if (highlightedNode == nullptr)
-            cameraNode->yaw(Degree(5), Node::TS_WORLD);
+            camNode->yaw(Degree(5), Node::TS_WORLD);
         else
             rotateHighlightedNode(90, false);
     }
     else if (evt.keysym.sym == SDLK_RIGHT) // Right arrow : rotate y+ camera
     {
-        auto cameraNode = scnMgr->getSceneNode("camNode");
         if (highlightedNode == nullptr)
-            cameraNode->yaw(Degree(-5), Node::TS_WORLD);
+            camNode->yaw(Degree(-5), Node::TS_WORLD);
         else
             rotateHighlightedNode(-90, false);
     }
     else if (evt.keysym.sym == 119) // Key "w" : move up camera
     {
-        auto direction {scnMgr->getCamera("myCam")->getRealDirection()};
-        auto cameraNode {scnMgr->getSceneNode("camNode")};
-        cameraNode->translate(direction * 1.5);
+        auto direction {myCam->getRealDirection()};
+        camNode->translate(direction * 1.5);
         translateHighlightedNode(direction);
     }
     else if (evt.keysym.sym == 115) //Key "s" : move down camera
     {
-        auto direction {scnMgr->getCamera("myCam")->getRealDirection()};
-        auto cameraNode {scnMgr->getSceneNode("camNode")};
-        cameraNode->translate(-direction * 1.5);
+        auto direction {myCam->getRealDirection()};
+        camNode->translate(-direction * 1.5);
         translateHighlightedNode(-direction);
     }
     
     else if (evt.keysym.sym == 97) // Key "a" : move left camera
     {
-        auto direction = scnMgr->getCamera("myCam")->getRealRight();
-        auto cameraNode = scnMgr->getSceneNode("camNode");
-        cameraNode->translate(-direction * 1.5);
+        auto direction = myCam->getRealRight();
+        camNode->translate(-direction * 1.5);
         translateHighlightedNode(-direction);
     }
     else if (evt.keysym.sym == 100) // Key "d" : move right camera
     {
-        auto direction = scnMgr->getCamera("myCam")->getRealRight();
-        auto cameraNode = scnMgr->getSceneNode("camNode");
-        cameraNode->translate(direction * 1.5);
+        auto direction = myCam->getRealRight();
+        camNode->translate(direction * 1.5);
         translateHighlightedNode(direction);
     }
     else if (evt.keysym.sym == 99) // Key "c" : change mode camera
@@ -828,11 +1183,54 @@ bool RollerCoaster::keyPressed(const KeyboardEvent& evt)
     else if (evt.keysym.sym == 117) // Key "u" : undo entity
     {
         this->undoEntity();  
+    }
+    else if (evt.keysym.sym == 121) // Key "y" : redo entity
+    {
+        this->redoEntity();  
     }
      else if (evt.keysym.sym == 109) // Key "m" : change view of map
     {
         this->map();
     }
+    else if (evt.keysym.sym == 112) // Key "p" : change mode of picking
+    {
+        precisePicking = !precisePicking;
+    }
+    else if (evt.keysym.sym == 98 && this->mTerrainsImported) // Key "b" : switch the static world batching and report the difference
+    {
+        profiler.startComparison(staticWorldBaked ? "Static world batching off" : "Static world batching on");
+        if (staticWorldBaked)
+            unbakeStaticWorld();
+        else
+            bakeStaticWorld();
+        staticWorld = staticWorldBaked;
+    }
+    else if (evt.keysym.sym == 116) // Key "t" : save the track for the simulator
+    {
+        try
+        {
+            saveTrack(Settings::TRACK_FILE.string(), track);
+            std::cout << "Track saved to " << Settings::TRACK_FILE << '\n';
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+        }
+    }
+    else if ((evt.keysym.sym == 103 || evt.keysym.sym == 108) && this->mTerrainsImported) // Key "g" : save the park, key "l" : load it
+    {
+        try
+        {
+            if (evt.keysym.sym == 103)
+                saveParkFile();
+            else
+                loadParkFile();
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+        }
+    }
     else if (evt.keysym.sym == SDLK_SPACE) // Key "space" : deselect entity
     {
         this->resetHighlightedNode();  
@@ -840,35 +1238,74 @@ bool RollerCoaster::keyPressed(const KeyboardEvent& evt)
     return true;
 }
 
-void RollerCoaster::frameRendered(const Ogre::FrameEvent&)
+void RollerCoaster::frameRendered(const Ogre::FrameEvent& evt)
 {
-    if(mTerrainsImported && this->timer.getMilliseconds() > 60000)
+    // A recording and its replay advance the clocks by the same fixed delta, whatever the frame really took
+    float delta {evt.timeSinceLastFrame};
+    if (player)
+    {
+        replayFrame(evt);
+        delta = player->getHeader().frameDelta;
+    }
+    else if (recorder)
+        delta = Settings::REPLAY_FRAME_DELTA;
+    frameTimes.add(evt.timeSinceLastFrame * 1000);
+    ++frameIndex;
+
+    if (!streamer.finished())
+    {
+        streamer.update();
+        updateLoadingBar();
+        if (streamer.finished())
+            std::cout << "Resources streamed in " << streamer.getSeconds() << " s, " << memoryReport() << '\n';
+    }
+
+    // Only the segments touched since the last frame are sampled and extruded again
+    track.update();
+    trackMesh->sync(track);
+    if (clearance.update(track) > 0)
+        updateClearance();
+    updateRideGraph();
+    if (terrainBuild == TerrainBuild::Building)
+        updateTerrainBuild(evt.timeSinceLastFrame);
+    for (auto& pool : decorationPools)
+        pool.second->update(myCam->getDerivedPosition());
+
+    const RenderTarget::FrameStats& stats {getRenderWindow()->getStatistics()};
+    profiler.addFrame(evt.timeSinceLastFrame * 1000, stats.batchCount, stats.triangleCount);
+    if (profiler.comparisonReady())
+        std::cout << profiler.finishComparison() << '\n';
+
+    skyTime += delta;
+    clockTime += delta;
+    if(mTerrainsImported && skyTime > 60)
     {
         if(this->sky < 5)
             this->sky++;
         else
             this->sky = 1;
-            scnMgr->setSkyBox(true, "Sky/SkyBox"+std::to_string(this->sky));
-        timer.reset();
+        this->showSky(this->sky);
+        skyTime = 0;
     }
-    if(mTerrainsImported && !pause && this->timer2.getMilliseconds() > 1000)
+    if(mTerrainsImported && !pause && clockTime > 1)
     {
         clock->setCaption(std::to_string(this->time--));
-        timer2.reset();
+        clockTime = 0;
     }
 }
 
-void RollerCoaster::setHighlightedNode(SceneNode* node) noexcept
+void RollerCoaster::setHighlightedNode(EntityHandle handle) noexcept
 {
     if (highlightedNode == nullptr)
     {
-        highlightedNode = node;
+        highlighted = handle;
+        highlightedNode = entities.node(handle);
         highlightedNode->showBoundingBox(true);
     }
-    else if (highlightedNode != node)
+    else if (highlighted != handle)
     {
         resetHighlightedNode();
-        setHighlightedNode(node);
+        setHighlightedNode(handle);
     }
 }
 
@@ -876,7 +1313,6 @@ void RollerCoaster::setHighlightedNode(SceneNode* node) noexcept
 void RollerCoaster::rotateScene(int speedX, int speedY) noexcept
 {
     // Moving camNode to TempNode
-    SceneNode* camNode {scnMgr->getSceneNode("camNode")};
     SceneNode* fatherCamera {camNode->getParentSceneNode()};
     if(abs(speedX) > abs(speedY))
         camNode->yaw(Degree(speedX * 0.1));
@@ -890,78 +1326,120 @@ void RollerCoaster::resetHighlightedNode(void) noexcept
     {    
         highlightedNode->showBoundingBox(false);
         highlightedNode = nullptr;
+        highlighted = EntityHandle{};
     }
 }
 
-// wrapper to recursive get_intersections
+// All the picked nodes, queried on the bounding volume hierarchy of the world
 // SceneNode: Node intersected, Vector3: collision point 
 std::vector<std::pair<SceneNode*, Vector3>> RollerCoaster::get_intersections(SceneNode * node, Ray & ray)
 {
-    std::map<Real, SceneNode*> matchs; // Intersections ordered by distance
+    std::vector<BoundingVolumeHierarchy<EntityHandle>::Hit> hits; // Intersections ordered by distance
     std::vector<std::pair<SceneNode*, Vector3>> intersections; // Intersections ordered by distance with point intersection
     
-    get_intersections(node, ray, matchs); // Get all matchs
-    // Transform map<Distance, SceneNode*> to vector<pair<SceneNode*, Vector3>>
-    for (std::pair<Real, SceneNode*> match : matchs)
-    {
-        intersections.emplace_back(match.second, ray.getPoint(match.first));
-    }
-    
-    return intersections;
-}
-
-void RollerCoaster::get_intersections(SceneNode* node, Ray& ray, std::map<Real, SceneNode*>& matchs)
-{
-    std::vector<Node*> childs {node->getChildren()};
-    // Deep First Search
-    if (childs.size() > 0) // Not a leave
-    {
-        for (Node* child : childs)
-        {
-            SceneNode* n {scnMgr->getSceneNode(child->getName())};
-            get_intersections(n, ray, matchs);
-        }
-    }
-    else // Find a leave
+    pickTree.raycastAll(ray, hits);
+    for (const auto& hit : hits)
     {
-        SceneNode* camNode {scnMgr->getSceneNode("camNode")};
-        RayTestResult rTR {ray.intersects(node->_getWorldAABB())};
-        // Generate a map<Distance, SceneNode*> with intersections ordered by distance
-        if (rTR.first and camNode != node) // Intersection
+        // Only the descendants of the requested node
+        SceneNode* hitNode {entities.node(hit.item)};
+        for (Node* parent {hitNode}; parent != nullptr; parent = parent->getParent())
         {
-            matchs.emplace(rTR.second, node);
+            if (parent == node)
+            {
+                intersections.emplace_back(hitNode, ray.getPoint(hit.distance));
+                break;
+            }
         }
     }
+    
+    return intersections;
 }
 
 void RollerCoaster::translateHighlightedNode(Vector3 direction)
 {
     if (highlightedNode != nullptr)
+    {
+        NodeState before {captureState(highlighted)};
+        releaseStaticNode(highlightedNode);
         highlightedNode->translate(direction * 1.5);
+        snapRail(highlighted);
+        updatePickable(highlighted);
+        updateTrackPoint(highlighted);
+        // Consecutive moves of the same object end up in a single command
+        journal.record({EditCommand::Kind::Transform, true, highlighted, before, captureState(highlighted)});
+    }
 }
 
 void RollerCoaster::rotateHighlightedNode(float angle, bool pitch)
 {
     if (highlightedNode != nullptr)
     {
-        SceneNode* camNode {scnMgr->getSceneNode("camNode")};
         Vector3 nodePosition = highlightedNode->getPosition();
         Vector3 cameraPosition = camNode->getPosition();
         Vector3 direction = (nodePosition - cameraPosition).normalisedCopy();
         Vector3 yAxis = Vector3::UNIT_Y;
-        Vector3 xAxis = scnMgr->getCamera("myCam")->getRealRight();
-        Vector3 zAxis = scnMgr->getCamera("myCam")->getRealUp();
+        Vector3 xAxis = myCam->getRealRight();
+        Vector3 zAxis = myCam->getRealUp();
+        NodeState before {captureState(highlighted)};
+        releaseStaticNode(highlightedNode);
         if(pitch)
             highlightedNode->rotate(xAxis, Radian(-angle),Node::TS_PARENT);
         else
             highlightedNode->rotate(yAxis, Radian(-angle),Node::TS_PARENT);
+        updatePickable(highlighted);
+        updateTrackPoint(highlighted);
+        journal.record({EditCommand::Kind::Transform, false, highlighted, before, captureState(highlighted)});
     }
 }
-/*
-// Find all intersected nodes
 
+// Leaves of worldNode are kept in pickTree with their world AABB
+void RollerCoaster::addPickable(EntityHandle handle)
+{
+    SceneNode* node {entities.node(handle)};
+    node->_update(true, false); // Bring the world AABB up to date before the next frame
+    entities.pickProxy(handle) = pickTree.insert(node->_getWorldAABB(), handle);
+    updateObstacle(handle);
+
+    // Read the triangles now so the first click on this mesh does not pay for it
+    for (unsigned short i = 0; i < node->numAttachedObjects(); ++i)
+    {
+        if (const MeshPtr* mesh = MeshColliderCache::meshOf(node->getAttachedObject(i)))
+            colliders.get(*mesh);
+    }
+}
+
+void RollerCoaster::removePickable(EntityHandle handle)
+{
+    int& proxy {entities.pickProxy(handle)};
+    if (proxy >= 0)
+    {
+        pickTree.remove(proxy);
+        proxy = -1;
+    }
+    clearance.removeObstacle(handle.index);
+}
+
+void RollerCoaster::updatePickable(EntityHandle handle)
+{
+    int proxy {entities.pickProxy(handle)};
+    if (proxy >= 0)
+    {
+        SceneNode* node {entities.node(handle)};
+        node->_update(true, false);
+        pickTree.update(proxy, node->_getWorldAABB());
+        updateObstacle(handle);
+    }
+}
+
+// Decorations are the obstacles of the clearance check, the world pieces are the old coaster itself
+void RollerCoaster::updateObstacle(EntityHandle handle)
+{
+    if (entities.type(handle) != EntityType::Decoration)
+        return;
+    const AxisAlignedBox& bounds {entities.node(handle)->_getWorldAABB()};
+    clearance.setObstacle(handle.index, {{bounds.getMinimum().x, bounds.getMinimum().y, bounds.getMinimum().z}, {bounds.getMaximum().x, bounds.getMaximum().y, bounds.getMaximum().z}});
+}
 
-*/
 // END INTERFACE
 
 // START TOOL
@@ -982,14 +1460,19 @@ void RollerCoaster::loadResource()
                 Ogre::ConfigFile cf;
                 cf.load(this->resourcesFile);
                 Ogre::String name, locType;
-                for (const auto& ti : cf.getSettings())
+                // Every section is a group, initialising them only parses the scripts
+                for (const auto& section : cf.getSettingsBySection())
                 {
-                    locType = ti.first; 
-                    name = ti.second;
-                    Ogre::ResourceGroupManager::getSingleton().addResourceLocation(name, locType);
+                    for (const auto& ti : section.second)
+                    {
+                        locType = ti.first; 
+                        name = ti.second;
+                        Ogre::ResourceGroupManager::getSingleton().addResourceLocation(name, locType, section.first);
+                    }
                 }
-                Ogre::ResourceGroupManager::getSingletonPtr()->initialiseResourceGroup("General");
-                Ogre::ResourceGroupManager::getSingletonPtr()->loadResourceGroup("General");
+                Ogre::ResourceGroupManager::getSingletonPtr()->initialiseAllResourceGroups();
+                std::cout << preferCookedTextures() << " texture units use cooked textures\n";
+                streamResources();
 		        ifs.close();
             }
             else
@@ -1002,6 +1485,47 @@ void RollerCoaster::loadResource()
     }
 }
 
+// The menu only waits for the trays, the other groups are streamed by the scenes that use them
+void RollerCoaster::streamResources()
+{
+    auto materials {MaterialManager::getSingleton().getResourceIterator()};
+    while (materials.hasMoreElements())
+    {
+        ResourcePtr material {materials.getNext()};
+        if (material->getGroup() == "General")
+            streamer.add("Material", material->getName(), "General", StringUtil::startsWith(material->getName(), "SdkTrays/", false) ? LOAD_MENU : LOAD_REST);
+    }
+    streamer.finish(LOAD_MENU);
+}
+
+// The group of the next sky is streamed while this one is shown, only the one before is unloaded
+void RollerCoaster::showSky(int index)
+{
+    String group {"Sky"+std::to_string(index)};
+    streamer.addGroup(group, LOAD_WORLD);
+    streamer.finish(LOAD_WORLD);
+    scnMgr->setSkyBox(true, "Sky/SkyBox"+std::to_string(index), 5000, true, Quaternion::IDENTITY, group);
+    if (skyShown != 0 && skyShown != index)
+        streamer.unloadGroup("Sky"+std::to_string(skyShown));
+    skyShown = index;
+    streamer.addGroup("Sky"+std::to_string(index % 5 + 1), LOAD_REST);
+    std::cout << "Memory with sky " << index << ": " << memoryReport() << '\n';
+}
+
+void RollerCoaster::updateLoadingBar()
+{
+    auto bar {dynamic_cast<ProgressBar*>(trayMgr->getWidget("LoadingBar"))};
+    if (bar == nullptr)
+        return;
+    if (streamer.finished())
+    {
+        trayMgr->destroyWidget(bar);
+        return;
+    }
+    bar->setProgress(streamer.progress());
+    bar->setComment(streamer.getCurrent());
+}
+
 int RollerCoaster::randomNumber(int low, int high)
 {
     std::uniform_int_distribution<> dist (low,high);
@@ -1019,36 +1543,66 @@ void RollerCoaster::updateAccount()
 
 void RollerCoaster::createRail()
 {
-    SceneNode* ogreNode = scnMgr->getSceneNode("worldNode")->createChildSceneNode("ogreEntity"+std::to_string(this->entity++));
-    Entity* ogreEntity = scnMgr->createEntity("Cube.001.mesh");
-    ogreNode->attachObject(ogreEntity);
-    ogreNode->pitch(Degree(-90));
-    ogreNode->setPosition(scnMgr->getSceneNode("camNode")->getPosition()+scnMgr->getCamera("myCam")->getRealDirection()*10);
-    this->cash -= 100;
+    NodeState state {EntityType::Rail, journal.meshIndex("Cube.001.mesh"), 100, camNode->getPosition()+myCam->getRealDirection()*10, Quaternion(Degree(-90), Vector3::UNIT_X), Vector3::UNIT_SCALE};
+    journal.record({EditCommand::Kind::Create, false, placeEntity(state), state, state});
+    this->cash -= state.cost;
     this->updateAccount();
 }
 
 void RollerCoaster::createDecoration()
 {
-    SceneNode* ogreNode = scnMgr->getSceneNode("worldNode")->createChildSceneNode("ogreEntity"+std::to_string(this->entity++));
-    Entity* ogreEntity = scnMgr->createEntity("conifer_macedonian_pine.mesh");
-    ogreNode->setScale(0.01,0.01,0.01);
-    ogreNode->pitch(Degree(-90));
-    ogreNode->attachObject(ogreEntity);
-    ogreNode->setPosition(scnMgr->getSceneNode("camNode")->getPosition()+scnMgr->getCamera("myCam")->getRealDirection()*3);
-    this->cash -= 50;
+    NodeState state {EntityType::Decoration, journal.meshIndex("conifer_macedonian_pine.mesh"), 50, camNode->getPosition()+myCam->getRealDirection()*3, Quaternion(Degree(-90), Vector3::UNIT_X), Vector3(0.01, 0.01, 0.01)};
+    journal.record({EditCommand::Kind::Create, false, placeEntity(state), state, state});
+    this->cash -= state.cost;
     this->updateAccount();
 }
 
 void RollerCoaster::undoEntity()
 {
-    if (scnMgr->hasSceneNode("ogreEntity"+std::to_string(this->entity-1)))
-    {    
-        scnMgr->destroySceneNode("ogreEntity"+std::to_string(this->entity-1));
-        entity--;
+    if (const EditCommand* command = journal.undo())
+    {
+        if (command->handle == highlighted)
+            resetHighlightedNode();
+        switch (command->kind)
+        {
+            case EditCommand::Kind::Create:
+                removeEntity(command->handle);
+                this->cash += command->after.cost;
+                break;
+            case EditCommand::Kind::Delete:
+                restoreEntity(command->handle, command->before);
+                this->cash -= DELETE_REFUND;
+                break;
+            case EditCommand::Kind::Transform:
+                applyTransform(command->handle, command->before);
+                break;
+        }
     }
     buttonUndo = false;
-    this->cash += 25;
+    this->updateAccount();
+}
+
+void RollerCoaster::redoEntity()
+{
+    if (const EditCommand* command = journal.redo())
+    {
+        if (command->handle == highlighted)
+            resetHighlightedNode();
+        switch (command->kind)
+        {
+            case EditCommand::Kind::Create:
+                restoreEntity(command->handle, command->after);
+                this->cash -= command->after.cost;
+                break;
+            case EditCommand::Kind::Delete:
+                removeEntity(command->handle);
+                this->cash += DELETE_REFUND;
+                break;
+            case EditCommand::Kind::Transform:
+                applyTransform(command->handle, command->after);
+                break;
+        }
+    }
     this->updateAccount();
 }
 
@@ -1056,11 +1610,14 @@ void RollerCoaster::deleteEntity()
 {
     if (highlightedNode != nullptr)
     {    
-        scnMgr->destroySceneNode(highlightedNode);
-        highlightedNode = nullptr;
+        EntityHandle handle {highlighted};
+        NodeState state {captureState(handle)};
+        resetHighlightedNode();
+        removeEntity(handle);
+        journal.record({EditCommand::Kind::Delete, false, handle, state, state});
+        this->cash += DELETE_REFUND;
     }
     buttonDelete = false;
-    this->cash += 10;
     this->updateAccount();
 }
 
@@ -1068,16 +1625,14 @@ void RollerCoaster::map()
 {
     if(mapStatus)
     {
-        auto camNode = scnMgr->getSceneNode("camNode");
         camNode->setPosition(savePosition);
         camNode->setDirection(saveDirection, Node::TS_WORLD);
         this->mapStatus = false;
     }
     else
     {
-        auto camNode = scnMgr->getSceneNode("camNode");
         savePosition = camNode->getPosition();
-        saveDirection = scnMgr->getCamera("myCam")->getRealDirection();
+        saveDirection = myCam->getRealDirection();
         camNode->setPosition(-6,350,2000);
         camNode->lookAt(Ogre::Vector3(-6,-350,2000), Node::TS_WORLD);
         this->mapStatus = true;
@@ -1087,6 +1642,616 @@ void RollerCoaster::map()
 
 // END MENU GUI BUILD
 
+// START ENTITIES
+
+// New object with a new handle
+EntityHandle RollerCoaster::placeEntity(const NodeState& state)
+{
+    EntityHandle handle {entities.create(state.type, state.cost, buildNode(state))};
+    addPickable(handle);
+    if (state.type == EntityType::Rail)
+    {
+        railPoints.push_back(handle);
+        track.addPoint(controlPoint(handle));
+        updateConnectors(handle);
+    }
+    return handle;
+}
+
+// Object brought back by undo or redo under the handle it had
+void RollerCoaster::restoreEntity(EntityHandle handle, const NodeState& state)
+{
+    entities.restore(handle, state.type, state.cost, buildNode(state));
+    addPickable(handle);
+    if (state.type == EntityType::Rail)
+    {
+        track.insertPoint(trackIndex(handle), controlPoint(handle));
+        updateConnectors(handle);
+    }
+}
+
+// Detach the node from every system that references it before destroying it.
+// The handle stays reserved until the journal forgets it.
+void RollerCoaster::removeEntity(EntityHandle handle)
+{
+    SceneNode* node {entities.node(handle)};
+    if (entities.type(handle) == EntityType::Rail)
+    {
+        long index {trackIndex(handle)};
+        if (index >= 0) // Gone already when the whole park is replaced
+            track.removePoint(index);
+        connectors.removePiece(handle.index);
+        orderChangedChains();
+        track.setClosed(connectors.isClosed());
+    }
+    removePickable(handle);
+    releaseStaticNode(node);
+    for (auto& pool : decorationPools)
+    {
+        if (pool.second->release(node))
+            break;
+    }
+    scnMgr->destroySceneNode(node);
+    entities.retire(handle);
+}
+
+SceneNode* RollerCoaster::buildNode(const NodeState& state)
+{
+    SceneNode* node {worldNode->createChildSceneNode(state.position, state.orientation)};
+    node->setScale(state.scale);
+    if (state.type == EntityType::Decoration)
+        decorationPool(journal.meshName(state.mesh))->attach(node); // Hardware instances instead of an Entity per tree
+    else
+    {
+        const std::string& meshName {journal.meshName(state.mesh)};
+        ensureLods(MeshManager::getSingleton().load(meshName, ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME), lodProfile(state.type));
+        node->attachObject(scnMgr->createEntity(meshName));
+    }
+    return node;
+}
+
+NodeState RollerCoaster::captureState(EntityHandle handle)
+{
+    SceneNode* node {entities.node(handle)};
+    const MeshPtr* mesh {MeshColliderCache::meshOf(node->getAttachedObject(0))};
+    return {entities.type(handle), journal.meshIndex((*mesh)->getName()), entities.cost(handle), node->getPosition(), node->getOrientation(), node->getScale()};
+}
+
+void RollerCoaster::applyTransform(EntityHandle handle, const NodeState& state)
+{
+    SceneNode* node {entities.node(handle)};
+    releaseStaticNode(node);
+    node->setPosition(state.position);
+    node->setOrientation(state.orientation);
+    node->setScale(state.scale);
+    updatePickable(handle);
+    updateTrackPoint(handle);
+}
+
+DecorationPool* RollerCoaster::decorationPool(const std::string& meshName)
+{
+    std::unique_ptr<DecorationPool>& pool {decorationPools[meshName]};
+    if (!pool)
+    {
+        // The set of the decoration is loaded whole the first time one of it is placed
+        streamer.addGroup(ResourceGroupManager::getSingleton().findGroupContainingResource(meshName), LOAD_WORLD);
+        streamer.finish(LOAD_WORLD);
+        pool = std::make_unique<DecorationPool>(scnMgr, meshName, lodProfile(EntityType::Decoration));
+    }
+    return pool.get();
+}
+
+// END ENTITIES
+
+// START PARK
+
+// Rails go first in track order, so placing them again in the same order rebuilds the spline
+void RollerCoaster::saveParkFile()
+{
+    ParkContents park;
+    park.cash = this->cash;
+    park.time = this->time;
+    park.closed = track.isClosed();
+    park.terrain = "terrain" + std::to_string(this->sky) + ".png";
+    park.terrainSize = mTerrainGroup->getTerrainWorldSize();
+    for (size_t i = 0; i < track.pointCount(); ++i)
+    {
+        const ControlPoint& point {track.getPoint(i)};
+        park.points.push_back({{point.position.x, point.position.y, point.position.z}, {point.handle.x, point.handle.y, point.handle.z}, point.bank});
+    }
+
+    std::vector<EntityHandle> order;
+    for (EntityHandle rail : railPoints)
+    {
+        if (entities.valid(rail))
+            order.push_back(rail);
+    }
+    for (size_t i = 0; i < entities.size(); ++i)
+    {
+        if (entities.getTypes()[i] == EntityType::Decoration)
+            order.push_back(entities.handleAt(i));
+    }
+
+    std::vector<int> meshes; // Index in the park of each mesh of the journal, -1 while unused
+    for (EntityHandle handle : order)
+    {
+        NodeState state {captureState(handle)};
+        if (state.mesh >= meshes.size())
+            meshes.resize(state.mesh + 1, -1);
+        if (meshes[state.mesh] < 0)
+        {
+            meshes[state.mesh] = park.meshes.size();
+            park.meshes.push_back(journal.meshName(state.mesh));
+        }
+        const Quaternion& q {state.orientation};
+        park.entities.push_back({{state.position.x, state.position.y, state.position.z}, {q.w, q.x, q.y, q.z},
+                                 {state.scale.x, state.scale.y, state.scale.z}, state.cost, uint16_t(meshes[state.mesh]), uint8_t(state.type), 0});
+    }
+
+    savePark(Settings::PARK_FILE.string(), park);
+    std::cout << "Park saved to " << Settings::PARK_FILE << " with " << park.entities.size() << " objects\n";
+}
+
+// Replaces what was placed in build mode, the world pieces stay and the undo history starts again
+void RollerCoaster::loadParkFile()
+{
+    ParkView park {Settings::PARK_FILE.string()};
+    resetHighlightedNode();
+    if (ride)
+        toggleRide();
+
+    journal.clear();
+    std::vector<EntityHandle> placed;
+    for (size_t i = 0; i < entities.size(); ++i)
+    {
+        if (entities.getTypes()[i] != EntityType::World)
+            placed.push_back(entities.handleAt(i));
+    }
+    railPoints.clear();
+    track.clear();
+    for (EntityHandle handle : placed)
+    {
+        removeEntity(handle);
+        entities.release(handle);
+    }
+
+    std::vector<uint16_t> meshes(park.meshCount());
+    for (size_t i = 0; i < meshes.size(); ++i)
+        meshes[i] = journal.meshIndex(std::string{park.meshName(i)});
+    loadingPark = true;
+    for (size_t i = 0; i < park.entityCount(); ++i)
+    {
+        const ParkEntity& entity {park.entities()[i]};
+        const float* q {entity.orientation};
+        placeEntity({EntityType(entity.type), meshes[entity.mesh], entity.cost,
+                     Vector3{entity.position[0], entity.position[1], entity.position[2]}, Quaternion{q[0], q[1], q[2], q[3]},
+                     Vector3{entity.scale[0], entity.scale[1], entity.scale[2]}});
+    }
+    loadingPark = false;
+    orderRailPoints(); // Nothing moves when the park was saved in track order
+    track.setClosed(park.header().closed != 0);
+
+    // The rails give the positions, the park keeps the handles and the banks
+    for (size_t i = 0; i < std::min(park.pointCount(), track.pointCount()); ++i)
+    {
+        const ParkPoint& point {park.points()[i]};
+        track.setPoint(i, {{point.position[0], point.position[1], point.position[2]}, {point.handle[0], point.handle[1], point.handle[2]}, point.bank});
+    }
+
+    this->cash = park.header().cash;
+    this->time = park.header().time;
+    this->updateAccount();
+    clock->setCaption(std::to_string(this->time));
+    std::string terrain {"terrain" + std::to_string(this->sky) + ".png"};
+    if (park.terrain() != terrain)
+        std::cerr << "The park was built on " << park.terrain() << ", it is shown on " << terrain << '\n';
+    std::cout << "Park loaded from " << Settings::PARK_FILE << " with " << park.entityCount() << " objects\n";
+}
+
+// END PARK
+
+// START TRACK
+
+// Position of a live rail among the control points of the track
+long RollerCoaster::trackIndex(EntityHandle handle)
+{
+    long index {0};
+    for (auto rail {railPoints.begin()}; rail != railPoints.end();)
+    {
+        if (!entities.reserved(*rail))
+        {
+            rail = railPoints.erase(rail); // Forgotten by the journal
+            continue;
+        }
+        if (*rail == handle)
+            return index;
+        if (entities.valid(*rail))
+            ++index;
+        ++rail;
+    }
+    return -1;
+}
+
+ControlPoint RollerCoaster::controlPoint(EntityHandle handle)
+{
+    const Vector3& position {entities.node(handle)->getPosition()};
+    return {Vec3{position.x, position.y, position.z}};
+}
+
+void RollerCoaster::updateTrackPoint(EntityHandle handle)
+{
+    if (entities.type(handle) == EntityType::Rail)
+    {
+        track.setPoint(trackIndex(handle), controlPoint(handle));
+        updateConnectors(handle);
+    }
+}
+
+// The ends of a piece lie on the longest axis of its mesh, the rails are modelled with Z up
+void RollerCoaster::railConnectors(EntityHandle handle, Connector& entry, Connector& exit)
+{
+    SceneNode* node {entities.node(handle)};
+    const AxisAlignedBox& bounds {node->getAttachedObject(0)->getBoundingBox()};
+    Vector3 size {bounds.getSize() * node->getScale()};
+    int along {size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2)};
+    Vector3 axis {Vector3::ZERO};
+    axis[along] = 1;
+    Vector3 up {Vector3::ZERO};
+    up[along == 2 ? 1 : 2] = 1;
+
+    const Quaternion& orientation {node->getOrientation()};
+    Vector3 center {node->getPosition() + orientation * (bounds.getCenter() * node->getScale())};
+    Vector3 tangent {orientation * axis};
+    Vector3 half {tangent * (size[along] / 2)};
+    Vec3 direction {tangent.x, tangent.y, tangent.z};
+    Vector3 worldUp {orientation * up};
+    float bank {bankOf(direction, {worldUp.x, worldUp.y, worldUp.z})};
+    Vector3 start {center - half};
+    Vector3 end {center + half};
+    entry = {{start.x, start.y, start.z}, direction, bank, ConnectorKind::Entry};
+    exit = {{end.x, end.y, end.z}, direction, bank, ConnectorKind::Exit};
+}
+
+// Joins follow the piece, and the spline closes when the pieces make a single loop
+void RollerCoaster::updateConnectors(EntityHandle handle)
+{
+    Connector entry, exit;
+    railConnectors(handle, entry, exit);
+    connectors.setPiece(handle.index, entry, exit);
+    if (loadingPark)
+        return;
+    orderChangedChains();
+    track.setClosed(connectors.isClosed());
+}
+
+// The control points follow the joins from exit to entry, whatever order the pieces were placed in.
+// A chain starts at its open entry, or a loop at its piece first in the track
+uint32_t RollerCoaster::chainStart(uint32_t piece)
+{
+    if (connectors.inLoop(piece))
+        return piece;
+    while (connectors.previous(piece) != ConnectorIndex::NONE)
+        piece = connectors.previous(piece);
+    return piece;
+}
+
+// Only the chains whose joins changed are ordered again, the others already are
+void RollerCoaster::orderChangedChains()
+{
+    for (uint32_t piece : connectors.changedChains())
+        orderChain(piece);
+    connectors.clearChanges();
+}
+
+// Every chain in order at once, in the order of their first pieces; for a whole park, where
+// ordering the chains one join at a time would scan the rails once per join
+void RollerCoaster::orderRailPoints()
+{
+    railScratch.clear();
+    uint32_t pieces {0};
+    for (size_t slot = 0; slot < railPoints.size(); ++slot)
+    {
+        EntityHandle rail {railPoints[slot]};
+        if (entities.valid(rail) && connectors.contains(rail.index))
+        {
+            railScratch.push_back({slot, rail, {}});
+            pieces = std::max(pieces, rail.index + 1);
+        }
+    }
+    connectors.clearChanges();
+    if (railScratch.size() != track.pointCount())
+        return;
+
+    // The rank is the place in the track here, NONE once the piece is ordered
+    railRank.assign(pieces, ConnectorIndex::NONE);
+    for (size_t i = 0; i < railScratch.size(); ++i)
+    {
+        railScratch[i].point = track.getPoint(i);
+        railRank[railScratch[i].handle.index] = uint32_t(i);
+    }
+    railOrder.clear();
+    for (const RailPlace& place : railScratch)
+    {
+        if (railRank[place.handle.index] == ConnectorIndex::NONE)
+            continue;
+        for (uint32_t piece {chainStart(place.handle.index)}; piece < pieces && railRank[piece] != ConnectorIndex::NONE; piece = connectors.next(piece))
+        {
+            railOrder.push_back(railScratch[railRank[piece]]);
+            railRank[piece] = ConnectorIndex::NONE;
+        }
+    }
+    if (railOrder.size() != railScratch.size())
+        return;
+    for (size_t i = 0; i < railScratch.size(); ++i)
+    {
+        if (railScratch[i].handle != railOrder[i].handle)
+        {
+            railPoints[railScratch[i].slot] = railOrder[i].handle;
+            track.setPoint(i, railOrder[i].point);
+        }
+    }
+}
+
+// The pieces of the chain are gathered at the place of the first one, in chain order; the
+// rails between them keep their order after the chain. Nothing moves when it is in order
+void RollerCoaster::orderChain(uint32_t piece)
+{
+    if (!connectors.contains(piece))
+        return;
+    uint32_t chain {connectors.chainOf(piece)};
+
+    // From the first piece of the chain in the track to its last one
+    railScratch.clear();
+    size_t firstIndex {0};
+    size_t lastMember {0};
+    uint32_t found {0};
+    size_t index {0};
+    uint32_t pieces {0};
+    for (size_t slot = 0; slot < railPoints.size(); ++slot)
+    {
+        EntityHandle rail {railPoints[slot]};
+        if (!entities.valid(rail) || !connectors.contains(rail.index))
+            continue;
+        bool member {connectors.chainOf(rail.index) == chain};
+        if (member && railScratch.empty())
+            firstIndex = index;
+        if (member || !railScratch.empty())
+        {
+            railScratch.push_back({slot, rail, {}});
+            pieces = std::max(pieces, rail.index + 1);
+            if (member)
+            {
+                lastMember = railScratch.size();
+                ++found;
+            }
+        }
+        ++index;
+    }
+    if (railScratch.empty() || index != track.pointCount())
+        return;
+    railScratch.resize(lastMember);
+
+    if (railRank.size() < pieces)
+        railRank.resize(pieces);
+    uint32_t first {chainStart(railScratch.front().handle.index)};
+    uint32_t members {0};
+    uint32_t member {first};
+    do
+    {
+        railRank[member] = members++;
+        member = connectors.next(member);
+    } while (member != ConnectorIndex::NONE && member != first);
+    if (members != found)
+        return;
+
+    bool ordered {railScratch.size() == members};
+    for (uint32_t i = 0; ordered && i < members; ++i)
+        ordered = railRank[railScratch[i].handle.index] == i;
+    if (ordered)
+        return;
+
+    railOrder.resize(railScratch.size());
+    size_t after {members};
+    for (size_t i = 0; i < railScratch.size(); ++i)
+    {
+        RailPlace& place {railScratch[i]};
+        place.point = track.getPoint(firstIndex + i);
+        railOrder[connectors.chainOf(place.handle.index) == chain ? railRank[place.handle.index] : after++] = place;
+    }
+    for (size_t i = 0; i < railScratch.size(); ++i)
+    {
+        if (railScratch[i].handle != railOrder[i].handle)
+        {
+            railPoints[railScratch[i].slot] = railOrder[i].handle;
+            track.setPoint(firstIndex + i, railOrder[i].point);
+        }
+    }
+}
+
+// A dragged piece meets the nearest open end within the radius, rolled to its bank and keeping its heading
+void RollerCoaster::snapRail(EntityHandle handle)
+{
+    if (entities.type(handle) != EntityType::Rail)
+        return;
+
+    Connector ends[2];
+    railConnectors(handle, ends[0], ends[1]);
+    ConnectorMatch best {};
+    int own {-1};
+    for (int end = 0; end < 2; ++end)
+    {
+        ConnectorMatch match;
+        if (connectors.nearest(handle.index, ends[end], match) && (own < 0 || match.distance < best.distance))
+        {
+            best = match;
+            own = end;
+        }
+    }
+    if (own < 0)
+        return;
+
+    SceneNode* node {entities.node(handle)};
+    const Vec3& tangent {ends[own].tangent};
+    Vec3 from {bankedUp(tangent, ends[own].bank)};
+    Vec3 to {bankedUp(tangent, best.connector.bank)};
+    Radian roll {std::atan2(from.cross(to).dot(tangent), from.dot(to))};
+    node->rotate(Vector3{tangent.x, tangent.y, tangent.z}, roll, Node::TS_PARENT);
+
+    railConnectors(handle, ends[0], ends[1]);
+    Vec3 offset {best.connector.position - ends[own].position};
+    node->translate(offset.x, offset.y, offset.z, Node::TS_PARENT);
+}
+
+// Shows how many places of the track hit a decoration or the terrain, and where the first one is
+void RollerCoaster::updateClearance()
+{
+    auto label {dynamic_cast<Label*>(trayMgr->getWidget("ClearanceLabel"))};
+    if (label == nullptr)
+        return;
+
+    if (clearance.conflicts() == 0)
+    {
+        label->setCaption("Clear");
+        return;
+    }
+    for (size_t segment = 0; segment < clearance.segmentCount(); ++segment)
+    {
+        if (clearance.segmentHits(segment).empty())
+            continue;
+        std::ostringstream caption;
+        caption << clearance.conflicts() << " hits at " << int(track.segmentStart(segment) + clearance.segmentHits(segment).front().offset) << " m";
+        label->setCaption(caption.str());
+        return;
+    }
+}
+
+// END TRACK
+
+// START RIDE
+
+// Starts a train on the current track, or stops the one running
+void RollerCoaster::toggleRide()
+{
+    if (ride)
+    {
+        ride.reset();
+        trayMgr->destroyWidget("RideGraph");
+        trayMgr->destroyWidget("RideInfo");
+        return;
+    }
+    if (track.length() <= 0)
+        return;
+
+    TrainParameters parameters;
+    parameters.speed = DISPATCH_SPEED;
+    telemetry.clear();
+    ride = std::make_unique<RideSession>(track, parameters);
+    showRideGraph();
+}
+
+void RollerCoaster::showRideGraph()
+{
+    trayMgr->moveWidgetToTray(new GraphWidget("RideGraph", 512, 64), TL_BOTTOM);
+    trayMgr->createLabel(TL_BOTTOM, "RideInfo", "", 512);
+}
+
+// Drains the samples published by the simulation since the last frame
+void RollerCoaster::updateRideGraph()
+{
+    if (!ride)
+        return;
+
+    TelemetrySample sample;
+    bool received {false};
+    while (ride->getSamples().pop(sample))
+    {
+        telemetry.add(sample);
+        received = true;
+    }
+
+    // The widgets are gone while another menu is shown
+    auto graph {dynamic_cast<GraphWidget*>(trayMgr->getWidget("RideGraph"))};
+    auto info {dynamic_cast<Label*>(trayMgr->getWidget("RideInfo"))};
+    if (!received || graph == nullptr || info == nullptr)
+        return;
+
+    graph->draw(telemetry);
+    const TelemetrySample& last {telemetry.latest()};
+    std::ostringstream caption;
+    caption.precision(3);
+    caption << "Time " << last.time << " s  Speed " << last.speed << " m/s  Acc. " << last.acceleration << " m/s2  G " << last.vertical << " / " << last.lateral;
+    info->setCaption(caption.str());
+}
+
+// END RIDE
+
+// START REPLAY
+
+// Live events are recorded when a log is being written and ignored when one is played
+template<typename InputEvent>
+bool RollerCoaster::acceptInput(const InputEvent& evt)
+{
+    if (player)
+        return replaying;
+    if (recorder)
+        recorder->record(frameIndex, evt);
+    return true;
+}
+
+void RollerCoaster::startReplay()
+{
+    // The tray only receives the events of the log, always before the engine
+    removeInputListener(trayMgr);
+    std::cout << "Replaying the input, live input is ignored\n";
+}
+
+// Dispatches the events that arrived before this frame was rendered when the log was recorded
+void RollerCoaster::replayFrame(const Ogre::FrameEvent& evt)
+{
+    if (getRoot()->endRenderingQueued())
+        return;
+    trayMgr->frameRendered(evt); // Out of the listeners, it still updates its widgets
+    Event event;
+    replaying = true;
+    while (!getRoot()->endRenderingQueued() && player->next(frameIndex, event))
+    {
+        switch (event.type)
+        {
+            case KEYDOWN:
+                keyPressed(event.key);
+                break;
+            case KEYUP:
+                keyReleased(event.key);
+                break;
+            case MOUSEBUTTONDOWN:
+                trayMgr->mousePressed(event.button);
+                mousePressed(event.button);
+                break;
+            case MOUSEBUTTONUP:
+                trayMgr->mouseReleased(event.button);
+                mouseReleased(event.button);
+                break;
+            case MOUSEMOTION:
+                trayMgr->mouseMoved(event.motion);
+                mouseMoved(event.motion);
+                break;
+            case MOUSEWHEEL:
+                trayMgr->mouseWheelRolled(event.wheel);
+                mouseWheelRolled(event.wheel);
+                break;
+        }
+    }
+    replaying = false;
+
+    if (player->finished())
+    {
+        std::cout << "Replay finished after " << frameIndex << " frames\n";
+        getRoot()->queueEndRendering();
+    }
+}
+
+// END REPLAY
+
 // START TERRAIN
 
 void RollerCoaster::createScene()
@@ -1113,19 +2278,25 @@ void RollerCoaster::createScene()
     // The setFilenameConvention allows us to choose how our terrain will be saved
     // Finally, we set the origin to be used for our terrain
     mTerrainGroup = new Ogre::TerrainGroup(scnMgr, Ogre::Terrain::ALIGN_X_Z, 513, 12000.0);
-    mTerrainGroup->setFilenameConvention(Ogre::String("terrain"), Ogre::String("dat"));
     mTerrainGroup->setOrigin(Ogre::Vector3::ZERO);
+    mTerrainGroup->setResourceGroup("Terrain");
+    mTerrainGlobals->setDefaultResourceGroup("Terrain");
 
     this->configureTerrainDefaults(light);
 
+    // The files of the cache are named after what the terrain is made from, see terraincache.h
+    terrainKey = terrainCacheKey();
+    mTerrainGroup->setFilenameConvention(terrainCachePrefix(Settings::TERRAIN_CACHE, "terrain"+std::to_string(this->sky), terrainKey), Ogre::String("dat"));
+
+    terrainGenerated = false;
     for(long x = 0; x <= 0; ++x)
         for(long y = 0; y <= 0; ++y)
-            defineTerrain(x, y);
+            terrainGenerated = defineTerrain(x, y) || terrainGenerated;
     // Define our terrains and ask the TerrainGroup to load them all
     mTerrainGroup->loadAllTerrains(true);
 
-    // Initialize the blend maps for our terrain
-    if (mTerrainsImported)
+    // Initialize the blend maps for our terrain, the cached ones have them
+    if (terrainGenerated)
     {
         for (const auto& ti : mTerrainGroup->getTerrainSlots())
         {
@@ -1150,7 +2321,7 @@ void RollerCoaster::destroyScene()
 void RollerCoaster::getTerrainImage(bool flipX, bool flipY, Ogre::Image& img)
 {
     // This will load our 'terrain.png' resource.
-    img.load("terrain"+std::to_string(this->sky)+".png", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    img.load("terrain"+std::to_string(this->sky)+".png", mTerrainGroup->getResourceGroup());
    
     // Flipping is used to create seamless terrain so that unlimited terrain can be created using a single heightmap
     if (flipX)
@@ -1159,25 +2330,43 @@ void RollerCoaster::getTerrainImage(bool flipX, bool flipY, Ogre::Image& img)
         img.flipAroundX();
 }
 
-void RollerCoaster::defineTerrain(long x, long y)
+// The terrain chunk of this version of Ogre, whole; a truncated or older file would leave the terrain without heights
+static bool terrainCacheReadable(const Ogre::String& filename)
+{
+    try
+    {
+        Ogre::DataStreamPtr file {Root::openFileStream(filename)};
+        Ogre::StreamSerialiser stream {file};
+        const Ogre::StreamSerialiser::Chunk* chunk {stream.readChunkBegin(Ogre::Terrain::TERRAIN_CHUNK_ID, Ogre::Terrain::TERRAIN_CHUNK_VERSION)};
+        if (chunk != nullptr && chunk->version == Ogre::Terrain::TERRAIN_CHUNK_VERSION && file->tell() + chunk->length <= file->size())
+            return true;
+    }
+    catch (const std::exception&)
+    {
+        // Read like a file that is not there
+    }
+    std::cerr << "The terrain cache " << filename << " cannot be read, the terrain is generated again\n";
+    return false;
+}
+
+// True when the terrain is imported from the heightmap, false when it is read from the cache
+bool RollerCoaster::defineTerrain(long x, long y)
 {
     // Ask the TerrainGroup to define a unique filename for this Terrain.
     Ogre::String filename = mTerrainGroup->generateFilename(x, y);
-    // Check to see if a filename for this grid location has already been generated
-    bool exists = Ogre::ResourceGroupManager::getSingleton().resourceExists( mTerrainGroup->getResourceGroup(), filename);
+    // The cache is out of the resource groups, next to the executable; a file that cannot be read is made again
+    bool exists = fs::exists(filename) && terrainCacheReadable(filename);
     
     //If it has already been generated, then we can call TerrainGroup::defineTerrain method to set up this grid location with the previously generated filename automatically. 
     if (exists)
         mTerrainGroup->defineTerrain(x, y);
-    else //If it has not been generated, then we generate an image with getTerrainImage and then call a different overload of TerrainGroup::defineTerrain that takes a reference to our generated image. Finally, we set the mTerrainsImported flag to true. 
+    else //If it has not been generated, then we generate an image with getTerrainImage and then call a different overload of TerrainGroup::defineTerrain that takes a reference to our generated image.
     {
         Ogre::Image img;
         getTerrainImage(x % 2 != 0, y % 2 != 0, img);
         mTerrainGroup->defineTerrain(x, y, &img);
-        timer.reset(); //For the skybox
-        timer2.reset(); //For the clock
-        mTerrainsImported = true;
     }
+    return !exists;
 }
 
 // This method will blend together the different layers we defined in configureTerrainDefaults
@@ -1228,24 +2417,93 @@ void RollerCoaster::configureTerrainDefaults(Ogre::Light* light)
     importData.minBatchSize = 33; //2^n+1
     importData.maxBatchSize = 65; //2^n+1
 
-    // This way you save storage space and speed up loading
-    // However if you want more flexibility, you can also make Ogre combine the images at loading accordingly as shown below
-    Image combined;
-    combined.loadTwoImagesAsRGBA("Ground"+std::to_string(this->sky)+"_col.jpg", "Ground"+std::to_string(this->sky)+"_spec.png", "General");
-    TextureManager::getSingleton().loadImage("Ground_diffspec", "General", combined);
+    // The cooked layer has the specular in its alpha already, otherwise Ogre combines the images at loading
+    String ground {"Ground"+std::to_string(this->sky)};
+    String diffspec {cookedTexture(ground+"_diffspec")};
+    if (diffspec == ground+"_diffspec")
+    {
+        Image combined;
+        combined.loadTwoImagesAsRGBA(ground+"_col.jpg", ground+"_spec.png", "Terrain");
+        diffspec = "Ground_diffspec";
+        TextureManager::getSingleton().loadImage(diffspec, "Terrain", combined);
+    }
 
     // Texture
     // The texture's worldSize determines how big each splat of texture is going to be when applied to the terrain. 
     // A smaller value will increase the resolution of the rendered texture layer because each piece will be stretched less to fill in the terrain. 
     importData.layerList.resize(2);
     importData.layerList[0].worldSize = 20;
-    importData.layerList[0].textureNames.push_back("Ground_diffspec");
-    importData.layerList[0].textureNames.push_back("Ground"+std::to_string(this->sky)+"_spec.png");
+    importData.layerList[0].textureNames.push_back(diffspec);
+    importData.layerList[0].textureNames.push_back(ground+"_spec.png");
     importData.layerList[1].worldSize = 0;
-    importData.layerList[1].textureNames.push_back("Ground_diffspec");
+    importData.layerList[1].textureNames.push_back(diffspec);
     importData.layerList[1].textureNames.push_back("Ground_normheight.dds");
 }
 
+// Everything the saved terrain is derived from, the files by their contents
+ContentHash RollerCoaster::terrainCacheKey()
+{
+    ContentHash key;
+    auto addFile = [&key](const String& name)
+    {
+        key.add(name);
+        if (ResourceGroupManager::getSingleton().resourceExists("Terrain", name))
+            key.add(ResourceGroupManager::getSingleton().openResource(name, "Terrain")->getAsString());
+    };
+
+    key.add(TERRAIN_CACHE_VERSION);
+    key.add(mTerrainGroup->getAlignment());
+    key.add(mTerrainGroup->getTerrainSize());
+    key.add(mTerrainGroup->getTerrainWorldSize());
+    key.add(mTerrainGlobals->getMaxPixelError());
+    key.add(mTerrainGlobals->getCompositeMapDistance());
+    key.add(mTerrainGlobals->getCompositeMapSize());
+    key.add(mTerrainGlobals->getLightMapDirection());
+    key.add(mTerrainGlobals->getLightMapSize());
+    key.add(mTerrainGlobals->getLayerBlendMapSize());
+    key.add(mTerrainGlobals->getCompositeMapAmbient());
+    key.add(mTerrainGlobals->getCompositeMapDiffuse());
+
+    const Ogre::Terrain::ImportData& importData {mTerrainGroup->getDefaultImportSettings()};
+    key.add(importData.terrainSize);
+    key.add(importData.worldSize);
+    key.add(importData.inputScale);
+    key.add(importData.inputBias);
+    key.add(importData.minBatchSize);
+    key.add(importData.maxBatchSize);
+    for (const Ogre::Terrain::LayerInstance& layer : importData.layerList)
+    {
+        key.add(layer.worldSize);
+        for (const String& texture : layer.textureNames)
+            addFile(texture);
+    }
+
+    // The heightmap, and the images of the ground layer when Ogre combines them
+    addFile("terrain"+std::to_string(this->sky)+".png");
+    addFile("Ground"+std::to_string(this->sky)+"_col.jpg");
+    addFile("Ground"+std::to_string(this->sky)+"_spec.png");
+    return key;
+}
+
+// Called once the derived data of a generated terrain is built, the next launches read it instead
+void RollerCoaster::saveTerrainCache()
+{
+    std::error_code error;
+    fs::create_directories(Settings::TERRAIN_CACHE, error);
+    try
+    {
+        mTerrainGroup->saveAllTerrains(true);
+        std::string heightmap {"terrain"+std::to_string(this->sky)};
+        size_t removed {removeStaleTerrainCaches(Settings::TERRAIN_CACHE, heightmap, terrainKey)};
+        std::cout << "Terrain saved to " << mTerrainGroup->generateFilename(0, 0) << ", " << removed << " older files of " << heightmap << " removed\n";
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "The terrain could not be cached: " << e.what() << '\n';
+    }
+    terrainGenerated = false;
+}
+
 // END TERRAIN
 
 int main(int argc, char **argv)
@@ -1253,8 +2511,22 @@ int main(int argc, char **argv)
     try
     {
     	RollerCoaster app;
+        bool profile {false};
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string option {argv[i]};
+            if (option == "--record" && i + 1 < argc)
+                app.recordInput(argv[++i]);
+            else if (option == "--replay" && i + 1 < argc)
+                app.replayInput(argv[++i]);
+            else
+                throw std::runtime_error{"Unknown option " + option + ", expected --record FILE or --replay FILE"};
+            profile = true;
+        }
         app.initApp();
         app.getRoot()->startRendering();
+        if (profile)
+            std::cout << app.frameReport();
         app.closeApp();
     }
     catch (const std::exception& e)
@@ -0,0 +1,227 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the headless simulator. It loads a track file, runs the
+ride without a window and prints the telemetry and the summary, so rides can
+be checked in batch on servers without a graphics card.
+*/
+
+#include "trackfile.h"
+#include "parkfile.h"
+#include "physics.h"
+#include "sweep.h"
+#include "operations.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace
+{
+    void usage()
+    {
+        std::cerr << "Usage: rce-sim TRACK|PARK [options]\n"
+                  << "  --speed M/S        Speed of the train when it is dispatched (0)\n"
+                  << "  --mass KG          Mass of the empty train (6000)\n"
+                  << "  --load KG          Mass of the passengers (0)\n"
+                  << "  --friction C       Rolling friction coefficient (0.003)\n"
+                  << "  --drag M2          Drag coefficient times frontal area (2)\n"
+                  << "  --wind X Y Z       Wind in meters per second (0 0 0)\n"
+                  << "  --time S           Longest ride to simulate (600)\n"
+                  << "  --timestep S       Fixed timestep (1/240)\n"
+                  << "  --telemetry FILE   Write the telemetry as CSV, - for the standard output\n"
+                  << "  --rate HZ          Telemetry samples per second (10)\n"
+                  << "  --sweep            Simulate the default parameter grid instead of one train\n"
+                  << "  --threads N        Threads of the sweep (all the cores)\n"
+                  << "  --operations       Simulate a day of operation with the layout of the track file\n"
+                  << "  --trains N         Trains on the circuit (2)\n"
+                  << "  --seats N          Riders per train (24)\n"
+                  << "  --dwell S          Seconds to unload and load in the station (45)\n"
+                  << "  --interval S       Least seconds between dispatches (0)\n"
+                  << "  --hours H          Length of the operating day (12)\n"
+                  << "  --train-length M   Length of a train (12)\n"
+                  << "  --export           Write a park file (.rcep) as text to the standard output\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || std::strcmp(argv[1], "--help") == 0)
+    {
+        usage();
+        return argc < 2 ? 1 : 0;
+    }
+
+    TrainParameters parameters;
+    float maxTime {600};
+    float timestep {1.0f / 240};
+    float rate {10};
+    std::string telemetryPath;
+    bool sweep {false};
+    size_t threads {std::thread::hardware_concurrency()};
+    bool operations {false};
+    OperationsPlan plan;
+    bool exportText {false};
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string option {argv[i]};
+        auto value = [&](int count = 1) -> bool { return i + count < argc; };
+        if (option == "--speed" && value())
+            parameters.speed = std::atof(argv[++i]);
+        else if (option == "--mass" && value())
+            parameters.mass = std::atof(argv[++i]);
+        else if (option == "--load" && value())
+            parameters.passengerMass = std::atof(argv[++i]);
+        else if (option == "--friction" && value())
+            parameters.rollingFriction = std::atof(argv[++i]);
+        else if (option == "--drag" && value())
+            parameters.dragArea = std::atof(argv[++i]);
+        else if (option == "--wind" && value(3))
+        {
+            parameters.wind.x = std::atof(argv[++i]);
+            parameters.wind.y = std::atof(argv[++i]);
+            parameters.wind.z = std::atof(argv[++i]);
+        }
+        else if (option == "--time" && value())
+            maxTime = std::atof(argv[++i]);
+        else if (option == "--timestep" && value())
+            timestep = std::atof(argv[++i]);
+        else if (option == "--telemetry" && value())
+            telemetryPath = argv[++i];
+        else if (option == "--rate" && value())
+            rate = std::atof(argv[++i]);
+        else if (option == "--sweep")
+            sweep = true;
+        else if (option == "--threads" && value())
+            threads = std::atoi(argv[++i]);
+        else if (option == "--operations")
+            operations = true;
+        else if (option == "--trains" && value())
+            plan.trains = std::atoi(argv[++i]);
+        else if (option == "--seats" && value())
+            plan.seats = std::atoi(argv[++i]);
+        else if (option == "--dwell" && value())
+            plan.dwell = std::atof(argv[++i]);
+        else if (option == "--interval" && value())
+            plan.dispatchInterval = std::atof(argv[++i]);
+        else if (option == "--hours" && value())
+            plan.hours = std::atof(argv[++i]);
+        else if (option == "--train-length" && value())
+            plan.trainLength = std::atof(argv[++i]);
+        else if (option == "--export")
+            exportText = true;
+        else
+        {
+            std::cerr << "Unknown option " << option << '\n';
+            usage();
+            return 1;
+        }
+    }
+
+    try
+    {
+        Track track;
+        RideLayout layout;
+        if (std::filesystem::path{argv[1]}.extension() == ".rcep")
+        {
+            // A park has the track of the engine but no ride layout
+            ParkView park {argv[1]};
+            if (exportText)
+            {
+                exportPark(park, std::cout);
+                return 0;
+            }
+            loadParkTrack(park, track);
+        }
+        else if (exportText)
+            throw std::runtime_error{"--export needs a park file"};
+        else
+            loadTrack(argv[1], track, &layout);
+        if (track.length() <= 0)
+            throw std::runtime_error{"The track has less than two points"};
+        std::cout << "Track: " << track.pointCount() << " points, " << track.length() << " m"
+                  << (track.isClosed() ? ", closed" : ", open") << '\n';
+
+        if (sweep)
+        {
+            SweepGrid grid;
+            grid.speed = parameters.speed;
+            grid.maxTime = maxTime;
+            ThreadPool pool {threads};
+            std::cout << runSweep(track, grid, pool).report();
+            return 0;
+        }
+
+        if (operations)
+        {
+            plan.train = parameters;
+            plan.timestep = timestep;
+            OperationsSimulation day {track, layout, plan};
+            auto start {std::chrono::steady_clock::now()};
+            OperationsReport report {day.run()};
+            std::cout << report.report() << "Simulated " << plan.hours << " h in "
+                      << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s\n";
+            return 0;
+        }
+
+        std::ofstream telemetryFile;
+        std::ostream* telemetry {nullptr};
+        if (telemetryPath == "-")
+            telemetry = &std::cout;
+        else if (!telemetryPath.empty())
+        {
+            telemetryFile.open(telemetryPath);
+            if (!telemetryFile)
+                throw std::runtime_error{"Error writing telemetry " + telemetryPath};
+            telemetry = &telemetryFile;
+        }
+
+        RideObserver observer;
+        if (telemetry != nullptr)
+        {
+            *telemetry << "time,distance,speed,acceleration,vertical_g,lateral_g,longitudinal_g\n";
+            int every {std::max(1, int(1 / (rate * timestep) + 0.5f))};
+            observer = [telemetry, every, step = 0](const TrainSimulation& simulation) mutable
+            {
+                if (step++ % every != 0)
+                    return;
+                GForce g {simulation.gforce(0)};
+                *telemetry << simulation.getTime() << ',' << simulation.distance(0) << ',' << simulation.speed(0) << ','
+                           << simulation.acceleration(0) << ',' << g.vertical << ',' << g.lateral << ',' << g.longitudinal << '\n';
+            };
+        }
+
+        RideResult ride {simulateRide(track, parameters, maxTime, timestep, observer)};
+        std::ostream& summary {telemetry == &std::cout ? std::cerr : std::cout};
+        if (ride.lapTime >= 0)
+            summary << "Ride time: " << ride.lapTime << " s\n";
+        else
+            summary << (ride.rolledBack ? "The train rolled back\n" : "The train did not finish the ride\n");
+        summary << "Vertical g: " << ride.minVertical << " to " << ride.maxVertical << '\n'
+                << "Lateral g: " << ride.maxLateral << ", longitudinal g: " << ride.maxLongitudinal << '\n'
+                << "Slowest crest: " << (std::isinf(ride.minCrestSpeed) ? 0 : ride.minCrestSpeed) << " m/s\n";
+        return ride.lapTime >= 0 ? 0 : 2;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error occurred during simulation: " << e.what() << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,300 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the block compression of the textures cooked offline.
+Every 4x4 block of pixels is stored as two colours of 16 bits and an index of
+2 bits per pixel into the four colours between them (BC1, 8 bytes), plus in
+BC3 two alphas and an index of 3 bits per pixel into the eight alphas between
+them (16 bytes). The colours are the ends of the pixels along their principal
+axis. The mipmaps are box filtered down to 1x1 and written with the faces in
+a DDS file, which the graphics card reads without decoding.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+enum class BlockFormat
+{
+    BC1, // Colour, 4 bits per pixel
+    BC3  // Colour and alpha, 8 bits per pixel
+};
+
+// Pixels in RGBA order, 4 bytes each, rows from the top
+struct RgbaImage
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+inline size_t blockBytes(BlockFormat format)
+{
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+inline size_t compressedSize(uint32_t width, uint32_t height, BlockFormat format)
+{
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+// Half the size, odd sides keep their last row or column in the average
+inline RgbaImage halfSize(const RgbaImage& image)
+{
+    RgbaImage half;
+    half.width = std::max(1u, image.width / 2);
+    half.height = std::max(1u, image.height / 2);
+    half.pixels.resize(size_t(half.width) * half.height * 4);
+    for (uint32_t y = 0; y < half.height; ++y)
+    {
+        uint32_t y0 {std::min(y * 2, image.height - 1)};
+        uint32_t y1 {std::min(y * 2 + 1, image.height - 1)};
+        for (uint32_t x = 0; x < half.width; ++x)
+        {
+            uint32_t x0 {std::min(x * 2, image.width - 1)};
+            uint32_t x1 {std::min(x * 2 + 1, image.width - 1)};
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                uint32_t sum {uint32_t(image.pixels[(size_t(y0) * image.width + x0) * 4 + c]) + image.pixels[(size_t(y0) * image.width + x1) * 4 + c]
+                    + image.pixels[(size_t(y1) * image.width + x0) * 4 + c] + image.pixels[(size_t(y1) * image.width + x1) * 4 + c]};
+                half.pixels[(size_t(y) * half.width + x) * 4 + c] = uint8_t((sum + 2) / 4);
+            }
+        }
+    }
+    return half;
+}
+
+// The image and its mipmaps down to 1x1
+inline std::vector<RgbaImage> mipChain(RgbaImage image)
+{
+    std::vector<RgbaImage> chain;
+    chain.push_back(std::move(image));
+    while (chain.back().width > 1 || chain.back().height > 1)
+        chain.push_back(halfSize(chain.back()));
+    return chain;
+}
+
+namespace blockcompress
+{
+    inline uint16_t to565(const float colour[3])
+    {
+        auto channel = [](float value, int bits) { return uint16_t(std::lround(std::clamp(value, 0.0f, 255.0f) * ((1 << bits) - 1) / 255.0f)); };
+        return uint16_t(channel(colour[0], 5) << 11 | channel(colour[1], 6) << 5 | channel(colour[2], 5));
+    }
+
+    inline std::array<int, 3> from565(uint16_t packed)
+    {
+        int r {packed >> 11 & 31};
+        int g {packed >> 5 & 63};
+        int b {packed & 31};
+        return {r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2};
+    }
+
+    // The four colours of the block with c0 > c1, the only mode BC3 knows
+    inline void encodeColour(const uint8_t block[64], uint8_t out[8])
+    {
+        float mean[3] {0, 0, 0};
+        for (int p = 0; p < 16; ++p)
+        {
+            for (int c = 0; c < 3; ++c)
+                mean[c] += block[p * 4 + c] / 16.0f;
+        }
+        float covariance[6] {0, 0, 0, 0, 0, 0}; // rr, rg, rb, gg, gb, bb
+        for (int p = 0; p < 16; ++p)
+        {
+            float d[3] {block[p * 4] - mean[0], block[p * 4 + 1] - mean[1], block[p * 4 + 2] - mean[2]};
+            covariance[0] += d[0] * d[0];
+            covariance[1] += d[0] * d[1];
+            covariance[2] += d[0] * d[2];
+            covariance[3] += d[1] * d[1];
+            covariance[4] += d[1] * d[2];
+            covariance[5] += d[2] * d[2];
+        }
+
+        // Principal axis by power iteration, starting from the luminance
+        float axis[3] {0.3f, 0.6f, 0.1f};
+        for (int i = 0; i < 8; ++i)
+        {
+            float next[3] {covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]};
+            float length {std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2])};
+            if (length < 1e-6f)
+                break;
+            for (int c = 0; c < 3; ++c)
+                axis[c] = next[c] / length;
+        }
+
+        float low {0};
+        float high {0};
+        for (int p = 0; p < 16; ++p)
+        {
+            float t {(block[p * 4] - mean[0]) * axis[0] + (block[p * 4 + 1] - mean[1]) * axis[1] + (block[p * 4 + 2] - mean[2]) * axis[2]};
+            low = std::min(low, t);
+            high = std::max(high, t);
+        }
+        float start[3];
+        float end[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            start[c] = mean[c] + axis[c] * high;
+            end[c] = mean[c] + axis[c] * low;
+        }
+        uint16_t c0 {to565(start)};
+        uint16_t c1 {to565(end)};
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        std::array<int, 3> palette[4] {from565(c0), from565(c1), {}, {}};
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        uint32_t indices {0};
+        if (c0 != c1) // Otherwise every pixel takes the first colour
+        {
+            for (int p = 0; p < 16; ++p)
+            {
+                int best {0};
+                int bestDistance {1 << 30};
+                for (int i = 0; i < 4; ++i)
+                {
+                    int distance {0};
+                    for (int c = 0; c < 3; ++c)
+                        distance += (block[p * 4 + c] - palette[i][c]) * (block[p * 4 + c] - palette[i][c]);
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        best = i;
+                    }
+                }
+                indices |= uint32_t(best) << (p * 2);
+            }
+        }
+        out[0] = uint8_t(c0);
+        out[1] = uint8_t(c0 >> 8);
+        out[2] = uint8_t(c1);
+        out[3] = uint8_t(c1 >> 8);
+        for (int i = 0; i < 4; ++i)
+            out[4 + i] = uint8_t(indices >> (i * 8));
+    }
+
+    // The eight alphas of the block with a0 > a1
+    inline void encodeAlpha(const uint8_t block[64], uint8_t out[8])
+    {
+        int a0 {0};
+        int a1 {255};
+        for (int p = 0; p < 16; ++p)
+        {
+            a0 = std::max<int>(a0, block[p * 4 + 3]);
+            a1 = std::min<int>(a1, block[p * 4 + 3]);
+        }
+        uint64_t indices {0};
+        if (a0 != a1) // Otherwise every pixel takes the first alpha
+        {
+            int palette[8] {a0, a1};
+            for (int i = 1; i < 7; ++i)
+                palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+            for (int p = 0; p < 16; ++p)
+            {
+                int best {0};
+                for (int i = 1; i < 8; ++i)
+                {
+                    if (std::abs(block[p * 4 + 3] - palette[i]) < std::abs(block[p * 4 + 3] - palette[best]))
+                        best = i;
+                }
+                indices |= uint64_t(best) << (p * 3);
+            }
+        }
+        out[0] = uint8_t(a0);
+        out[1] = uint8_t(a1);
+        for (int i = 0; i < 6; ++i)
+            out[2 + i] = uint8_t(indices >> (i * 8));
+    }
+}
+
+// Blocks from left to right and top to bottom, the pixels past the sides repeat the last ones
+inline std::vector<uint8_t> compressBlocks(const RgbaImage& image, BlockFormat format)
+{
+    std::vector<uint8_t> blocks(compressedSize(image.width, image.height, format));
+    uint8_t* out {blocks.data()};
+    uint8_t block[64];
+    for (uint32_t by = 0; by < image.height; by += 4)
+    {
+        for (uint32_t bx = 0; bx < image.width; bx += 4)
+        {
+            for (uint32_t p = 0; p < 16; ++p)
+            {
+                uint32_t x {std::min(bx + p % 4, image.width - 1)};
+                uint32_t y {std::min(by + p / 4, image.height - 1)};
+                std::copy_n(&image.pixels[(size_t(y) * image.width + x) * 4], 4, &block[p * 4]);
+            }
+            if (format == BlockFormat::BC3)
+            {
+                blockcompress::encodeAlpha(block, out);
+                out += 8;
+            }
+            blockcompress::encodeColour(block, out);
+            out += 8;
+        }
+    }
+    return blocks;
+}
+
+// Header of 128 bytes, then every face with its mipmaps from the largest; 6 faces make a cube map
+inline void writeDds(std::ostream& out, uint32_t width, uint32_t height, BlockFormat format, const std::vector<std::vector<std::vector<uint8_t>>>& faces)
+{
+    auto word = [&out](uint32_t value)
+    {
+        char bytes[4] {char(value), char(value >> 8), char(value >> 16), char(value >> 24)};
+        out.write(bytes, 4);
+    };
+    uint32_t mipmaps {uint32_t(faces.front().size())};
+    bool cube {faces.size() == 6};
+
+    out.write("DDS ", 4);
+    word(124);
+    word(0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000); // Caps, height, width, pixel format, mipmap count, linear size
+    word(height);
+    word(width);
+    word(uint32_t(compressedSize(width, height, format)));
+    word(0); // Depth
+    word(mipmaps);
+    for (int i = 0; i < 11; ++i)
+        word(0);
+    word(32); // Pixel format
+    word(0x4); // Four CC
+    out.write(format == BlockFormat::BC1 ? "DXT1" : "DXT5", 4);
+    for (int i = 0; i < 5; ++i)
+        word(0);
+    word(0x1000 | 0x8 | 0x400000); // Texture, complex, mipmaps
+    word(cube ? 0x200 | 0xFC00 : 0); // Cube map with all its faces
+    for (int i = 0; i < 3; ++i)
+        word(0);
+
+    for (const auto& face : faces)
+    {
+        for (const auto& level : face)
+            out.write(reinterpret_cast<const char*>(level.data()), std::streamsize(level.size()));
+    }
+}
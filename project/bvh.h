@@ -0,0 +1,480 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the bounding volume hierarchy used to pick the objects of
+the world. It is a dynamic AABB tree: leaves are inserted, moved and removed
+one by one and the tree is kept balanced with rotations, so ray queries stay
+logarithmic while the park is being edited.
+*/
+
+#pragma once
+
+#include "Ogre.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+// Compact box used by the tree (Ogre::AxisAlignedBox carries extent flags we do not need)
+struct BoundingBox
+{
+    Ogre::Vector3 min;
+    Ogre::Vector3 max;
+
+    static BoundingBox from(const Ogre::AxisAlignedBox& box)
+    {
+        if (box.isFinite())
+            return {box.getMinimum(), box.getMaximum()};
+        return {Ogre::Vector3::ZERO, Ogre::Vector3::ZERO};
+    }
+
+    BoundingBox merge(const BoundingBox& other) const
+    {
+        BoundingBox result {min, max};
+        result.min.makeFloor(other.min);
+        result.max.makeCeil(other.max);
+        return result;
+    }
+
+    bool contains(const BoundingBox& other) const
+    {
+        return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z
+            && max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+    }
+
+    // Half of the surface area, enough to compare insertion costs
+    Ogre::Real area() const
+    {
+        Ogre::Vector3 d {max - min};
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+};
+
+// Ray with the inverse direction precomputed for the slab test
+struct BoundingRay
+{
+    Ogre::Vector3 origin;
+    Ogre::Vector3 invDirection;
+
+    explicit BoundingRay(const Ogre::Ray& ray) :
+        origin{ray.getOrigin()},
+        invDirection{1.0f / ray.getDirection().x, 1.0f / ray.getDirection().y, 1.0f / ray.getDirection().z}
+    {}
+
+    // Distance to the entry point of the box, or a negative value when it is missed
+    Ogre::Real intersects(const BoundingBox& box, Ogre::Real maxDistance) const
+    {
+        Ogre::Real tMin {0}, tMax {maxDistance};
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            Ogre::Real t0 {(box.min[axis] - origin[axis]) * invDirection[axis]};
+            Ogre::Real t1 {(box.max[axis] - origin[axis]) * invDirection[axis]};
+            if (t0 > t1)
+                std::swap(t0, t1);
+            tMin = t0 > tMin ? t0 : tMin;
+            tMax = t1 < tMax ? t1 : tMax;
+            if (tMin > tMax)
+                return -1;
+        }
+        return tMin;
+    }
+};
+
+template <typename T>
+class BoundingVolumeHierarchy
+{
+    public:
+        struct Hit
+        {
+            T item;
+            Ogre::Real distance;
+        };
+
+        BoundingVolumeHierarchy(Ogre::Real margin = 0.5f);
+
+        // Returns a proxy id that identifies the leaf until it is removed
+        int insert(const Ogre::AxisAlignedBox&, T);
+        void remove(int);
+        // Returns true if the leaf had to be moved inside the tree
+        bool update(int, const Ogre::AxisAlignedBox&);
+        void clear();
+
+        const T& getItem(int proxy) const { return nodes[proxy].item; }
+        int size() const { return leafCount; }
+        int height() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+
+        // Closest leaf hit by the ray, optionally refined by a narrow test
+        bool raycastNearest(const Ogre::Ray&, Hit&) const;
+        template <typename NarrowTest>
+        bool raycastNearest(const Ogre::Ray&, Hit&, NarrowTest) const;
+        // Every leaf hit by the ray, ordered by distance
+        void raycastAll(const Ogre::Ray&, std::vector<Hit>&) const;
+
+    private:
+        static constexpr int NULL_NODE = -1;
+
+        struct TreeNode
+        {
+            BoundingBox box;   // Fattened for leaves
+            BoundingBox tight; // Exact box of the leaf, used to answer queries
+            T item;
+            int parent;
+            int left;
+            int right;
+            int height; // Leaves have height 0, free nodes -1
+
+            bool isLeaf() const { return left == NULL_NODE; }
+        };
+
+        int allocateNode();
+        void freeNode(int);
+        void insertLeaf(int);
+        void removeLeaf(int);
+        int balance(int);
+        void refit(int);
+
+        std::vector<TreeNode> nodes;
+        int root;
+        int freeList;
+        int leafCount;
+        Ogre::Real margin; // Fattening of the leaves so small moves do not touch the tree
+        mutable std::vector<int> stack;
+};
+
+template <typename T>
+BoundingVolumeHierarchy<T>::BoundingVolumeHierarchy(Ogre::Real margin) :
+    root{NULL_NODE},
+    freeList{NULL_NODE},
+    leafCount{0},
+    margin{margin}
+{}
+
+template <typename T>
+int BoundingVolumeHierarchy<T>::allocateNode()
+{
+    if (freeList == NULL_NODE)
+    {
+        nodes.push_back(TreeNode{});
+        nodes.back().parent = NULL_NODE;
+        freeList = nodes.size() - 1;
+    }
+    int id {freeList};
+    freeList = nodes[id].parent;
+    nodes[id].parent = NULL_NODE;
+    nodes[id].left = NULL_NODE;
+    nodes[id].right = NULL_NODE;
+    nodes[id].height = 0;
+    return id;
+}
+
+template <typename T>
+void BoundingVolumeHierarchy<T>::freeNode(int id)
+{
+    nodes[id].parent = freeList;
+    nodes[id].height = -1;
+    nodes[id].item = T{};
+    freeList = id;
+}
+
+template <typename T>
+int BoundingVolumeHierarchy<T>::insert(const Ogre::AxisAlignedBox& box, T item)
+{
+    int leaf {allocateNode()};
+    BoundingBox fat {BoundingBox::from(box)};
+    nodes[leaf].tight = fat;
+    fat.min -= margin;
+    fat.max += margin;
+    nodes[leaf].box = fat;
+    nodes[leaf].item = item;
+    insertLeaf(leaf);
+    ++leafCount;
+    return leaf;
+}
+
+template <typename T>
+void BoundingVolumeHierarchy<T>::remove(int proxy)
+{
+    removeLeaf(proxy);
+    freeNode(proxy);
+    --leafCount;
+}
+
+template <typename T>
+bool BoundingVolumeHierarchy<T>::update(int proxy, const Ogre::AxisAlignedBox& box)
+{
+    BoundingBox tight {BoundingBox::from(box)};
+    nodes[proxy].tight = tight;
+    if (nodes[proxy].box.contains(tight))
+        return false;
+
+    removeLeaf(proxy);
+    tight.min -= margin;
+    tight.max += margin;
+    nodes[proxy].box = tight;
+    insertLeaf(proxy);
+    return true;
+}
+
+template <typename T>
+void BoundingVolumeHierarchy<T>::clear()
+{
+    nodes.clear();
+    root = NULL_NODE;
+    freeList = NULL_NODE;
+    leafCount = 0;
+}
+
+template <typename T>
+void BoundingVolumeHierarchy<T>::insertLeaf(int leaf)
+{
+    if (root == NULL_NODE)
+    {
+        root = leaf;
+        nodes[root].parent = NULL_NODE;
+        return;
+    }
+
+    // Descend to the sibling that makes the tree grow the least (surface area heuristic)
+    BoundingBox leafBox {nodes[leaf].box};
+    int index {root};
+    while (!nodes[index].isLeaf())
+    {
+        int left {nodes[index].left};
+        int right {nodes[index].right};
+        Ogre::Real area {nodes[index].box.area()};
+        Ogre::Real combinedArea {nodes[index].box.merge(leafBox).area()};
+
+        // Cost of creating a new parent for this node and the new leaf
+        Ogre::Real cost {2 * combinedArea};
+        // Minimum cost of pushing the leaf further down the tree
+        Ogre::Real inheritanceCost {2 * (combinedArea - area)};
+
+        auto descendCost = [&](int child)
+        {
+            Ogre::Real enlarged {nodes[child].box.merge(leafBox).area()};
+            if (nodes[child].isLeaf())
+                return enlarged + inheritanceCost;
+            return enlarged - nodes[child].box.area() + inheritanceCost;
+        };
+        Ogre::Real costLeft {descendCost(left)};
+        Ogre::Real costRight {descendCost(right)};
+
+        if (cost < costLeft && cost < costRight)
+            break;
+        index = costLeft < costRight ? left : right;
+    }
+
+    int sibling {index};
+    int oldParent {nodes[sibling].parent};
+    int newParent {allocateNode()};
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box = leafBox.merge(nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].left = sibling;
+    nodes[newParent].right = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    if (oldParent == NULL_NODE)
+        root = newParent;
+    else if (nodes[oldParent].left == sibling)
+        nodes[oldParent].left = newParent;
+    else
+        nodes[oldParent].right = newParent;
+
+    refit(nodes[leaf].parent);
+}
+
+template <typename T>
+void BoundingVolumeHierarchy<T>::removeLeaf(int leaf)
+{
+    if (leaf == root)
+    {
+        root = NULL_NODE;
+        return;
+    }
+
+    int parent {nodes[leaf].parent};
+    int grandParent {nodes[parent].parent};
+    int sibling {nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left};
+
+    if (grandParent == NULL_NODE)
+    {
+        root = sibling;
+        nodes[sibling].parent = NULL_NODE;
+        freeNode(parent);
+        return;
+    }
+
+    if (nodes[grandParent].left == parent)
+        nodes[grandParent].left = sibling;
+    else
+        nodes[grandParent].right = sibling;
+    nodes[sibling].parent = grandParent;
+    freeNode(parent);
+    refit(grandParent);
+}
+
+// Walk up to the root fixing boxes and heights, rotating where the tree is unbalanced
+template <typename T>
+void BoundingVolumeHierarchy<T>::refit(int index)
+{
+    while (index != NULL_NODE)
+    {
+        index = balance(index);
+        int left {nodes[index].left};
+        int right {nodes[index].right};
+        nodes[index].height = 1 + std::max(nodes[left].height, nodes[right].height);
+        nodes[index].box = nodes[left].box.merge(nodes[right].box);
+        index = nodes[index].parent;
+    }
+}
+
+// Promote the taller grandchild when the children heights differ by more than one
+template <typename T>
+int BoundingVolumeHierarchy<T>::balance(int a)
+{
+    if (nodes[a].isLeaf() || nodes[a].height < 2)
+        return a;
+
+    int b {nodes[a].left};
+    int c {nodes[a].right};
+    int difference {nodes[c].height - nodes[b].height};
+    if (difference >= -1 && difference <= 1)
+        return a;
+
+    // 'up' is the taller child that will replace 'a', 'down' keeps its place under 'a'
+    int up {difference > 0 ? c : b};
+    int f {nodes[up].left};
+    int g {nodes[up].right};
+
+    nodes[up].left = a;
+    nodes[up].parent = nodes[a].parent;
+    nodes[a].parent = up;
+
+    if (nodes[up].parent == NULL_NODE)
+        root = up;
+    else if (nodes[nodes[up].parent].left == a)
+        nodes[nodes[up].parent].left = up;
+    else
+        nodes[nodes[up].parent].right = up;
+
+    // The taller grandchild stays with 'up', the shorter one moves under 'a'
+    int keep {nodes[f].height > nodes[g].height ? f : g};
+    int move {keep == f ? g : f};
+    nodes[up].right = keep;
+    if (difference > 0)
+        nodes[a].right = move;
+    else
+        nodes[a].left = move;
+    nodes[move].parent = a;
+
+    int aLeft {nodes[a].left};
+    int aRight {nodes[a].right};
+    nodes[a].box = nodes[aLeft].box.merge(nodes[aRight].box);
+    nodes[a].height = 1 + std::max(nodes[aLeft].height, nodes[aRight].height);
+    nodes[up].box = nodes[a].box.merge(nodes[keep].box);
+    nodes[up].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+    return up;
+}
+
+template <typename T>
+bool BoundingVolumeHierarchy<T>::raycastNearest(const Ogre::Ray& ray, Hit& hit) const
+{
+    return raycastNearest(ray, hit, [](const T&, Ogre::Real distance) { return distance; });
+}
+
+// The narrow test receives the leaf item and its box distance, and returns the
+// refined distance or a negative value when the item is not really hit
+template <typename T>
+template <typename NarrowTest>
+bool BoundingVolumeHierarchy<T>::raycastNearest(const Ogre::Ray& ray, Hit& hit, NarrowTest narrowTest) const
+{
+    if (root == NULL_NODE)
+        return false;
+
+    BoundingRay boundingRay {ray};
+    Ogre::Real best {std::numeric_limits<Ogre::Real>::max()};
+    bool found {false};
+
+    stack.clear();
+    stack.push_back(root);
+    while (!stack.empty())
+    {
+        int index {stack.back()};
+        stack.pop_back();
+        const TreeNode& node {nodes[index]};
+        Ogre::Real distance {boundingRay.intersects(node.isLeaf() ? node.tight : node.box, best)};
+        if (distance < 0)
+            continue;
+
+        if (node.isLeaf())
+        {
+            Ogre::Real refined {narrowTest(node.item, distance)};
+            if (refined >= 0 && refined < best)
+            {
+                best = refined;
+                hit = Hit{node.item, refined};
+                found = true;
+            }
+            continue;
+        }
+
+        // Push the farther child first so the nearer one is visited next
+        Ogre::Real leftDistance {boundingRay.intersects(nodes[node.left].box, best)};
+        Ogre::Real rightDistance {boundingRay.intersects(nodes[node.right].box, best)};
+        if (leftDistance < rightDistance)
+        {
+            if (rightDistance >= 0) stack.push_back(node.right);
+            if (leftDistance >= 0) stack.push_back(node.left);
+        }
+        else
+        {
+            if (leftDistance >= 0) stack.push_back(node.left);
+            if (rightDistance >= 0) stack.push_back(node.right);
+        }
+    }
+    return found;
+}
+
+template <typename T>
+void BoundingVolumeHierarchy<T>::raycastAll(const Ogre::Ray& ray, std::vector<Hit>& hits) const
+{
+    hits.clear();
+    if (root == NULL_NODE)
+        return;
+
+    BoundingRay boundingRay {ray};
+    const Ogre::Real far {std::numeric_limits<Ogre::Real>::max()};
+
+    stack.clear();
+    stack.push_back(root);
+    while (!stack.empty())
+    {
+        const TreeNode& node {nodes[stack.back()]};
+        stack.pop_back();
+        Ogre::Real distance {boundingRay.intersects(node.isLeaf() ? node.tight : node.box, far)};
+        if (distance < 0)
+            continue;
+        if (node.isLeaf())
+        {
+            hits.push_back(Hit{node.item, distance});
+            continue;
+        }
+        stack.push_back(node.left);
+        stack.push_back(node.right);
+    }
+    std::sort(hits.begin(), hits.end(), [](const Hit& a, const Hit& b) { return a.distance < b.distance; });
+}
@@ -0,0 +1,463 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the clearance check of the track. The space the riders
+need, the envelope, is swept along every segment as a chain of oriented boxes
+and tested against the bounds of the obstacles and the height of the terrain.
+Both are kept in a spatial hash of vertical columns, and every column knows
+the segments that pass through it, so an edit only checks again the segments
+it can affect.
+*/
+
+#pragma once
+
+#include "track.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+struct ClearanceBox
+{
+    Vec3 min;
+    Vec3 max;
+
+    bool overlaps(const ClearanceBox& b) const
+    {
+        return min.x <= b.max.x && max.x >= b.min.x && min.y <= b.max.y && max.y >= b.min.y && min.z <= b.max.z && max.z >= b.min.z;
+    }
+
+    void grow(const Vec3& p)
+    {
+        min = {std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z)};
+        max = {std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z)};
+    }
+
+    static ClearanceBox empty()
+    {
+        float big {std::numeric_limits<float>::max()};
+        return {{big, big, big}, {-big, -big, -big}};
+    }
+};
+
+// Space of the train and the riders around the rails, in the rider frame
+struct ClearanceEnvelope
+{
+    float halfWidth = 1.0f; // Meters to each side of the rails
+    float height = 2.0f;    // Meters above the rails, heads and raised arms
+    float below = 0.5f;     // Meters below the rails, the structure of the track
+};
+
+struct ClearanceHit
+{
+    enum Kind
+    {
+        Obstacle,
+        Terrain
+    };
+
+    Kind kind;
+    uint32_t obstacle; // Id given to setObstacle(), only for obstacles
+    size_t segment;
+    float offset;      // Meters from the start of the segment
+    Vec3 position;     // On the rails
+};
+
+class ClearanceChecker
+{
+    public:
+        static constexpr float CELL = 8.0f; // Meters of side of the columns of the hash
+        static constexpr size_t CHUNK = 8;  // Slices tested together before going one by one
+        typedef std::function<float(float x, float z)> TerrainHeight;
+
+        explicit ClearanceChecker(const ClearanceEnvelope& envelope = {}, float terrainSpacing = 2.0f);
+
+        // Heights are read lazily, once per column, and every segment is checked again
+        void setTerrain(TerrainHeight);
+        // Inserts or moves an obstacle, the segments near its old and new place are checked again
+        void setObstacle(uint32_t id, const ClearanceBox&);
+        void removeObstacle(uint32_t id);
+
+        // Checks the segments changed since the last call and the ones near moved obstacles, returns how many
+        size_t update(const Track&);
+
+        size_t conflicts() const { return total; }
+        const std::vector<ClearanceHit>& segmentHits(size_t segment) const { return states[segment].hits; }
+        size_t segmentCount() const { return states.size(); }
+
+    private:
+        struct Cell
+        {
+            std::vector<uint32_t> obstacles;
+            std::vector<uint32_t> segments;
+            bool sampled = false;
+            float top = 0; // Highest terrain sample
+            std::vector<float> heights;
+        };
+
+        struct SegmentState
+        {
+            uint32_t revision = 0;
+            bool dirty = true;
+            std::vector<uint64_t> cells;
+            std::vector<ClearanceHit> hits;
+        };
+
+        // One slice of the envelope between two samples
+        struct Slice
+        {
+            Vec3 center;
+            Vec3 axes[3];   // Tangent, side, normal
+            float half[3];
+            ClearanceBox bounds;
+        };
+
+        static uint64_t key(int x, int z) { return uint64_t(uint32_t(x)) << 32 | uint32_t(z); }
+        static int column(float v) { return int(std::floor(v / CELL)); }
+        template<typename Visit>
+        void forCells(const ClearanceBox&, Visit);
+        Cell& cell(uint64_t);
+        void sampleTerrain(Cell&, uint64_t);
+        float terrainHeight(float x, float z);
+        void markObstacleCells(const ClearanceBox&);
+        static bool overlaps(const Slice&, const ClearanceBox&);
+        void unregister(size_t segment);
+        void check(size_t segment, const Track&);
+
+        ClearanceEnvelope envelope;
+        float spacing;
+        TerrainHeight terrain;
+        std::unordered_map<uint64_t, Cell> cells;
+        std::unordered_map<uint32_t, ClearanceBox> obstacles;
+        std::vector<SegmentState> states;
+        size_t total = 0;
+
+        // Scratch of check(), kept to avoid allocations
+        std::vector<Slice> slices;
+        std::vector<uint32_t> candidates;
+};
+
+inline ClearanceChecker::ClearanceChecker(const ClearanceEnvelope& envelope, float terrainSpacing) :
+    envelope{envelope},
+    spacing{terrainSpacing}
+{}
+
+template<typename Visit>
+void ClearanceChecker::forCells(const ClearanceBox& box, Visit visit)
+{
+    int x1 {column(box.max.x)};
+    int z1 {column(box.max.z)};
+    for (int x = column(box.min.x); x <= x1; ++x)
+        for (int z = column(box.min.z); z <= z1; ++z)
+            visit(key(x, z));
+}
+
+inline ClearanceChecker::Cell& ClearanceChecker::cell(uint64_t k)
+{
+    return cells[k];
+}
+
+inline void ClearanceChecker::setTerrain(TerrainHeight height)
+{
+    terrain = std::move(height);
+    for (auto& entry : cells)
+    {
+        entry.second.sampled = false;
+        entry.second.heights.clear();
+    }
+    for (SegmentState& state : states)
+        state.dirty = true;
+}
+
+inline void ClearanceChecker::sampleTerrain(Cell& target, uint64_t k)
+{
+    size_t n {size_t(std::ceil(CELL / spacing))};
+    float step {CELL / n};
+    float x0 {float(int32_t(k >> 32)) * CELL};
+    float z0 {float(int32_t(k & 0xffffffff)) * CELL};
+    target.heights.resize((n + 1) * (n + 1));
+    target.top = std::numeric_limits<float>::lowest();
+    for (size_t i = 0; i <= n; ++i)
+    {
+        for (size_t j = 0; j <= n; ++j)
+        {
+            float h {terrain(x0 + i * step, z0 + j * step)};
+            target.heights[i * (n + 1) + j] = h;
+            target.top = std::max(target.top, h);
+        }
+    }
+    target.sampled = true;
+}
+
+// Bilinear between the samples of the column
+inline float ClearanceChecker::terrainHeight(float x, float z)
+{
+    int cx {column(x)};
+    int cz {column(z)};
+    uint64_t k {key(cx, cz)};
+    Cell& target {cell(k)};
+    if (!target.sampled)
+        sampleTerrain(target, k);
+
+    size_t n {size_t(std::ceil(CELL / spacing))};
+    float step {CELL / n};
+    float fx {(x - cx * CELL) / step};
+    float fz {(z - cz * CELL) / step};
+    size_t i {std::min(size_t(std::max(fx, 0.0f)), n - 1)};
+    size_t j {std::min(size_t(std::max(fz, 0.0f)), n - 1)};
+    float u {std::min(std::max(fx - i, 0.0f), 1.0f)};
+    float v {std::min(std::max(fz - j, 0.0f), 1.0f)};
+    const float* h {target.heights.data()};
+    float h0 {h[i * (n + 1) + j] + (h[(i + 1) * (n + 1) + j] - h[i * (n + 1) + j]) * u};
+    float h1 {h[i * (n + 1) + j + 1] + (h[(i + 1) * (n + 1) + j + 1] - h[i * (n + 1) + j + 1]) * u};
+    return h0 + (h1 - h0) * v;
+}
+
+inline void ClearanceChecker::markObstacleCells(const ClearanceBox& box)
+{
+    forCells(box, [this](uint64_t k) {
+        auto found {cells.find(k)};
+        if (found == cells.end())
+            return;
+        for (uint32_t segment : found->second.segments)
+            states[segment].dirty = true;
+    });
+}
+
+inline void ClearanceChecker::setObstacle(uint32_t id, const ClearanceBox& box)
+{
+    auto found {obstacles.find(id)};
+    if (found != obstacles.end())
+    {
+        if (found->second.min == box.min && found->second.max == box.max)
+            return;
+        removeObstacle(id);
+    }
+    obstacles[id] = box;
+    forCells(box, [this, id](uint64_t k) { cell(k).obstacles.push_back(id); });
+    markObstacleCells(box);
+}
+
+inline void ClearanceChecker::removeObstacle(uint32_t id)
+{
+    auto found {obstacles.find(id)};
+    if (found == obstacles.end())
+        return;
+    ClearanceBox box {found->second};
+    obstacles.erase(found);
+    forCells(box, [this, id](uint64_t k) {
+        std::vector<uint32_t>& list {cell(k).obstacles};
+        list.erase(std::remove(list.begin(), list.end(), id), list.end());
+    });
+    markObstacleCells(box);
+}
+
+// Separating axis test of an oriented box against an axis aligned one
+inline bool ClearanceChecker::overlaps(const Slice& slice, const ClearanceBox& box)
+{
+    Vec3 extent {(box.max - box.min) * 0.5f};
+    Vec3 d {slice.center - (box.min + box.max) * 0.5f};
+    float a[3] {extent.x, extent.y, extent.z};
+    float t[3] {d.x, d.y, d.z};
+    float r[3][3];    // Components of the slice axes on the world axes
+    float absR[3][3];
+    for (int j = 0; j < 3; ++j)
+    {
+        float c[3] {slice.axes[j].x, slice.axes[j].y, slice.axes[j].z};
+        for (int i = 0; i < 3; ++i)
+        {
+            r[i][j] = c[i];
+            absR[i][j] = std::fabs(c[i]) + 1e-6f;
+        }
+    }
+    const float* b {slice.half};
+
+    // World axes
+    for (int i = 0; i < 3; ++i)
+    {
+        if (std::fabs(t[i]) > a[i] + b[0] * absR[i][0] + b[1] * absR[i][1] + b[2] * absR[i][2])
+            return false;
+    }
+    // Slice axes
+    for (int j = 0; j < 3; ++j)
+    {
+        float projection {t[0] * r[0][j] + t[1] * r[1][j] + t[2] * r[2][j]};
+        if (std::fabs(projection) > a[0] * absR[0][j] + a[1] * absR[1][j] + a[2] * absR[2][j] + b[j])
+            return false;
+    }
+    // Cross products of a world axis and a slice axis
+    for (int i = 0; i < 3; ++i)
+    {
+        int i1 {(i + 1) % 3};
+        int i2 {(i + 2) % 3};
+        for (int j = 0; j < 3; ++j)
+        {
+            int j1 {(j + 1) % 3};
+            int j2 {(j + 2) % 3};
+            float ra {a[i1] * absR[i2][j] + a[i2] * absR[i1][j]};
+            float rb {b[j1] * absR[i][j2] + b[j2] * absR[i][j1]};
+            if (std::fabs(t[i2] * r[i1][j] - t[i1] * r[i2][j]) > ra + rb)
+                return false;
+        }
+    }
+    return true;
+}
+
+inline void ClearanceChecker::unregister(size_t segment)
+{
+    SegmentState& state {states[segment]};
+    for (uint64_t k : state.cells)
+    {
+        std::vector<uint32_t>& list {cell(k).segments};
+        list.erase(std::remove(list.begin(), list.end(), uint32_t(segment)), list.end());
+    }
+    state.cells.clear();
+    total -= state.hits.size();
+    state.hits.clear();
+}
+
+inline void ClearanceChecker::check(size_t segment, const Track& track)
+{
+    unregister(segment);
+    SegmentState& state {states[segment]};
+    state.revision = track.segmentRevision(segment);
+    state.dirty = false;
+
+    const std::vector<TrackSample>& samples {track.segmentSamples(segment)};
+    float step {track.segmentLength(segment) / (samples.size() - 1)};
+    float middle {(envelope.height - envelope.below) / 2};
+
+    // Oriented box of the envelope between every pair of samples
+    slices.resize(samples.size() - 1);
+    for (size_t k = 0; k + 1 < samples.size(); ++k)
+    {
+        const TrackSample& a {samples[k]};
+        const TrackSample& b {samples[k + 1]};
+        Slice& slice {slices[k]};
+        Vec3 along {b.position - a.position};
+        float length {along.length()};
+        Vec3 tangent {length > 0 ? along / length : a.tangent};
+        Vec3 normal {a.normal + b.normal};
+        normal = (normal - tangent * tangent.dot(normal)).normalised();
+        slice.axes[0] = tangent;
+        slice.axes[1] = tangent.cross(normal);
+        slice.axes[2] = normal;
+        slice.half[0] = length / 2;
+        slice.half[1] = envelope.halfWidth;
+        slice.half[2] = (envelope.height + envelope.below) / 2;
+        slice.center = (a.position + b.position) * 0.5f + normal * middle;
+
+        slice.bounds = ClearanceBox::empty();
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            slice.bounds.grow(slice.center + slice.axes[0] * (corner & 1 ? slice.half[0] : -slice.half[0])
+                                           + slice.axes[1] * (corner & 2 ? slice.half[1] : -slice.half[1])
+                                           + slice.axes[2] * (corner & 4 ? slice.half[2] : -slice.half[2]));
+        }
+    }
+
+    // Chunks of slices register the segment in their columns and gather the obstacles to test
+    bool inTerrain {false};
+    for (size_t first = 0; first < slices.size(); first += CHUNK)
+    {
+        size_t last {std::min(first + CHUNK, slices.size())};
+        ClearanceBox bounds {ClearanceBox::empty()};
+        for (size_t k = first; k < last; ++k)
+        {
+            bounds.grow(slices[k].bounds.min);
+            bounds.grow(slices[k].bounds.max);
+        }
+
+        candidates.clear();
+        float top {std::numeric_limits<float>::lowest()};
+        forCells(bounds, [&](uint64_t k) {
+            if (std::find(state.cells.begin(), state.cells.end(), k) == state.cells.end())
+            {
+                state.cells.push_back(k);
+                cell(k).segments.push_back(uint32_t(segment));
+            }
+            Cell& column {cell(k)};
+            candidates.insert(candidates.end(), column.obstacles.begin(), column.obstacles.end());
+            if (terrain)
+            {
+                if (!column.sampled)
+                    sampleTerrain(column, k);
+                top = std::max(top, column.top);
+            }
+        });
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        for (uint32_t id : candidates)
+        {
+            const ClearanceBox& box {obstacles[id]};
+            if (!box.overlaps(bounds))
+                continue;
+            bool known {std::any_of(state.hits.begin(), state.hits.end(), [id](const ClearanceHit& hit) { return hit.kind == ClearanceHit::Obstacle && hit.obstacle == id; })};
+            for (size_t k = first; k < last && !known; ++k)
+            {
+                if (slices[k].bounds.overlaps(box) && overlaps(slices[k], box))
+                {
+                    state.hits.push_back({ClearanceHit::Obstacle, id, segment, k * step, samples[k].position});
+                    known = true;
+                }
+            }
+        }
+
+        // The terrain only matters where it reaches the lowest corner of the chunk, one hit per stretch underground
+        if (!terrain || bounds.min.y > top)
+        {
+            inTerrain = false;
+            continue;
+        }
+        for (size_t k = first; k < last; ++k)
+        {
+            const TrackSample& sample {samples[k]};
+            Vec3 side {sample.tangent.cross(sample.normal) * envelope.halfWidth};
+            Vec3 up {sample.normal * envelope.height};
+            Vec3 down {sample.normal * envelope.below};
+            bool buried {false};
+            for (const Vec3& corner : {sample.position + side + up, sample.position - side + up, sample.position + side - down, sample.position - side - down})
+                buried = buried || terrainHeight(corner.x, corner.z) > corner.y;
+            if (buried && !inTerrain)
+                state.hits.push_back({ClearanceHit::Terrain, 0, segment, k * step, sample.position});
+            inTerrain = buried;
+        }
+    }
+    total += state.hits.size();
+}
+
+inline size_t ClearanceChecker::update(const Track& track)
+{
+    size_t count {track.segmentCount()};
+    for (size_t i = count; i < states.size(); ++i)
+        unregister(i);
+    states.resize(count);
+
+    size_t checked {0};
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (states[i].dirty || states[i].revision != track.segmentRevision(i))
+        {
+            check(i, track);
+            ++checked;
+        }
+    }
+    return checked;
+}
@@ -0,0 +1,420 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the triangle data used for precise picking. The triangles
+of a mesh are read once, stored as structure of arrays and indexed by their
+own bounding volume hierarchy, then every Entity of that mesh shares them.
+*/
+
+#pragma once
+
+#include "Ogre.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class MeshCollider
+{
+    public:
+        // Builds the hierarchy over a triangle list (three positions per triangle)
+        explicit MeshCollider(const std::vector<Ogre::Vector3>&);
+
+        // Distance along the ray (in the ray parameter) to the closest triangle, or negative if none
+        Ogre::Real intersects(const Ogre::Ray&, Ogre::Real maxDistance) const;
+        size_t triangleCount() const { return v0x.size(); }
+
+    private:
+        static constexpr uint32_t LEAF_SIZE = 4;
+        static constexpr int BINS = 8;
+        static constexpr int MAX_DEPTH = 60; // Keeps the traversal stack bounded
+
+        // 32 bytes: children are contiguous, leaves point to a range of triangles
+        struct TreeNode
+        {
+            float min[3];
+            uint32_t leftFirst; // First child for inner nodes, first triangle for leaves
+            float max[3];
+            uint32_t count;     // Number of triangles, 0 for inner nodes
+        };
+
+        void subdivide(uint32_t, int, std::vector<uint32_t>&, const std::vector<Ogre::Vector3>&, const std::vector<Ogre::Vector3>&);
+        void updateBounds(uint32_t, const std::vector<uint32_t>&, const std::vector<Ogre::Vector3>&);
+        Ogre::Real intersectsTriangle(uint32_t, const Ogre::Vector3&, const Ogre::Vector3&, Ogre::Real) const;
+
+        // First vertex and both edges of each triangle
+        std::vector<float> v0x, v0y, v0z;
+        std::vector<float> e1x, e1y, e1z;
+        std::vector<float> e2x, e2y, e2z;
+        std::vector<TreeNode> nodes;
+};
+
+// One collider per mesh, created the first time the mesh is seen
+class MeshColliderCache
+{
+    public:
+        const MeshCollider* get(const Ogre::MeshPtr&);
+        // Mesh of an Entity or an InstancedEntity, nullptr for other objects
+        static const Ogre::MeshPtr* meshOf(Ogre::MovableObject*);
+        // Distance to the closest triangle of the entities attached to the node, or negative if none
+        Ogre::Real intersects(Ogre::SceneNode*, const Ogre::Ray&, Ogre::Real maxDistance);
+
+    private:
+        static void readTriangles(const Ogre::Mesh&, std::vector<Ogre::Vector3>&);
+
+        std::unordered_map<const Ogre::Mesh*, std::unique_ptr<MeshCollider>> colliders;
+};
+
+inline MeshCollider::MeshCollider(const std::vector<Ogre::Vector3>& vertices)
+{
+    uint32_t count = vertices.size() / 3;
+    std::vector<Ogre::Vector3> centroids(count);
+    std::vector<uint32_t> order(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        centroids[i] = (vertices[3 * i] + vertices[3 * i + 1] + vertices[3 * i + 2]) * (1.0f / 3.0f);
+        order[i] = i;
+    }
+
+    nodes.reserve(count > 0 ? 2 * count : 1);
+    nodes.push_back(TreeNode{});
+    nodes[0].leftFirst = 0;
+    nodes[0].count = count;
+    updateBounds(0, order, vertices);
+    if (count > 0)
+        subdivide(0, 0, order, vertices, centroids);
+
+    // Store the triangles in leaf order so every leaf reads a contiguous range
+    for (std::vector<float>* array : {&v0x, &v0y, &v0z, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z})
+        array->resize(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const Ogre::Vector3& a {vertices[3 * order[i]]};
+        Ogre::Vector3 e1 {vertices[3 * order[i] + 1] - a};
+        Ogre::Vector3 e2 {vertices[3 * order[i] + 2] - a};
+        v0x[i] = a.x; v0y[i] = a.y; v0z[i] = a.z;
+        e1x[i] = e1.x; e1y[i] = e1.y; e1z[i] = e1.z;
+        e2x[i] = e2.x; e2y[i] = e2.y; e2z[i] = e2.z;
+    }
+}
+
+inline void MeshCollider::updateBounds(uint32_t index, const std::vector<uint32_t>& order, const std::vector<Ogre::Vector3>& vertices)
+{
+    TreeNode& node {nodes[index]};
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        node.min[axis] = std::numeric_limits<float>::max();
+        node.max[axis] = -std::numeric_limits<float>::max();
+    }
+    for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+    {
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            const Ogre::Vector3& v {vertices[3 * order[i] + corner]};
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                node.min[axis] = std::min(node.min[axis], v[axis]);
+                node.max[axis] = std::max(node.max[axis], v[axis]);
+            }
+        }
+    }
+}
+
+// Binned surface area heuristic split
+inline void MeshCollider::subdivide(uint32_t index, int depth, std::vector<uint32_t>& order, const std::vector<Ogre::Vector3>& vertices, const std::vector<Ogre::Vector3>& centroids)
+{
+    uint32_t first {nodes[index].leftFirst};
+    uint32_t count {nodes[index].count};
+    if (count <= LEAF_SIZE || depth >= MAX_DEPTH)
+        return;
+
+    auto area = [](const float* min, const float* max)
+    {
+        float dx {max[0] - min[0]}, dy {max[1] - min[1]}, dz {max[2] - min[2]};
+        return dx * dy + dy * dz + dz * dx;
+    };
+
+    float bestCost {count * area(nodes[index].min, nodes[index].max)};
+    int bestAxis {-1};
+    float bestSplit {0};
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float low {std::numeric_limits<float>::max()}, high {-std::numeric_limits<float>::max()};
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            low = std::min(low, centroids[order[i]][axis]);
+            high = std::max(high, centroids[order[i]][axis]);
+        }
+        if (low == high)
+            continue;
+
+        struct Bin { float min[3]; float max[3]; uint32_t count; };
+        Bin bins[BINS];
+        for (Bin& bin : bins)
+        {
+            bin.count = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                bin.min[k] = std::numeric_limits<float>::max();
+                bin.max[k] = -std::numeric_limits<float>::max();
+            }
+        }
+        float scale {BINS / (high - low)};
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            int b {std::min(BINS - 1, int((centroids[order[i]][axis] - low) * scale))};
+            ++bins[b].count;
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                const Ogre::Vector3& v {vertices[3 * order[i] + corner]};
+                for (int k = 0; k < 3; ++k)
+                {
+                    bins[b].min[k] = std::min(bins[b].min[k], v[k]);
+                    bins[b].max[k] = std::max(bins[b].max[k], v[k]);
+                }
+            }
+        }
+
+        // Sweep from both sides to evaluate every plane between bins
+        float leftArea[BINS - 1], rightArea[BINS - 1];
+        uint32_t leftCount[BINS - 1], rightCount[BINS - 1];
+        Bin left {bins[0]}, right {bins[BINS - 1]};
+        left.count = right.count = 0;
+        for (int i = 0; i < BINS - 1; ++i)
+        {
+            const Bin& l {bins[i]};
+            const Bin& r {bins[BINS - 1 - i]};
+            left.count += l.count;
+            right.count += r.count;
+            for (int k = 0; k < 3; ++k)
+            {
+                left.min[k] = std::min(left.min[k], l.min[k]);
+                left.max[k] = std::max(left.max[k], l.max[k]);
+                right.min[k] = std::min(right.min[k], r.min[k]);
+                right.max[k] = std::max(right.max[k], r.max[k]);
+            }
+            leftCount[i] = left.count;
+            leftArea[i] = left.count ? area(left.min, left.max) : 0;
+            rightCount[BINS - 2 - i] = right.count;
+            rightArea[BINS - 2 - i] = right.count ? area(right.min, right.max) : 0;
+        }
+        for (int i = 0; i < BINS - 1; ++i)
+        {
+            float cost {leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i]};
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = low + (i + 1) / scale;
+            }
+        }
+    }
+    if (bestAxis < 0)
+        return;
+
+    // Partition the triangles around the chosen plane
+    uint32_t i {first}, j {first + count};
+    while (i < j)
+    {
+        if (centroids[order[i]][bestAxis] < bestSplit)
+            ++i;
+        else
+            std::swap(order[i], order[--j]);
+    }
+    uint32_t leftCount {i - first};
+    if (leftCount == 0 || leftCount == count)
+        return;
+
+    uint32_t leftIndex = nodes.size();
+    nodes.push_back(TreeNode{});
+    nodes.push_back(TreeNode{});
+    nodes[leftIndex].leftFirst = first;
+    nodes[leftIndex].count = leftCount;
+    nodes[leftIndex + 1].leftFirst = i;
+    nodes[leftIndex + 1].count = count - leftCount;
+    nodes[index].leftFirst = leftIndex;
+    nodes[index].count = 0;
+
+    updateBounds(leftIndex, order, vertices);
+    updateBounds(leftIndex + 1, order, vertices);
+    subdivide(leftIndex, depth + 1, order, vertices, centroids);
+    subdivide(leftIndex + 1, depth + 1, order, vertices, centroids);
+}
+
+// Möller-Trumbore test against one triangle of the arrays
+inline Ogre::Real MeshCollider::intersectsTriangle(uint32_t i, const Ogre::Vector3& origin, const Ogre::Vector3& direction, Ogre::Real maxDistance) const
+{
+    Ogre::Vector3 e1 {e1x[i], e1y[i], e1z[i]};
+    Ogre::Vector3 e2 {e2x[i], e2y[i], e2z[i]};
+    Ogre::Vector3 p {direction.crossProduct(e2)};
+    Ogre::Real det {e1.dotProduct(p)};
+    if (std::abs(det) < 1e-12f)
+        return -1;
+
+    Ogre::Real invDet {1.0f / det};
+    Ogre::Vector3 s {origin - Ogre::Vector3(v0x[i], v0y[i], v0z[i])};
+    Ogre::Real u {s.dotProduct(p) * invDet};
+    if (u < 0 || u > 1)
+        return -1;
+    Ogre::Vector3 q {s.crossProduct(e1)};
+    Ogre::Real v {direction.dotProduct(q) * invDet};
+    if (v < 0 || u + v > 1)
+        return -1;
+    Ogre::Real t {e2.dotProduct(q) * invDet};
+    return t >= 0 && t < maxDistance ? t : -1;
+}
+
+inline Ogre::Real MeshCollider::intersects(const Ogre::Ray& ray, Ogre::Real maxDistance) const
+{
+    if (triangleCount() == 0)
+        return -1;
+
+    const Ogre::Vector3& origin {ray.getOrigin()};
+    const Ogre::Vector3& direction {ray.getDirection()};
+    Ogre::Vector3 inv {1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z};
+
+    auto slab = [&](const TreeNode& node, Ogre::Real best)
+    {
+        Ogre::Real tMin {0}, tMax {best};
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            Ogre::Real t0 {(node.min[axis] - origin[axis]) * inv[axis]};
+            Ogre::Real t1 {(node.max[axis] - origin[axis]) * inv[axis]};
+            tMin = std::max(tMin, std::min(t0, t1));
+            tMax = std::min(tMax, std::max(t0, t1));
+        }
+        return tMin <= tMax ? tMin : -1;
+    };
+
+    Ogre::Real best {maxDistance};
+    bool found {false};
+    uint32_t stack[64];
+    int top {0};
+    if (slab(nodes[0], best) >= 0)
+        stack[top++] = 0;
+    while (top > 0)
+    {
+        const TreeNode& node {nodes[stack[--top]]};
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+            {
+                Ogre::Real t {intersectsTriangle(i, origin, direction, best)};
+                if (t >= 0)
+                {
+                    best = t;
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first
+        uint32_t near {node.leftFirst}, far {node.leftFirst + 1};
+        Ogre::Real nearDistance {slab(nodes[near], best)};
+        Ogre::Real farDistance {slab(nodes[far], best)};
+        if (nearDistance < 0 || (farDistance >= 0 && farDistance < nearDistance))
+        {
+            std::swap(near, far);
+            std::swap(nearDistance, farDistance);
+        }
+        if (farDistance >= 0)
+            stack[top++] = far;
+        if (nearDistance >= 0)
+            stack[top++] = near;
+    }
+    return found ? best : -1;
+}
+
+inline const MeshCollider* MeshColliderCache::get(const Ogre::MeshPtr& mesh)
+{
+    auto collider {colliders.find(mesh.get())};
+    if (collider != colliders.end())
+        return collider->second.get();
+
+    std::vector<Ogre::Vector3> vertices;
+    readTriangles(*mesh, vertices);
+    return colliders.emplace(mesh.get(), std::make_unique<MeshCollider>(vertices)).first->second.get();
+}
+
+inline Ogre::Real MeshColliderCache::intersects(Ogre::SceneNode* node, const Ogre::Ray& ray, Ogre::Real maxDistance)
+{
+    // Move the ray to the local space of the node instead of transforming the triangles.
+    // The direction is not normalised so distances stay in the world ray parameter.
+    Ogre::Affine3 toLocal {node->_getFullTransform().inverse()};
+    Ogre::Ray localRay {toLocal * ray.getOrigin(), toLocal.linear() * ray.getDirection()};
+
+    Ogre::Real best {-1};
+    const Ogre::Mesh* tested {nullptr};
+    for (unsigned short i = 0; i < node->numAttachedObjects(); ++i)
+    {
+        const Ogre::MeshPtr* mesh {meshOf(node->getAttachedObject(i))};
+        // The instances of a decoration are one per submesh of the same mesh
+        if (mesh == nullptr || mesh->get() == tested)
+            continue;
+        tested = mesh->get();
+        Ogre::Real t {get(*mesh)->intersects(localRay, best >= 0 ? best : maxDistance)};
+        if (t >= 0)
+            best = t;
+    }
+    return best;
+}
+
+inline const Ogre::MeshPtr* MeshColliderCache::meshOf(Ogre::MovableObject* object)
+{
+    if (Ogre::Entity* entity = dynamic_cast<Ogre::Entity*>(object))
+        return &entity->getMesh();
+    if (Ogre::InstancedEntity* instance = dynamic_cast<Ogre::InstancedEntity*>(object))
+        return &instance->_getOwner()->_getMeshRef();
+    return nullptr;
+}
+
+// Triangle lists of every submesh, shared or dedicated vertex data
+inline void MeshColliderCache::readTriangles(const Ogre::Mesh& mesh, std::vector<Ogre::Vector3>& vertices)
+{
+    for (const Ogre::SubMesh* subMesh : mesh.getSubMeshes())
+    {
+        if (subMesh->operationType != Ogre::RenderOperation::OT_TRIANGLE_LIST || subMesh->indexData->indexCount == 0)
+            continue;
+
+        const Ogre::VertexData* vertexData {subMesh->useSharedVertices ? mesh.sharedVertexData : subMesh->vertexData};
+        const Ogre::VertexElement* element {vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_POSITION)};
+        Ogre::HardwareVertexBufferSharedPtr vertexBuffer {vertexData->vertexBufferBinding->getBuffer(element->getSource())};
+        Ogre::HardwareBufferLockGuard vertexLock {vertexBuffer, Ogre::HardwareBuffer::HBL_READ_ONLY};
+
+        std::vector<Ogre::Vector3> positions(vertexData->vertexCount);
+        unsigned char* vertex {static_cast<unsigned char*>(vertexLock.pData) + vertexData->vertexStart * vertexBuffer->getVertexSize()};
+        for (size_t i = 0; i < vertexData->vertexCount; ++i, vertex += vertexBuffer->getVertexSize())
+        {
+            float* position;
+            element->baseVertexPointerToElement(vertex, &position);
+            positions[i] = Ogre::Vector3(position[0], position[1], position[2]);
+        }
+
+        const Ogre::IndexData* indexData {subMesh->indexData};
+        Ogre::HardwareIndexBufferSharedPtr indexBuffer {indexData->indexBuffer};
+        Ogre::HardwareBufferLockGuard indexLock {indexBuffer, Ogre::HardwareBuffer::HBL_READ_ONLY};
+        bool use32bit {indexBuffer->getType() == Ogre::HardwareIndexBuffer::IT_32BIT};
+        for (size_t i = indexData->indexStart; i < indexData->indexStart + indexData->indexCount; ++i)
+        {
+            uint32_t index {use32bit ? static_cast<uint32_t*>(indexLock.pData)[i] : static_cast<uint16_t*>(indexLock.pData)[i]};
+            vertices.push_back(positions[index]);
+        }
+    }
+}
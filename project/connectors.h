@@ -0,0 +1,370 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the connectors of the rail pieces. Every piece has an entry
+and an exit, kept in a spatial hash to find the nearest open one in constant
+time. Connectors that meet are joined, and the pieces joined one after the
+other form chains whose size and loop are updated on every join and break, so
+knowing whether the circuit is closed needs no walk.
+*/
+
+#pragma once
+
+#include "vec3.h"
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class ConnectorKind : uint8_t
+{
+    Entry,
+    Exit
+};
+
+struct Connector
+{
+    Vec3 position;
+    Vec3 tangent; // Direction of travel, the same for both ends of a piece
+    float bank;   // Radians of roll around the tangent
+    ConnectorKind kind;
+};
+
+// Up of a piece with no roll, tangent must be unit
+inline Vec3 bankReference(const Vec3& tangent)
+{
+    Vec3 up {Vec3{0, 1, 0} - tangent * tangent.y};
+    if (up.length() < 1e-4f)
+        up = Vec3{1, 0, 0} - tangent * tangent.x; // Vertical piece
+    return up.normalised();
+}
+
+inline float bankOf(const Vec3& tangent, const Vec3& up)
+{
+    Vec3 reference {bankReference(tangent)};
+    return std::atan2(reference.cross(up).dot(tangent), reference.dot(up));
+}
+
+inline Vec3 bankedUp(const Vec3& tangent, float bank)
+{
+    Vec3 reference {bankReference(tangent)};
+    return reference * std::cos(bank) + tangent.cross(reference) * std::sin(bank);
+}
+
+struct ConnectorMatch
+{
+    uint32_t piece;
+    Connector connector;
+    float distance;
+};
+
+class ConnectorIndex
+{
+    public:
+        static constexpr uint32_t NONE = UINT32_MAX;
+        static constexpr float JOIN_DISTANCE = 0.01f; // Meters between connectors that are joined
+        static constexpr float MAX_BEND = 0.7f; // Cosine of the sharpest bend between joined pieces, about 45 degrees
+
+        // The radius is the side of the cells of the hash
+        explicit ConnectorIndex(float radius = 1.0f) : radius{radius} {}
+
+        // Inserts or moves a piece, its joins are broken or made to match where it is now
+        void setPiece(uint32_t piece, const Connector& entry, const Connector& exit);
+        void removePiece(uint32_t piece);
+
+        // Nearest open connector of another piece that can be joined to the given one
+        bool nearest(uint32_t piece, const Connector&, ConnectorMatch&) const;
+
+        // Constant time, every piece in a single loop
+        bool isClosed() const { return chains == 1 && loops == 1; }
+        size_t pieceCount() const { return live; }
+        size_t openConnectors() const { return open; }
+        size_t chainCount() const { return chains; }
+
+        // Piece joined to the entry and to the exit of a live one, NONE when open
+        uint32_t previous(uint32_t piece) const { return pieces[piece].partner[0]; }
+        uint32_t next(uint32_t piece) const { return pieces[piece].partner[1]; }
+        bool contains(uint32_t piece) const { return piece < pieces.size() && pieces[piece].live; }
+        uint32_t chainOf(uint32_t piece) const { return pieces[piece].chain; }
+        bool inLoop(uint32_t piece) const { return chainTable[pieces[piece].chain].loop; }
+
+        // A piece of every chain whose order from entry to exit changed since clearChanges(): two chains
+        // were joined, or a loop was opened somewhere else than before its first piece
+        const std::vector<uint32_t>& changedChains() const { return changed; }
+        void clearChanges() { changed.clear(); }
+
+    private:
+        struct Piece
+        {
+            bool live = false;
+            Connector ends[2];
+            uint32_t partner[2] {NONE, NONE}; // Piece joined to the entry and to the exit
+            uint32_t chain = NONE;
+        };
+
+        struct Chain
+        {
+            uint32_t size = 0;
+            bool loop = false;
+        };
+
+        static uint64_t key(int x, int y, int z) { return (uint64_t(x) & 0x1fffff) << 42 | (uint64_t(y) & 0x1fffff) << 21 | (uint64_t(z) & 0x1fffff); }
+        int cell(float v) const { return int(std::floor(v / radius)); }
+        template<typename Visit>
+        void forNeighbours(const Vec3&, Visit) const;
+        static bool compatible(const Connector& a, const Connector& b) { return a.kind != b.kind && a.tangent.dot(b.tangent) >= MAX_BEND; }
+        void insert(uint32_t connector);
+        void erase(uint32_t connector);
+        bool joined(uint32_t exitPiece, uint32_t entryPiece) const;
+        void join(uint32_t exitPiece, uint32_t entryPiece);
+        void split(uint32_t exitPiece, uint32_t entryPiece);
+        uint32_t newChain();
+        uint32_t relabel(uint32_t start, int direction, uint32_t from, uint32_t to);
+
+        float radius;
+        std::unordered_map<uint64_t, std::vector<uint32_t>> cells; // Connector ids, piece * 2 + kind
+        std::vector<Piece> pieces; // By the id given to setPiece()
+        std::vector<Chain> chainTable;
+        std::vector<uint32_t> freeChains;
+        std::vector<uint32_t> changed;
+        size_t live = 0;
+        size_t open = 0;
+        size_t chains = 0;
+        size_t loops = 0;
+};
+
+template<typename Visit>
+void ConnectorIndex::forNeighbours(const Vec3& position, Visit visit) const
+{
+    int x {cell(position.x)};
+    int y {cell(position.y)};
+    int z {cell(position.z)};
+    for (int i = x - 1; i <= x + 1; ++i)
+    {
+        for (int j = y - 1; j <= y + 1; ++j)
+        {
+            for (int k = z - 1; k <= z + 1; ++k)
+            {
+                auto found {cells.find(key(i, j, k))};
+                if (found != cells.end())
+                {
+                    for (uint32_t connector : found->second)
+                        visit(connector);
+                }
+            }
+        }
+    }
+}
+
+inline void ConnectorIndex::insert(uint32_t connector)
+{
+    const Vec3& position {pieces[connector / 2].ends[connector % 2].position};
+    cells[key(cell(position.x), cell(position.y), cell(position.z))].push_back(connector);
+}
+
+inline void ConnectorIndex::erase(uint32_t connector)
+{
+    const Vec3& position {pieces[connector / 2].ends[connector % 2].position};
+    auto found {cells.find(key(cell(position.x), cell(position.y), cell(position.z)))};
+    std::vector<uint32_t>& list {found->second};
+    for (size_t i = 0; i < list.size(); ++i)
+    {
+        if (list[i] == connector)
+        {
+            list[i] = list.back();
+            list.pop_back();
+            break;
+        }
+    }
+    if (list.empty())
+        cells.erase(found);
+}
+
+inline bool ConnectorIndex::joined(uint32_t exitPiece, uint32_t entryPiece) const
+{
+    const Connector& exit {pieces[exitPiece].ends[1]};
+    const Connector& entry {pieces[entryPiece].ends[0]};
+    return (exit.position - entry.position).length() <= JOIN_DISTANCE && exit.tangent.dot(entry.tangent) >= MAX_BEND;
+}
+
+inline uint32_t ConnectorIndex::newChain()
+{
+    ++chains;
+    if (!freeChains.empty())
+    {
+        uint32_t chain {freeChains.back()};
+        freeChains.pop_back();
+        chainTable[chain] = {};
+        return chain;
+    }
+    chainTable.emplace_back();
+    return uint32_t(chainTable.size() - 1);
+}
+
+// Walks from start, forward through the exits (1) or backward through the entries (0), while the pieces are in chain from
+inline uint32_t ConnectorIndex::relabel(uint32_t start, int direction, uint32_t from, uint32_t to)
+{
+    uint32_t count {0};
+    for (uint32_t piece {start}; piece != NONE && pieces[piece].chain == from; piece = pieces[piece].partner[direction])
+    {
+        pieces[piece].chain = to;
+        ++count;
+    }
+    return count;
+}
+
+inline void ConnectorIndex::join(uint32_t exitPiece, uint32_t entryPiece)
+{
+    pieces[exitPiece].partner[1] = entryPiece;
+    pieces[entryPiece].partner[0] = exitPiece;
+    open -= 2;
+
+    uint32_t a {pieces[exitPiece].chain};
+    uint32_t b {pieces[entryPiece].chain};
+    if (a == b)
+    {
+        chainTable[a].loop = true;
+        ++loops;
+        return;
+    }
+    changed.push_back(entryPiece);
+
+    // The smaller chain takes the label of the larger one, the walks stop where the label changes
+    uint32_t start {entryPiece};
+    if (chainTable[a].size < chainTable[b].size)
+    {
+        std::swap(a, b);
+        start = exitPiece;
+    }
+    relabel(start, 1, b, a);
+    relabel(pieces[start].partner[0], 0, b, a);
+    chainTable[a].size += chainTable[b].size;
+    freeChains.push_back(b);
+    --chains;
+}
+
+inline void ConnectorIndex::split(uint32_t exitPiece, uint32_t entryPiece)
+{
+    pieces[exitPiece].partner[1] = NONE;
+    pieces[entryPiece].partner[0] = NONE;
+    open += 2;
+
+    uint32_t chain {pieces[exitPiece].chain};
+    if (chainTable[chain].loop)
+    {
+        chainTable[chain].loop = false;
+        --loops;
+        changed.push_back(exitPiece); // Its entry piece may be removed next
+        return;
+    }
+
+    // Both sides are walked in turns, only the shorter one is labelled again
+    uint32_t back {exitPiece};
+    uint32_t ahead {entryPiece};
+    while (pieces[back].partner[0] != NONE && pieces[ahead].partner[1] != NONE)
+    {
+        back = pieces[back].partner[0];
+        ahead = pieces[ahead].partner[1];
+    }
+    bool backShorter {pieces[back].partner[0] == NONE};
+    uint32_t part {newChain()};
+    uint32_t size {backShorter ? relabel(exitPiece, 0, chain, part) : relabel(entryPiece, 1, chain, part)};
+    chainTable[part].size = size;
+    chainTable[chain].size -= size;
+}
+
+inline void ConnectorIndex::setPiece(uint32_t id, const Connector& entry, const Connector& exit)
+{
+    if (id >= pieces.size())
+        pieces.resize(id + 1);
+    if (!pieces[id].live)
+    {
+        Piece& piece {pieces[id]};
+        piece.live = true;
+        piece.chain = newChain();
+        chainTable[piece.chain].size = 1;
+        ++live;
+        open += 2;
+    }
+    else
+    {
+        erase(id * 2);
+        erase(id * 2 + 1);
+    }
+    pieces[id].ends[0] = entry;
+    pieces[id].ends[1] = exit;
+    insert(id * 2);
+    insert(id * 2 + 1);
+
+    // Joins that no longer meet are broken
+    if (pieces[id].partner[0] != NONE && !joined(pieces[id].partner[0], id))
+        split(pieces[id].partner[0], id);
+    if (pieces[id].partner[1] != NONE && !joined(id, pieces[id].partner[1]))
+        split(id, pieces[id].partner[1]);
+
+    // Open connectors of other pieces that meet these ones are joined
+    for (uint32_t end = 0; end < 2; ++end)
+    {
+        if (pieces[id].partner[end] != NONE)
+            continue;
+        uint32_t other {NONE};
+        forNeighbours(pieces[id].ends[end].position, [&](uint32_t connector) {
+            uint32_t piece {connector / 2};
+            if (other == NONE && piece != id && connector % 2 != end && pieces[piece].partner[connector % 2] == NONE
+                && (end == 1 ? joined(id, piece) : joined(piece, id)))
+                other = piece;
+        });
+        if (other != NONE)
+            end == 1 ? join(id, other) : join(other, id);
+    }
+}
+
+inline void ConnectorIndex::removePiece(uint32_t id)
+{
+    if (id >= pieces.size() || !pieces[id].live)
+        return;
+    if (pieces[id].partner[0] != NONE)
+        split(pieces[id].partner[0], id);
+    if (pieces[id].partner[1] != NONE)
+        split(id, pieces[id].partner[1]);
+    erase(id * 2);
+    erase(id * 2 + 1);
+    freeChains.push_back(pieces[id].chain);
+    --chains;
+    --live;
+    open -= 2;
+    pieces[id] = {};
+}
+
+inline bool ConnectorIndex::nearest(uint32_t id, const Connector& from, ConnectorMatch& match) const
+{
+    bool found {false};
+    match.distance = radius;
+    forNeighbours(from.position, [&](uint32_t connector) {
+        uint32_t piece {connector / 2};
+        const Connector& candidate {pieces[piece].ends[connector % 2]};
+        if (piece == id || pieces[piece].partner[connector % 2] != NONE || !compatible(from, candidate))
+            return;
+        float distance {(candidate.position - from.position).length()};
+        if (distance <= match.distance)
+        {
+            match = {piece, candidate, distance};
+            found = true;
+        }
+    });
+    return found;
+}
@@ -0,0 +1,265 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the procedural geometry of the track: the rails and the
+spine are tubes swept along the frames of a segment and the ties are boxes
+laid at a fixed spacing. The segments are extruded on a worker thread so the
+editor does not wait for them.
+*/
+
+#pragma once
+
+#include "track.h"
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TubeProfile
+{
+    float right;  // Offset of the center from the heartline, in the rider frame
+    float up;
+    float radius;
+    unsigned sides;
+    unsigned material; // Index in TrackStyle::materials
+};
+
+struct TrackStyle
+{
+    std::vector<const char*> materials {"metalic_grey2", "metalic_red2"};
+    std::vector<TubeProfile> tubes {{-0.55f, 0, 0.06f, 8, 0}, {0.55f, 0, 0.06f, 8, 0}, {0, -0.45f, 0.16f, 10, 1}};
+    float tieSpacing = 1.0f;
+    Vec3 tieSize {1.3f, 0.08f, 0.15f}; // Width, height and depth
+    float tieUp = -0.08f;
+    unsigned tieMaterial = 0;
+    float ringSpacing = 2.0f;  // Longest distance between two rings of a tube
+    float ringAngle = 0.08f;   // Radians the frame may turn before a new ring is needed
+};
+
+// Geometry of one material of a segment
+struct ExtrudedPart
+{
+    std::vector<float> vertices; // Position, normal and texture coordinates
+    std::vector<uint32_t> indices;
+
+    static constexpr size_t STRIDE = 8;
+
+    void vertex(const Vec3& p, const Vec3& n, float u, float v)
+    {
+        vertices.insert(vertices.end(), {p.x, p.y, p.z, n.x, n.y, n.z, u, v});
+    }
+    uint32_t vertexCount() const { return vertices.size() / STRIDE; }
+};
+
+struct ExtrudedSegment
+{
+    uint32_t revision; // Revision of the track segment it was built from
+    std::vector<ExtrudedPart> parts; // One per material
+    Vec3 min;
+    Vec3 max;
+};
+
+// Frame at a distance from the start of the segment, interpolated from its samples
+inline TrackSample segmentFrame(const std::vector<TrackSample>& samples, float length, float s)
+{
+    float f {length > 0 ? s / length * (samples.size() - 1) : 0};
+    size_t k {std::min(size_t(std::max(f, 0.0f)), samples.size() - 2)};
+    float w {std::min(f - k, 1.0f)};
+    const TrackSample& a {samples[k]};
+    const TrackSample& b {samples[k + 1]};
+    return {lerp(a.position, b.position, w), lerp(a.tangent, b.tangent, w).normalised(), lerp(a.normal, b.normal, w).normalised(), lerp(a.curvature, b.curvature, w)};
+}
+
+inline ExtrudedSegment extrudeSegment(uint32_t revision, const std::vector<TrackSample>& samples, float length, const TrackStyle& style)
+{
+    ExtrudedSegment segment {revision, std::vector<ExtrudedPart>(style.materials.size()), samples[0].position, samples[0].position};
+    const float pi {3.14159265f};
+
+    // Rings only where the frame turns or the spacing runs out, both ends included
+    float step {length / (samples.size() - 1)};
+    std::vector<size_t> rings {0};
+    for (size_t k = 1; k + 1 < samples.size(); ++k)
+    {
+        const TrackSample& last {samples[rings.back()]};
+        float turned {std::acos(std::min(1.0f, last.tangent.dot(samples[k].tangent))) + std::acos(std::min(1.0f, last.normal.dot(samples[k].normal)))};
+        if (turned > style.ringAngle || (k - rings.back()) * step > style.ringSpacing)
+            rings.push_back(k);
+    }
+    rings.push_back(samples.size() - 1);
+
+    for (const TubeProfile& tube : style.tubes)
+    {
+        ExtrudedPart& part {segment.parts[tube.material]};
+        uint32_t base {part.vertexCount()};
+        for (size_t k : rings)
+        {
+            const TrackSample& sample {samples[k]};
+            Vec3 right {sample.tangent.cross(sample.normal)};
+            Vec3 center {sample.position + right * tube.right + sample.normal * tube.up};
+            float v {k * step * 0.5f};
+            for (unsigned side = 0; side <= tube.sides; ++side) // The seam is repeated for the texture
+            {
+                float angle {2 * pi * side / tube.sides};
+                Vec3 normal {right * std::cos(angle) + sample.normal * std::sin(angle)};
+                part.vertex(center + normal * tube.radius, normal, float(side) / tube.sides, v);
+            }
+        }
+        uint32_t ring {tube.sides + 1};
+        for (uint32_t r = 0; r + 1 < rings.size(); ++r)
+        {
+            for (uint32_t side = 0; side < tube.sides; ++side)
+            {
+                uint32_t a {base + r * ring + side};
+                uint32_t b {a + ring};
+                part.indices.insert(part.indices.end(), {a, b, a + 1, b, b + 1, a + 1}); // Counter clockwise seen from outside
+            }
+        }
+    }
+
+    // Ties spread evenly over the segment, it does not depend on the segments before it
+    ExtrudedPart& ties {segment.parts[style.tieMaterial]};
+    size_t tieCount {std::max<size_t>(1, size_t(std::round(length / style.tieSpacing)))};
+    for (size_t tie = 0; tie < tieCount; ++tie)
+    {
+        TrackSample frame {segmentFrame(samples, length, (tie + 0.5f) * length / tieCount)};
+        Vec3 axes[3] {frame.normal.cross(frame.tangent), frame.normal, frame.tangent}; // Right handed
+        float half[3] {style.tieSize.x / 2, style.tieSize.y / 2, style.tieSize.z / 2};
+        Vec3 center {frame.position + frame.normal * style.tieUp};
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (float sign : {-1.0f, 1.0f})
+            {
+                // Face perpendicular to the axis, spanned by the other two
+                Vec3 normal {axes[axis] * sign};
+                Vec3 du {axes[(axis + 1) % 3] * half[(axis + 1) % 3]};
+                Vec3 dv {axes[(axis + 2) % 3] * half[(axis + 2) % 3] * sign};
+                Vec3 face {center + normal * half[axis]};
+                uint32_t a {ties.vertexCount()};
+                ties.vertex(face - du - dv, normal, 0, 0);
+                ties.vertex(face + du - dv, normal, 1, 0);
+                ties.vertex(face + du + dv, normal, 1, 1);
+                ties.vertex(face - du + dv, normal, 0, 1);
+                ties.indices.insert(ties.indices.end(), {a, a + 1, a + 2, a, a + 2, a + 3});
+            }
+        }
+    }
+
+    for (const ExtrudedPart& part : segment.parts)
+    {
+        for (size_t i = 0; i < part.vertices.size(); i += ExtrudedPart::STRIDE)
+        {
+            segment.min = {std::min(segment.min.x, part.vertices[i]), std::min(segment.min.y, part.vertices[i + 1]), std::min(segment.min.z, part.vertices[i + 2])};
+            segment.max = {std::max(segment.max.x, part.vertices[i]), std::max(segment.max.y, part.vertices[i + 1]), std::max(segment.max.z, part.vertices[i + 2])};
+        }
+    }
+    return segment;
+}
+
+// Extrudes the requested segments on its own thread, the results are collected by the render thread
+class TrackExtruder
+{
+    public:
+        explicit TrackExtruder(const TrackStyle& style = TrackStyle{}) :
+            style{style},
+            worker{&TrackExtruder::run, this}
+        {}
+
+        ~TrackExtruder()
+        {
+            {
+                std::lock_guard<std::mutex> lock {mutex};
+                stopping = true;
+            }
+            wake.notify_one();
+            worker.join();
+        }
+
+        TrackExtruder(const TrackExtruder&) = delete;
+        TrackExtruder& operator=(const TrackExtruder&) = delete;
+
+        // The samples are copied, the track can be edited while the job waits
+        void request(uint32_t revision, const std::vector<TrackSample>& samples, float length)
+        {
+            {
+                std::lock_guard<std::mutex> lock {mutex};
+                jobs.push_back({revision, samples, length});
+            }
+            wake.notify_one();
+        }
+
+        // Forgets a job that has not started yet
+        void drop(uint32_t revision)
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            for (auto job {jobs.begin()}; job != jobs.end(); ++job)
+            {
+                if (job->revision == revision)
+                {
+                    jobs.erase(job);
+                    return;
+                }
+            }
+        }
+
+        bool collect(ExtrudedSegment& segment)
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            if (results.empty())
+                return false;
+            segment = std::move(results.front());
+            results.pop_front();
+            return true;
+        }
+
+        const TrackStyle& getStyle() const { return style; }
+
+    private:
+        struct Job
+        {
+            uint32_t revision;
+            std::vector<TrackSample> samples;
+            float length;
+        };
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock {mutex};
+            while (true)
+            {
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+                Job job {std::move(jobs.front())};
+                jobs.pop_front();
+
+                lock.unlock();
+                ExtrudedSegment segment {extrudeSegment(job.revision, job.samples, job.length, style)};
+                lock.lock();
+                results.push_back(std::move(segment));
+            }
+        }
+
+        TrackStyle style;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<Job> jobs;
+        std::deque<ExtrudedSegment> results;
+        bool stopping = false;
+        std::thread worker; // Last, it starts once everything else is built
+};
@@ -0,0 +1,148 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the tray widget that draws the graphs of a ride. The
+graphs are painted into a small dynamic texture shown by an overlay panel,
+one band per channel of the telemetry history.
+*/
+
+#pragma once
+
+#include "Ogre.h"
+#include "OgreOverlayManager.h"
+#include "OgreTrays.h"
+#include "telemetry.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+class GraphWidget : public OgreBites::Widget
+{
+    public:
+        GraphWidget(const Ogre::String& name, unsigned width, unsigned bandHeight);
+        ~GraphWidget();
+
+        // Repaints the bands from the history, the cost only depends on the size of the widget
+        void draw(const TelemetryHistory&);
+
+    private:
+        struct Band
+        {
+            TelemetryHistory::Channel channel;
+            float min; // Range shown
+            float max;
+            uint32_t colour;
+        };
+
+        void fill(unsigned x, unsigned y0, unsigned y1, uint32_t colour);
+
+        unsigned width;
+        unsigned bandHeight;
+        std::vector<Band> bands;
+        std::vector<uint32_t> pixels;
+        Ogre::TexturePtr texture;
+        Ogre::MaterialPtr material;
+};
+
+inline GraphWidget::GraphWidget(const Ogre::String& name, unsigned width, unsigned bandHeight) :
+    width{width},
+    bandHeight{bandHeight}
+{
+    // Colours are ABGR, how PF_BYTE_RGBA is laid in memory on little endian
+    bands = {
+        {TelemetryHistory::Speed, 0, 40, 0xff40d0ff},
+        {TelemetryHistory::Acceleration, -20, 20, 0xff40ff80},
+        {TelemetryHistory::Vertical, -2, 6, 0xff4080ff},
+        {TelemetryHistory::Lateral, -3, 3, 0xffff8040}
+    };
+    unsigned height {bandHeight * unsigned(bands.size())};
+    pixels.resize(width * height);
+
+    texture = Ogre::TextureManager::getSingleton().createManual(name + "/Texture", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, Ogre::TEX_TYPE_2D, width, height, 0, Ogre::PF_BYTE_RGBA, Ogre::TU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+    material = Ogre::MaterialManager::getSingleton().create(name + "/Material", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    Ogre::Pass* pass {material->getTechnique(0)->getPass(0)};
+    pass->setLightingEnabled(false);
+    pass->setDepthCheckEnabled(false);
+    pass->setSceneBlending(Ogre::SBT_TRANSPARENT_ALPHA);
+    pass->createTextureUnitState(texture->getName());
+
+    Ogre::OverlayElement* panel {Ogre::OverlayManager::getSingleton().createOverlayElement("Panel", name)};
+    panel->setMetricsMode(Ogre::GMM_PIXELS);
+    panel->setDimensions(width, height);
+    panel->setMaterial(material);
+    mElement = panel;
+}
+
+inline GraphWidget::~GraphWidget()
+{
+    // The panel is destroyed by the tray manager through cleanup()
+    Ogre::MaterialManager::getSingleton().remove(material);
+    Ogre::TextureManager::getSingleton().remove(texture);
+}
+
+inline void GraphWidget::fill(unsigned x, unsigned y0, unsigned y1, uint32_t colour)
+{
+    for (unsigned y = y0; y <= y1; ++y)
+        pixels[y * width + x] = colour;
+}
+
+inline void GraphWidget::draw(const TelemetryHistory& history)
+{
+    std::fill(pixels.begin(), pixels.end(), 0xa0000000); // Translucent black
+
+    for (size_t b = 0; b < bands.size(); ++b)
+    {
+        const Band& band {bands[b]};
+        const std::vector<TelemetryHistory::Column>& columns {history.columns(band.channel)};
+        unsigned top {unsigned(b) * bandHeight};
+        auto row = [&](float value)
+        {
+            float t {(value - band.min) / (band.max - band.min)};
+            t = std::min(std::max(t, 0.0f), 1.0f);
+            return top + unsigned((1 - t) * (bandHeight - 2)) + 1;
+        };
+
+        // Zero line and separation between the bands
+        std::fill(pixels.begin() + row(0) * width, pixels.begin() + (row(0) + 1) * width, 0xff606060);
+        std::fill(pixels.begin() + top * width, pixels.begin() + (top + 1) * width, 0xffa0a0a0);
+
+        if (columns.empty())
+            continue;
+
+        // Every pixel column spans the range of the history columns under it, joined to the previous one
+        unsigned previous {row(columns[0].min)};
+        for (unsigned x = 0; x < width; ++x)
+        {
+            size_t first {x * history.getCapacity() / width};
+            size_t last {std::max(first + 1, size_t(x + 1) * history.getCapacity() / width)};
+            if (first >= columns.size())
+                break;
+            float low {columns[first].min};
+            float high {columns[first].max};
+            for (size_t c = first + 1; c < std::min(last, columns.size()); ++c)
+            {
+                low = std::min(low, columns[c].min);
+                high = std::max(high, columns[c].max);
+            }
+            unsigned y0 {std::min(row(high), previous)};
+            unsigned y1 {std::max(row(low), previous)};
+            fill(x, y0, y1, band.colour);
+            previous = (row(high) + row(low)) / 2;
+        }
+    }
+
+    texture->getBuffer()->blitFromMemory(Ogre::PixelBox(width, bandHeight * bands.size(), 1, Ogre::PF_BYTE_RGBA, pixels.data()));
+}
@@ -0,0 +1,316 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the pool of hardware instances used to render the
+decorations. Every submesh of a decoration mesh gets its own InstanceManager,
+so thousands of trees cost one draw call per batch instead of one per tree.
+
+Instances cannot switch the level of detail of their mesh, so every level is
+a mesh with its own managers and the pool moves each decoration to the level
+of its distance to the camera. Past the last level a decoration is a
+billboard with a picture of the mesh, all of them in one BillboardSet. The
+full instance stays attached and hidden, picking and saving still use it.
+*/
+
+#pragma once
+
+#include "lod.h"
+#include "Ogre.h"
+#include "OgreRTShaderSystem.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class DecorationPool
+{
+    public:
+        static constexpr unsigned IMPOSTOR_SIZE = 256; // Pixels of side of the picture of the billboards
+
+        // The managers belong to the SceneManager, which destroys them with the scene
+        DecorationPool(Ogre::SceneManager*, const Ogre::String& meshName, const LodProfile&, size_t instancesPerBatch = 128);
+
+        // Attaches the node at the level of the last camera position, reusing released instances first
+        void attach(Ogre::SceneNode*);
+        // Returns the instances of the node to the pool, false if the node is not a decoration of this pool
+        bool release(Ogre::SceneNode*);
+        // Moves every decoration to the level of its distance, called once per frame
+        void update(const Ogre::Vector3& camera);
+
+        const Ogre::String& getMeshName() const { return meshName; }
+        size_t size() const { return used.size(); }
+        size_t capacity() const;
+
+    private:
+        typedef std::vector<Ogre::InstancedEntity*> Instance; // One instanced entity per submesh
+
+        struct Level
+        {
+            std::vector<Ogre::InstanceManager*> managers;
+            std::vector<Ogre::String> materials;
+            std::vector<Instance> parked; // Released instances waiting to be reused
+        };
+
+        struct Placed
+        {
+            size_t level; // levels.size() for the billboard
+            Instance full; // Always the first objects of the node
+            Instance reduced; // Of the level when it is not the first one
+            Ogre::Billboard* billboard;
+        };
+
+        Ogre::String instancedMaterial(const Ogre::String&);
+        size_t levelAt(float distance) const;
+        Instance take(size_t level);
+        void show(Ogre::SceneNode*, Placed&, size_t level);
+        void hide(Ogre::SceneNode*, Placed&);
+        void renderImpostor(const Ogre::Quaternion&);
+
+        Ogre::SceneManager* scnMgr;
+        Ogre::String meshName;
+        Ogre::MeshPtr mesh;
+        const LodProfile& profile;
+        size_t instancesPerBatch;
+        std::vector<Level> levels; // The mesh, then one per level of detail
+        std::unordered_map<Ogre::SceneNode*, Placed> used;
+        Ogre::Vector3 camera {Ogre::Vector3::ZERO};
+        Ogre::BillboardSet* impostors = nullptr; // Made when the first decoration is far enough
+        Ogre::Vector3 impostorCenter; // Of the bounds of the oriented mesh
+        Ogre::Vector2 impostorSize;
+};
+
+inline DecorationPool::DecorationPool(Ogre::SceneManager* scnMgr, const Ogre::String& meshName, const LodProfile& profile, size_t instancesPerBatch) :
+    scnMgr{scnMgr},
+    meshName{meshName},
+    mesh{Ogre::MeshManager::getSingleton().load(meshName, Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME)},
+    profile{profile},
+    instancesPerBatch{instancesPerBatch}
+{
+    ensureLods(mesh, profile);
+    levels.resize(mesh->getNumLodLevels());
+    for (unsigned short l = 0; l < levels.size(); ++l)
+    {
+        Ogre::MeshPtr levelMesh {lodMesh(mesh, l)};
+        for (unsigned short i = 0; i < levelMesh->getNumSubMeshes(); ++i)
+        {
+            Ogre::String name {"Decoration/" + levelMesh->getName() + "/" + std::to_string(i)};
+            levels[l].managers.push_back(scnMgr->createInstanceManager(name, levelMesh->getName(), levelMesh->getGroup(), Ogre::InstanceManager::HWInstancingBasic, instancesPerBatch, Ogre::IM_USEALL, i));
+            levels[l].materials.push_back(instancedMaterial(levelMesh->getSubMesh(i)->getMaterialName()));
+        }
+    }
+}
+
+// Copy of the material whose shaders read the world matrix from the instance data
+inline Ogre::String DecorationPool::instancedMaterial(const Ogre::String& name)
+{
+    Ogre::String instancedName {name + "/Instanced"};
+    if (Ogre::MaterialManager::getSingleton().resourceExists(instancedName))
+        return instancedName;
+
+    Ogre::MaterialPtr material {Ogre::MaterialManager::getSingleton().getByName(name)};
+    Ogre::MaterialPtr instanced {material->clone(instancedName)};
+
+    Ogre::RTShader::ShaderGenerator* shadergen {Ogre::RTShader::ShaderGenerator::getSingletonPtr()};
+    shadergen->createShaderBasedTechnique(*instanced, Ogre::MaterialManager::DEFAULT_SCHEME_NAME, Ogre::RTShader::ShaderGenerator::DEFAULT_SCHEME_NAME);
+    Ogre::RTShader::RenderState* renderState {shadergen->getRenderState(Ogre::RTShader::ShaderGenerator::DEFAULT_SCHEME_NAME, *instanced)};
+    Ogre::RTShader::SubRenderState* transform {shadergen->createSubRenderState("FFP_Transform")};
+    transform->setParameter("instanced", "true");
+    renderState->addTemplateSubRenderState(transform);
+    return instancedName;
+}
+
+inline size_t DecorationPool::capacity() const
+{
+    return used.size() + levels[0].parked.size(); // Every decoration holds one full instance
+}
+
+inline size_t DecorationPool::levelAt(float distance) const
+{
+    if (profile.impostorDistance > 0 && distance >= profile.impostorDistance)
+        return levels.size();
+    // The distances the mesh was generated or cooked with, it may have more levels than the profile
+    size_t level {0};
+    while (level + 1 < levels.size() && distance >= mesh->getLodLevel(Ogre::ushort(level + 1)).userValue)
+        ++level;
+    return level;
+}
+
+inline DecorationPool::Instance DecorationPool::take(size_t level)
+{
+    Level& source {levels[level]};
+    Instance instance;
+    if (!source.parked.empty())
+    {
+        instance = std::move(source.parked.back());
+        source.parked.pop_back();
+    }
+    else
+    {
+        // The managers create a new batch when the current ones are full
+        for (size_t i = 0; i < source.managers.size(); ++i)
+            instance.push_back(scnMgr->createInstancedEntity(source.materials[i], source.managers[i]->getName()));
+    }
+    return instance;
+}
+
+inline void DecorationPool::show(Ogre::SceneNode* node, Placed& placed, size_t level)
+{
+    placed.level = level;
+    for (Ogre::InstancedEntity* part : placed.full)
+        part->setVisible(level == 0);
+    if (level == levels.size())
+    {
+        if (impostors == nullptr)
+            renderImpostor(node->_getDerivedOrientation());
+        const Ogre::Vector3& scale {node->_getDerivedScale()};
+        placed.billboard = impostors->createBillboard(node->_getDerivedPosition() + impostorCenter * scale);
+        placed.billboard->setDimensions(impostorSize.x * scale.x, impostorSize.y * scale.y);
+    }
+    else if (level > 0)
+    {
+        placed.reduced = take(level);
+        for (Ogre::InstancedEntity* part : placed.reduced)
+        {
+            node->attachObject(part);
+            part->setVisible(true);
+        }
+    }
+}
+
+inline void DecorationPool::hide(Ogre::SceneNode* node, Placed& placed)
+{
+    if (placed.level == levels.size())
+    {
+        impostors->removeBillboard(placed.billboard);
+        placed.billboard = nullptr;
+    }
+    else if (placed.level > 0)
+    {
+        // Detaching swaps with the last objects, the full instance keeps its place
+        for (Ogre::InstancedEntity* part : placed.reduced)
+        {
+            node->detachObject(part);
+            part->setVisible(false);
+        }
+        levels[placed.level].parked.push_back(std::move(placed.reduced));
+        placed.reduced.clear();
+    }
+}
+
+inline void DecorationPool::attach(Ogre::SceneNode* node)
+{
+    Placed& placed {used[node]};
+    placed.billboard = nullptr;
+    placed.full = take(0);
+    for (Ogre::InstancedEntity* part : placed.full)
+        node->attachObject(part);
+    show(node, placed, levelAt(node->_getDerivedPosition().distance(camera)));
+}
+
+inline bool DecorationPool::release(Ogre::SceneNode* node)
+{
+    auto placed {used.find(node)};
+    if (placed == used.end())
+        return false;
+    hide(node, placed->second);
+    for (Ogre::InstancedEntity* part : placed->second.full)
+    {
+        node->detachObject(part);
+        part->setVisible(false);
+    }
+    levels[0].parked.push_back(std::move(placed->second.full));
+    used.erase(placed);
+    return true;
+}
+
+inline void DecorationPool::update(const Ogre::Vector3& position)
+{
+    camera = position;
+    bool moved {false};
+    for (auto& decoration : used)
+    {
+        Ogre::SceneNode* node {decoration.first};
+        Placed& placed {decoration.second};
+        size_t level {levelAt(node->_getDerivedPosition().distance(camera))};
+        if (level != placed.level)
+        {
+            hide(node, placed);
+            show(node, placed, level);
+            moved = true;
+        }
+        else if (placed.billboard != nullptr)
+        {
+            // Decorations can be moved while they are far
+            Ogre::Vector3 at {node->_getDerivedPosition() + impostorCenter * node->_getDerivedScale()};
+            moved = moved || at != placed.billboard->getPosition();
+            placed.billboard->setPosition(at);
+        }
+    }
+    if (moved && impostors != nullptr)
+        impostors->_updateBounds();
+}
+
+// The mesh is drawn once from the side into a texture, in a scene of its own so nothing else is in the picture
+inline void DecorationPool::renderImpostor(const Ogre::Quaternion& orientation)
+{
+    Ogre::String name {"Decoration/" + meshName + "/Impostor"};
+    Ogre::SceneManager* studio {Ogre::Root::getSingleton().createSceneManager()};
+    Ogre::RTShader::ShaderGenerator* shadergen {Ogre::RTShader::ShaderGenerator::getSingletonPtr()};
+    shadergen->addSceneManager(studio);
+    studio->setAmbientLight(scnMgr->getAmbientLight());
+    Ogre::Light* light {studio->createLight()};
+    light->setType(Ogre::Light::LT_DIRECTIONAL);
+    Ogre::SceneNode* sun {studio->getRootSceneNode()->createChildSceneNode()};
+    sun->setDirection(Ogre::Vector3(0.55, -0.3, -0.75).normalisedCopy());
+    sun->attachObject(light);
+
+    Ogre::Entity* entity {studio->createEntity(mesh)};
+    studio->getRootSceneNode()->createChildSceneNode(Ogre::Vector3::ZERO, orientation)->attachObject(entity);
+    studio->getRootSceneNode()->_update(true, false);
+    const Ogre::AxisAlignedBox& bounds {entity->getWorldBoundingBox(true)};
+    impostorCenter = bounds.getCenter();
+    impostorSize = {bounds.getSize().x, bounds.getSize().y};
+
+    // Looking down -Z at the middle of the bounds, without perspective
+    Ogre::Camera* eye {studio->createCamera(name)};
+    eye->setProjectionType(Ogre::PT_ORTHOGRAPHIC);
+    eye->setOrthoWindow(impostorSize.x, impostorSize.y);
+    eye->setNearClipDistance(1);
+    eye->setFarClipDistance(bounds.getSize().z + 2);
+    studio->getRootSceneNode()->createChildSceneNode(impostorCenter + Ogre::Vector3(0, 0, bounds.getHalfSize().z + 1))->attachObject(eye);
+
+    Ogre::TexturePtr texture {Ogre::TextureManager::getSingleton().createManual(name, mesh->getGroup(), Ogre::TEX_TYPE_2D, IMPOSTOR_SIZE, IMPOSTOR_SIZE, 0, Ogre::PF_BYTE_RGBA, Ogre::TU_RENDERTARGET)};
+    Ogre::RenderTexture* target {texture->getBuffer()->getRenderTarget()};
+    Ogre::Viewport* viewport {target->addViewport(eye)};
+    viewport->setBackgroundColour(Ogre::ColourValue(0, 0, 0, 0));
+    viewport->setOverlaysEnabled(false);
+    viewport->setMaterialScheme(Ogre::RTShader::ShaderGenerator::DEFAULT_SCHEME_NAME);
+    target->update();
+    target->removeAllViewports();
+    shadergen->removeSceneManager(studio);
+    Ogre::Root::getSingleton().destroySceneManager(studio);
+
+    Ogre::MaterialPtr material {Ogre::MaterialManager::getSingleton().create(name, mesh->getGroup())};
+    Ogre::Pass* pass {material->getTechnique(0)->getPass(0)};
+    pass->setLightingEnabled(false);
+    pass->setAlphaRejectSettings(Ogre::CMPF_GREATER_EQUAL, 128);
+    pass->setCullingMode(Ogre::CULL_NONE);
+    pass->createTextureUnitState(name);
+
+    impostors = scnMgr->createBillboardSet(name, 64);
+    impostors->setMaterial(material);
+    impostors->setBillboardType(Ogre::BBT_POINT);
+    scnMgr->getRootSceneNode()->createChildSceneNode()->attachObject(impostors);
+}
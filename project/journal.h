@@ -0,0 +1,168 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the journal of the edits done in build mode. Every edit is
+stored as a small command that can be undone and redone in constant time.
+The journal drops its oldest commands when it reaches its memory budget.
+*/
+
+#pragma once
+
+#include "Ogre.h"
+#include "registry.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Everything needed to rebuild a deleted object
+struct NodeState
+{
+    EntityType type;
+    uint16_t mesh; // Index in the mesh table of the journal
+    int cost;
+    Ogre::Vector3 position;
+    Ogre::Quaternion orientation;
+    Ogre::Vector3 scale;
+};
+
+struct EditCommand
+{
+    enum class Kind : uint8_t
+    {
+        Create,
+        Delete,
+        Transform
+    };
+
+    Kind kind;
+    bool mergeable; // Small moves that the next move of the same object can absorb
+    EntityHandle handle;
+    NodeState before; // State before the edit (Delete, Transform)
+    NodeState after;  // State after the edit (Create, Transform)
+};
+
+class EditJournal
+{
+    public:
+        // Called with the handle of an object whose slot is no longer referenced by any command
+        typedef std::function<void(EntityHandle)> ReleaseCallback;
+
+        explicit EditJournal(size_t memoryBudget, ReleaseCallback release) :
+            budget{memoryBudget},
+            release{release}
+        {}
+
+        void record(const EditCommand&);
+        // The command to undo, nullptr if there is none. The caller applies it.
+        const EditCommand* undo();
+        const EditCommand* redo();
+        void clear();
+
+        bool canUndo() const { return cursor > 0; }
+        bool canRedo() const { return cursor < commands.size(); }
+        size_t size() const { return commands.size(); }
+        size_t memoryUsage() const { return commands.size() * sizeof(EditCommand) + meshBytes; }
+
+        uint16_t meshIndex(const std::string&);
+        const std::string& meshName(uint16_t index) const { return meshes[index]; }
+
+    private:
+        void discard(const EditCommand&, bool undone);
+
+        std::deque<EditCommand> commands; // [0, cursor) done, [cursor, size) undone
+        size_t cursor = 0;
+        size_t budget;
+        ReleaseCallback release;
+        std::vector<std::string> meshes; // A handful of names shared by every command
+        size_t meshBytes = 0;
+};
+
+inline void EditJournal::record(const EditCommand& command)
+{
+    // A new edit makes the undone commands unreachable
+    while (commands.size() > cursor)
+    {
+        discard(commands.back(), true);
+        commands.pop_back();
+    }
+
+    // Consecutive small moves of the same object become a single command
+    if (command.kind == EditCommand::Kind::Transform && command.mergeable && cursor > 0)
+    {
+        EditCommand& last {commands.back()};
+        if (last.kind == EditCommand::Kind::Transform && last.mergeable && last.handle == command.handle)
+        {
+            last.after = command.after;
+            return;
+        }
+    }
+
+    commands.push_back(command);
+    ++cursor;
+
+    // Forget the oldest edits when the budget is exceeded
+    while (memoryUsage() > budget && cursor > 1)
+    {
+        discard(commands.front(), false);
+        commands.pop_front();
+        --cursor;
+    }
+}
+
+inline const EditCommand* EditJournal::undo()
+{
+    if (!canUndo())
+        return nullptr;
+    return &commands[--cursor];
+}
+
+inline const EditCommand* EditJournal::redo()
+{
+    if (!canRedo())
+        return nullptr;
+    return &commands[cursor++];
+}
+
+inline void EditJournal::clear()
+{
+    while (!commands.empty())
+    {
+        discard(commands.back(), commands.size() > cursor);
+        commands.pop_back();
+    }
+    cursor = 0;
+}
+
+// Slots kept alive for an undo or redo are released with the last command that can bring them back
+inline void EditJournal::discard(const EditCommand& command, bool undone)
+{
+    if ((command.kind == EditCommand::Kind::Create && undone) || (command.kind == EditCommand::Kind::Delete && !undone))
+        release(command.handle);
+}
+
+inline uint16_t EditJournal::meshIndex(const std::string& name)
+{
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        if (meshes[i] == name)
+            return i;
+    }
+    meshes.push_back(name);
+    meshBytes += sizeof(std::string) + name.capacity();
+    return meshes.size() - 1;
+}
@@ -0,0 +1,160 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the levels of detail of the meshes. Every type of entity
+has its own distances, the meshes are given them by the cook-assets target or,
+when they were not cooked, the first time they are loaded; the MeshManager
+keeps the result for the rest of the session. Entities and the static world
+switch levels themselves, the instances of the decorations cannot, so every
+level can also be made into a mesh of its own.
+*/
+
+#pragma once
+
+#include "registry.h"
+#include "vertexcache.h"
+#include "Ogre.h"
+#include "OgreLodConfig.h"
+#include "OgreMeshLodGenerator.h"
+#include <string>
+#include <vector>
+
+// LODs are not worth it below this
+static constexpr size_t MIN_LOD_TRIANGLES = 256;
+
+struct LodStep
+{
+    float distance;  // Meters from the camera to the bounds
+    float reduction; // Part of the vertices removed
+};
+
+struct LodProfile
+{
+    std::vector<LodStep> levels;
+    float impostorDistance; // Meters from where a billboard is drawn instead, 0 for never
+};
+
+inline const LodProfile& lodProfile(EntityType type)
+{
+    // The coaster is large and seen from far, the trees are many and small
+    static const LodProfile world {{{100, 0.5f}, {300, 0.8f}}, 0};
+    static const LodProfile rail {{{80, 0.5f}, {250, 0.8f}}, 0};
+    static const LodProfile decoration {{{40, 0.5f}, {100, 0.8f}}, 200};
+    switch (type)
+    {
+        case EntityType::Rail:
+            return rail;
+        case EntityType::Decoration:
+            return decoration;
+        default:
+            return world;
+    }
+}
+
+// Indices of the range as 32 bits
+inline std::vector<uint32_t> readIndices(const Ogre::IndexData* data)
+{
+    std::vector<uint32_t> indices(data->indexCount);
+    if (data->indexCount == 0)
+        return indices;
+    Ogre::HardwareIndexBuffer* buffer {data->indexBuffer.get()};
+    size_t size {buffer->getIndexSize()};
+    Ogre::HardwareBufferLockGuard lock {buffer, data->indexStart * size, data->indexCount * size, Ogre::HardwareBuffer::HBL_READ_ONLY};
+    if (buffer->getType() == Ogre::HardwareIndexBuffer::IT_32BIT)
+        std::copy_n(static_cast<const uint32_t*>(lock.pData), data->indexCount, indices.begin());
+    else
+        std::copy_n(static_cast<const uint16_t*>(lock.pData), data->indexCount, indices.begin());
+    return indices;
+}
+
+// Same count, written over the range
+inline void writeIndices(Ogre::IndexData* data, const std::vector<uint32_t>& indices)
+{
+    if (indices.empty())
+        return;
+    Ogre::HardwareIndexBuffer* buffer {data->indexBuffer.get()};
+    size_t size {buffer->getIndexSize()};
+    Ogre::HardwareBufferLockGuard lock {buffer, data->indexStart * size, indices.size() * size, Ogre::HardwareBuffer::HBL_NORMAL};
+    if (buffer->getType() == Ogre::HardwareIndexBuffer::IT_32BIT)
+        std::copy(indices.begin(), indices.end(), static_cast<uint32_t*>(lock.pData));
+    else
+        std::transform(indices.begin(), indices.end(), static_cast<uint16_t*>(lock.pData), [](uint32_t i) { return uint16_t(i); });
+}
+
+inline size_t triangleCount(const Ogre::MeshPtr& mesh)
+{
+    size_t triangles {0};
+    for (Ogre::SubMesh* submesh : mesh->getSubMeshes())
+    {
+        if (submesh->operationType == Ogre::RenderOperation::OT_TRIANGLE_LIST)
+            triangles += submesh->indexData->indexCount / 3;
+    }
+    return triangles;
+}
+
+// The levels of the profile, at distances to the bounds, with their triangles in cache order
+inline void generateLods(Ogre::MeshPtr mesh, const LodProfile& profile)
+{
+    mesh->removeLodLevels();
+    Ogre::LodConfig config {mesh};
+    config.advanced.useCompression = false; // Every level gets its own indices, so they can be reordered
+    for (const LodStep& level : profile.levels)
+        config.createGeneratedLodLevel(level.distance, level.reduction);
+    Ogre::MeshLodGenerator::getSingleton().generateLodLevels(config);
+
+    for (Ogre::SubMesh* submesh : mesh->getSubMeshes())
+    {
+        const Ogre::VertexData* vertexData {submesh->useSharedVertices ? mesh->sharedVertexData : submesh->vertexData};
+        for (Ogre::IndexData* lod : submesh->mLodFaceList)
+        {
+            std::vector<uint32_t> indices {readIndices(lod)};
+            optimiseVertexCache(indices.data(), indices.size(), std::max<size_t>(vertexData->vertexCount, indices.empty() ? 0 : *std::max_element(indices.begin(), indices.end()) + 1));
+            writeIndices(lod, indices);
+        }
+    }
+}
+
+// Cooked meshes already have their levels, the rest get them the first time they are used
+inline void ensureLods(const Ogre::MeshPtr& mesh, const LodProfile& profile)
+{
+    if (mesh->getNumLodLevels() == 1 && !profile.levels.empty() && triangleCount(mesh) >= MIN_LOD_TRIANGLES
+        && !mesh->hasSkeleton() && !mesh->hasVertexAnimation())
+        generateLods(mesh, profile);
+}
+
+// Copy of the mesh with the triangles of one of its levels and no levels, for what cannot switch them like instances
+inline Ogre::MeshPtr lodMesh(const Ogre::MeshPtr& mesh, unsigned short level)
+{
+    if (level == 0)
+        return mesh;
+    Ogre::String name {mesh->getName() + "/Lod" + std::to_string(level)};
+    Ogre::MeshPtr copy {Ogre::MeshManager::getSingleton().getByName(name, mesh->getGroup())};
+    if (copy)
+        return copy;
+
+    copy = mesh->clone(name);
+    std::vector<Ogre::IndexData*> faces;
+    for (Ogre::SubMesh* submesh : copy->getSubMeshes())
+        faces.push_back(submesh->mLodFaceList[level - 1]->clone(true));
+    copy->removeLodLevels();
+    for (size_t i = 0; i < faces.size(); ++i)
+    {
+        Ogre::SubMesh* submesh {copy->getSubMesh(i)};
+        delete submesh->indexData;
+        submesh->indexData = faces[i];
+    }
+    return copy;
+}
@@ -0,0 +1,420 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the simulation of a day of operation of a ride with several
+trains. The circuit is split in blocks by hold points, the station and the
+block brakes, and a train may only enter a block when the train ahead has
+left it. The physics of each block is simulated once per entry speed, so the
+day itself is a queue of events, trains arriving at hold points and blocks
+becoming free, that jumps from one to the next without stepping the trains.
+*/
+
+#pragma once
+
+#include "physics.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct HoldPoint
+{
+    enum Kind
+    {
+        Station, // Every train stops, unloads and loads
+        Brake    // Trains pass trimmed to the trim speed, or stop if the next block is occupied
+    };
+
+    float distance = 0; // Meters along the track
+    Kind kind = Brake;
+    float trimSpeed = 0; // Meters per second a passing train leaves the brake at
+};
+
+// Chain lift or drive tyres: the train moves at least at the speed of the chain
+struct Chain
+{
+    float start = 0;
+    float end = 0;
+    float speed = 0;
+};
+
+// Where the trains are held and pulled, saved with the track
+struct RideLayout
+{
+    std::vector<HoldPoint> holds;
+    std::vector<Chain> chains;
+};
+
+struct OperationsPlan
+{
+    TrainParameters train;
+    size_t trains = 2;
+    size_t seats = 24;            // Riders per train, all the trains leave the station full
+    float trainLength = 12;       // Meters, a block is free once the rear of the train leaves it
+    float dwell = 45;             // Seconds in the station to unload and load
+    float dispatchInterval = 0;   // Least seconds between two dispatches, 0 to dispatch as soon as possible
+    float releaseSpeed = 3;       // Meters per second the tyres give to a train leaving a stop
+    float hours = 12;             // Length of the operating day
+    float timestep = 1.0f / 240;  // Of the block physics
+};
+
+struct OperationsReport
+{
+    size_t dispatches = 0;
+    float theoreticalPerHour = 0; // Riders per hour if no train ever waited
+    float simulatedPerHour = 0;
+    float meanInterval = 0;  // Seconds between dispatches
+    float cycleTime = 0;     // Seconds around the circuit of a train that never waits
+    float bottleneck = 0;    // Seconds between trains the slowest block allows
+    size_t bottleneckBlock = 0;
+    float stationWait = 0;   // Seconds of loaded trains waiting for a free block, all the day
+    float brakeWait = 0;     // Seconds of trains stopped at block brakes, all the day
+    size_t events = 0;
+
+    std::string report() const;
+};
+
+class OperationsSimulation
+{
+    public:
+        OperationsSimulation(const Track&, const RideLayout&, const OperationsPlan&);
+        OperationsReport run();
+
+    private:
+        // A block traversed from its first hold point at a given speed
+        struct Run
+        {
+            float duration = 0;  // Seconds until the front reaches the next hold point
+            float clearTime = 0; // Seconds until the rear leaves the first one
+            float exitSpeed = 0;
+        };
+
+        struct Event
+        {
+            enum Kind
+            {
+                Arrive,  // The front of the train reaches the end of its block
+                Clear,   // A block becomes free
+                Ready,   // The train is loaded
+                Dispatch // The dispatch interval is over
+            };
+
+            double time;
+            size_t order; // Events at the same time keep their order
+            Kind kind;
+            size_t index; // Train or block
+
+            bool operator>(const Event& e) const { return time != e.time ? time > e.time : order > e.order; }
+        };
+
+        static constexpr size_t NONE = size_t(-1);
+
+        const Run& blockRun(size_t block, float speed);
+        Run simulateBlock(size_t block, float speed) const;
+        float blockLength(size_t block) const;
+        size_t next(size_t hold) const { return (hold + 1) % layout.holds.size(); }
+        size_t previous(size_t hold) const { return (hold + layout.holds.size() - 1) % layout.holds.size(); }
+        void schedule(double time, Event::Kind, size_t index);
+        void enter(size_t train, size_t block, float speed);
+        void arrive(size_t train);
+        void release(size_t hold);
+        void tryDispatch();
+        void nominal(OperationsReport&);
+
+        const Track& track;
+        RideLayout layout;
+        OperationsPlan plan;
+        size_t station;
+        std::map<std::pair<size_t, float>, Run> runs; // Block and entry speed
+
+        // State of the day
+        std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+        size_t order = 0;
+        double now = 0;
+        std::vector<size_t> occupant;   // Per block, the train inside or reserving it
+        std::vector<size_t> held;       // Per hold point, the train stopped at it
+        std::vector<double> heldSince;  // Per hold point
+        std::vector<size_t> blockOf;    // Per train
+        std::vector<float> arrivalSpeed; // Per train, at the end of its block
+        bool stationReady = false;
+        double firstDispatch = 0;
+        double lastDispatch = -1e30;
+        OperationsReport result;
+};
+
+inline OperationsSimulation::OperationsSimulation(const Track& track, const RideLayout& rideLayout, const OperationsPlan& plan) :
+    track{track},
+    layout{rideLayout},
+    plan{plan}
+{
+    if (!track.isClosed() || track.length() <= 0)
+        throw std::runtime_error{"Operations need a closed track"};
+    std::sort(layout.holds.begin(), layout.holds.end(), [](const HoldPoint& a, const HoldPoint& b) { return a.distance < b.distance; });
+    auto found = std::find_if(layout.holds.begin(), layout.holds.end(), [](const HoldPoint& hold) { return hold.kind == HoldPoint::Station; });
+    if (found == layout.holds.end())
+        throw std::runtime_error{"The ride has no station"};
+    if (std::count_if(layout.holds.begin(), layout.holds.end(), [](const HoldPoint& hold) { return hold.kind == HoldPoint::Station; }) > 1)
+        throw std::runtime_error{"Only rides with one station are supported"};
+    station = found - layout.holds.begin();
+    if (plan.trains == 0 || plan.trains >= layout.holds.size())
+        throw std::runtime_error{"With " + std::to_string(layout.holds.size()) + " blocks the ride runs 1 to " + std::to_string(layout.holds.size() - 1) + " trains"};
+}
+
+// Block i goes from hold point i to the next one, around the circuit
+inline float OperationsSimulation::blockLength(size_t block) const
+{
+    float length {layout.holds[next(block)].distance - layout.holds[block].distance};
+    return length > 0 ? length : length + track.length();
+}
+
+inline OperationsSimulation::Run OperationsSimulation::simulateBlock(size_t block, float speed) const
+{
+    TrainParameters parameters {plan.train};
+    parameters.speed = speed;
+    TrainSimulation simulation {track, plan.timestep};
+    simulation.addTrain(parameters, layout.holds[block].distance);
+
+    float length {blockLength(block)};
+    float total {track.length()};
+    float travelled {0};
+    float previous {layout.holds[block].distance};
+    Run path;
+    path.clearTime = -1;
+    double limit {600};
+    while (travelled < length)
+    {
+        float position {simulation.distance(0)};
+        for (const Chain& chain : layout.chains)
+        {
+            bool inside {chain.start <= chain.end ? position >= chain.start && position < chain.end : position >= chain.start || position < chain.end};
+            if (inside && simulation.speed(0) < chain.speed)
+                simulation.setSpeed(0, chain.speed);
+        }
+        simulation.step();
+
+        float moved {simulation.distance(0) - previous};
+        if (moved < -total / 2)
+            moved += total;
+        else if (moved > total / 2)
+            moved -= total;
+        travelled += moved;
+        previous = simulation.distance(0);
+
+        if (path.clearTime < 0 && travelled >= plan.trainLength)
+            path.clearTime = simulation.getTime();
+        if (simulation.getTime() > limit || (simulation.speed(0) <= 0 && travelled < length))
+        {
+            std::ostringstream message;
+            message << "A train leaving hold point " << block << " at " << speed << " m/s does not reach the next one, it stalls "
+                    << travelled << " m into the block";
+            throw std::runtime_error{message.str()};
+        }
+    }
+    path.duration = simulation.getTime();
+    path.exitSpeed = simulation.speed(0);
+    if (path.clearTime < 0) // Shorter block than the train
+        path.clearTime = path.duration;
+    return path;
+}
+
+// The speeds that enter a block are few: the release speed and the trims, so the runs are cached
+inline const OperationsSimulation::Run& OperationsSimulation::blockRun(size_t block, float speed)
+{
+    auto key {std::make_pair(block, speed)};
+    auto found {runs.find(key)};
+    if (found != runs.end())
+        return found->second;
+    return runs.emplace(key, simulateBlock(block, speed)).first->second;
+}
+
+inline void OperationsSimulation::schedule(double time, Event::Kind kind, size_t index)
+{
+    events.push({time, order++, kind, index});
+}
+
+// The train starts the block at its first hold point, the previous block is free once its rear is out
+inline void OperationsSimulation::enter(size_t train, size_t block, float speed)
+{
+    const Run& path {blockRun(block, speed)};
+    occupant[block] = train;
+    blockOf[train] = block;
+    arrivalSpeed[train] = path.exitSpeed;
+    schedule(now + path.duration, Event::Arrive, train);
+    schedule(now + path.clearTime, Event::Clear, previous(block));
+    if (block == station)
+    {
+        if (result.dispatches++ == 0)
+            firstDispatch = now;
+        lastDispatch = now;
+    }
+}
+
+inline void OperationsSimulation::arrive(size_t train)
+{
+    size_t hold {next(blockOf[train])};
+    const HoldPoint& point {layout.holds[hold]};
+    if (point.kind == HoldPoint::Station)
+    {
+        held[hold] = train;
+        heldSince[hold] = now;
+        schedule(now + plan.dwell, Event::Ready, train);
+    }
+    else if (occupant[hold] == NONE)
+        enter(train, hold, std::min(arrivalSpeed[train], point.trimSpeed));
+    else
+    {
+        held[hold] = train;
+        heldSince[hold] = now;
+    }
+}
+
+// A block became free: the train stopped in front of it, if any, may go
+inline void OperationsSimulation::release(size_t hold)
+{
+    if (hold == station)
+    {
+        tryDispatch();
+        return;
+    }
+    size_t train {held[hold]};
+    if (train == NONE)
+        return;
+    held[hold] = NONE;
+    result.brakeWait += now - heldSince[hold];
+    enter(train, hold, plan.releaseSpeed);
+}
+
+inline void OperationsSimulation::tryDispatch()
+{
+    size_t train {held[station]};
+    if (train == NONE || !stationReady || occupant[station] != NONE)
+        return;
+    if (now < lastDispatch + plan.dispatchInterval)
+    {
+        schedule(lastDispatch + plan.dispatchInterval, Event::Dispatch, station);
+        return;
+    }
+    held[station] = NONE;
+    stationReady = false;
+    result.stationWait += now - heldSince[station];
+    enter(train, station, plan.releaseSpeed);
+}
+
+// A train that never waits: stops only at the station and passes the brakes at their trim
+inline void OperationsSimulation::nominal(OperationsReport& report)
+{
+    size_t blocks {layout.holds.size()};
+    std::vector<Run> path(blocks);
+    float speed {plan.releaseSpeed};
+    for (size_t i = 0; i < blocks; ++i)
+    {
+        size_t block {(station + i) % blocks};
+        path[block] = blockRun(block, speed);
+        speed = std::min(path[block].exitSpeed, layout.holds[next(block)].trimSpeed);
+        report.cycleTime += path[block].duration;
+    }
+    report.cycleTime += plan.dwell;
+
+    // A block takes the next train once the train inside has gone through it, waited at its end
+    // if it is the station and cleared it
+    for (size_t block = 0; block < blocks; ++block)
+    {
+        size_t end {next(block)};
+        float headway {path[block].duration + path[end].clearTime + (end == station ? plan.dwell : 0)};
+        if (headway > report.bottleneck)
+        {
+            report.bottleneck = headway;
+            report.bottleneckBlock = block;
+        }
+    }
+    float interval {std::max({report.bottleneck, plan.dispatchInterval, report.cycleTime / plan.trains})};
+    report.theoreticalPerHour = plan.seats * 3600 / interval;
+}
+
+inline OperationsReport OperationsSimulation::run()
+{
+    result = {};
+    nominal(result);
+
+    size_t blocks {layout.holds.size()};
+    occupant.assign(blocks, NONE);
+    held.assign(blocks, NONE);
+    heldSince.assign(blocks, 0);
+    blockOf.assign(plan.trains, 0);
+    arrivalSpeed.assign(plan.trains, 0);
+    events = {};
+    now = 0;
+    lastDispatch = -1e30;
+
+    // The first train loads at the station, the others wait at the brakes behind it
+    for (size_t train = 0; train < plan.trains; ++train)
+    {
+        size_t hold {(station + blocks - train) % blocks};
+        size_t block {previous(hold)};
+        occupant[block] = train;
+        blockOf[train] = block;
+        held[hold] = train;
+    }
+    stationReady = false;
+    schedule(plan.dwell, Event::Ready, 0);
+
+    double end {plan.hours * 3600.0};
+    while (!events.empty() && events.top().time <= end)
+    {
+        Event event {events.top()};
+        events.pop();
+        now = event.time;
+        ++result.events;
+        switch (event.kind)
+        {
+            case Event::Arrive:
+                arrive(event.index);
+                break;
+            case Event::Clear:
+                occupant[event.index] = NONE;
+                release(event.index);
+                break;
+            case Event::Ready:
+                stationReady = true;
+                heldSince[station] = now;
+                tryDispatch();
+                break;
+            case Event::Dispatch:
+                tryDispatch();
+                break;
+        }
+    }
+
+    result.simulatedPerHour = plan.hours > 0 ? result.dispatches * plan.seats / plan.hours : 0;
+    result.meanInterval = result.dispatches > 1 ? float((lastDispatch - firstDispatch) / (result.dispatches - 1)) : 0;
+    return result;
+}
+
+inline std::string OperationsReport::report() const
+{
+    std::ostringstream report;
+    report << "Dispatches: " << dispatches << ", every " << meanInterval << " s\n"
+           << "Riders per hour: " << simulatedPerHour << " simulated, " << theoreticalPerHour << " theoretical\n"
+           << "Cycle: " << cycleTime << " s, slowest block " << bottleneckBlock << " takes a train every " << bottleneck << " s\n"
+           << "Waiting: " << stationWait << " s loaded in the station, " << brakeWait << " s stopped at brakes\n"
+           << "Events: " << events << '\n';
+    return report.str();
+}
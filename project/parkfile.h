@@ -0,0 +1,321 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the park files. A park file is binary and laid out to be
+used where it lies once mapped into memory: a fixed header followed by
+sections of plain records, each aligned to 8 bytes:
+
+    header      magic, version, economy, terrain and the place of the sections
+    points      control points of the track in order
+    entities    rails in track order, then the decorations
+    meshes      names of the meshes, as places in the strings
+    strings     the characters of every name, without terminators
+
+Opening a park only checks that the sections fit in the file. The text
+export writes the same contents one line per record, for diffing.
+*/
+
+#pragma once
+
+#include "track.h"
+#include "registry.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#if defined(_WIN32)
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct ParkSection
+{
+    uint64_t offset; // Bytes from the start of the file
+    uint64_t count;  // Records
+};
+
+struct ParkString
+{
+    uint32_t offset; // Bytes from the start of the strings
+    uint32_t length;
+};
+
+struct ParkHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder; // PARK_BYTE_ORDER as written by the machine that saved the park
+    uint32_t closed;    // The track loops
+    uint64_t size;      // Bytes of the whole file, a truncated file is refused
+    int32_t cash;
+    int32_t time;       // Seconds left on the clock
+    float terrainSize;  // Meters of side of the terrain
+    uint32_t reserved;
+    ParkString terrain; // Heightmap of the terrain
+    ParkSection points;
+    ParkSection entities;
+    ParkSection meshes;
+    ParkSection strings;
+};
+
+struct ParkPoint
+{
+    float position[3];
+    float handle[3];
+    float bank;
+};
+
+struct ParkEntity
+{
+    float position[3];
+    float orientation[4]; // w x y z
+    float scale[3];
+    int32_t cost;
+    uint16_t mesh; // Index in the meshes
+    uint8_t type;  // EntityType
+    uint8_t reserved;
+};
+
+static_assert(std::is_trivially_copyable<ParkHeader>::value && sizeof(ParkHeader) == 112, "The park header is written as it is");
+static_assert(std::is_trivially_copyable<ParkPoint>::value && sizeof(ParkPoint) == 28, "Park points are written as they are");
+static_assert(std::is_trivially_copyable<ParkEntity>::value && sizeof(ParkEntity) == 48, "Park entities are written as they are");
+
+static constexpr char PARK_MAGIC[4] {'R', 'C', 'E', 'P'};
+static constexpr uint32_t PARK_VERSION = 1;
+static constexpr uint32_t PARK_BYTE_ORDER = 0x01020304;
+
+// Contents of a park being saved
+struct ParkContents
+{
+    int32_t cash = 0;
+    int32_t time = 0;
+    bool closed = false;
+    std::string terrain;
+    float terrainSize = 0;
+    std::vector<ParkPoint> points;
+    std::vector<ParkEntity> entities;
+    std::vector<std::string> meshes;
+};
+
+inline void savePark(const std::string& path, const ParkContents& park)
+{
+    auto align = [](uint64_t offset) { return (offset + 7) / 8 * 8; };
+
+    std::string strings {park.terrain};
+    std::vector<ParkString> meshes;
+    for (const std::string& mesh : park.meshes)
+    {
+        meshes.push_back({uint32_t(strings.size()), uint32_t(mesh.size())});
+        strings += mesh;
+    }
+
+    ParkHeader header {};
+    std::memcpy(header.magic, PARK_MAGIC, sizeof(header.magic));
+    header.version = PARK_VERSION;
+    header.byteOrder = PARK_BYTE_ORDER;
+    header.closed = park.closed;
+    header.cash = park.cash;
+    header.time = park.time;
+    header.terrainSize = park.terrainSize;
+    header.terrain = {0, uint32_t(park.terrain.size())};
+    header.points = {align(sizeof(ParkHeader)), park.points.size()};
+    header.entities = {align(header.points.offset + park.points.size() * sizeof(ParkPoint)), park.entities.size()};
+    header.meshes = {align(header.entities.offset + park.entities.size() * sizeof(ParkEntity)), meshes.size()};
+    header.strings = {align(header.meshes.offset + meshes.size() * sizeof(ParkString)), strings.size()};
+    header.size = header.strings.offset + strings.size();
+
+    std::ofstream file {path, std::ios::binary};
+    if (!file)
+        throw std::runtime_error{"Error writing park " + path};
+    auto write = [&file](uint64_t offset, const void* data, size_t bytes)
+    {
+        static const char padding[8] {};
+        file.write(padding, offset - uint64_t(file.tellp()));
+        file.write(static_cast<const char*>(data), bytes);
+    };
+    write(0, &header, sizeof(header));
+    write(header.points.offset, park.points.data(), park.points.size() * sizeof(ParkPoint));
+    write(header.entities.offset, park.entities.data(), park.entities.size() * sizeof(ParkEntity));
+    write(header.meshes.offset, meshes.data(), meshes.size() * sizeof(ParkString));
+    write(header.strings.offset, strings.data(), strings.size());
+    if (!file)
+        throw std::runtime_error{"Error writing park " + path};
+}
+
+// A park file mapped into memory, the records are read in place
+class ParkView
+{
+    public:
+        explicit ParkView(const std::string& path);
+        ~ParkView();
+        ParkView(const ParkView&) = delete;
+        ParkView& operator=(const ParkView&) = delete;
+
+        const ParkHeader& header() const { return *reinterpret_cast<const ParkHeader*>(data); }
+        const ParkPoint* points() const { return section<ParkPoint>(header().points); }
+        size_t pointCount() const { return header().points.count; }
+        const ParkEntity* entities() const { return section<ParkEntity>(header().entities); }
+        size_t entityCount() const { return header().entities.count; }
+        size_t meshCount() const { return header().meshes.count; }
+        std::string_view meshName(size_t mesh) const { return string(section<ParkString>(header().meshes)[mesh]); }
+        std::string_view terrain() const { return string(header().terrain); }
+
+    private:
+        template<typename T>
+        const T* section(const ParkSection& s) const { return reinterpret_cast<const T*>(data + s.offset); }
+        std::string_view string(const ParkString& s) const { return {data + header().strings.offset + s.offset, s.length}; }
+        template<typename T>
+        bool fits(const ParkSection&) const;
+        void check(const std::string& path) const;
+
+        const char* data = nullptr;
+        size_t size = 0;
+#if defined(_WIN32)
+        std::vector<char> buffer; // Read whole where there is no mmap
+#endif
+};
+
+template<typename T>
+bool ParkView::fits(const ParkSection& s) const
+{
+    return s.offset % alignof(uint64_t) == 0 && s.offset <= size && s.count <= (size - s.offset) / sizeof(T);
+}
+
+inline void ParkView::check(const std::string& path) const
+{
+    auto refuse = [&path](const std::string& reason) { throw std::runtime_error{"Error reading park " + path + ": " + reason}; };
+    if (size < sizeof(ParkHeader) || std::memcmp(header().magic, PARK_MAGIC, sizeof(PARK_MAGIC)) != 0)
+        refuse("not a park file");
+    if (header().version != PARK_VERSION)
+        refuse("version " + std::to_string(header().version) + " is not supported");
+    if (header().byteOrder != PARK_BYTE_ORDER)
+        refuse("saved on a machine with another byte order");
+    if (header().size != size)
+        refuse("the file is truncated");
+    if (!fits<ParkPoint>(header().points) || !fits<ParkEntity>(header().entities) || !fits<ParkString>(header().meshes) || !fits<char>(header().strings))
+        refuse("a section is out of the file");
+
+    // The names and the references to them are the only records that can point out of place
+    uint64_t strings {header().strings.count};
+    auto valid = [strings](const ParkString& s) { return uint64_t(s.offset) + s.length <= strings; };
+    if (!valid(header().terrain))
+        refuse("the terrain name is out of the file");
+    for (size_t i = 0; i < meshCount(); ++i)
+    {
+        if (!valid(section<ParkString>(header().meshes)[i]))
+            refuse("a mesh name is out of the file");
+    }
+    for (size_t i = 0; i < entityCount(); ++i)
+    {
+        if (entities()[i].mesh >= meshCount() || entities()[i].type >= uint8_t(EntityType::Count))
+            refuse("entity " + std::to_string(i) + " is not valid");
+    }
+}
+
+#if defined(_WIN32)
+inline ParkView::ParkView(const std::string& path)
+{
+    std::ifstream file {path, std::ios::binary};
+    if (!file)
+        throw std::runtime_error{"Error opening park " + path};
+    buffer.assign(std::istreambuf_iterator<char>{file}, {});
+    data = buffer.data();
+    size = buffer.size();
+    check(path);
+}
+
+inline ParkView::~ParkView() {}
+#else
+inline ParkView::ParkView(const std::string& path)
+{
+    int descriptor {open(path.c_str(), O_RDONLY)};
+    if (descriptor < 0)
+        throw std::runtime_error{"Error opening park " + path};
+    struct stat status;
+    void* mapping {MAP_FAILED};
+    if (fstat(descriptor, &status) == 0 && status.st_size > 0)
+        mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor); // The mapping keeps the file
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error{"Error mapping park " + path};
+    data = static_cast<const char*>(mapping);
+    size = status.st_size;
+    try
+    {
+        check(path);
+    }
+    catch (...)
+    {
+        munmap(const_cast<char*>(data), size);
+        throw;
+    }
+}
+
+inline ParkView::~ParkView()
+{
+    munmap(const_cast<char*>(data), size);
+}
+#endif
+
+inline void loadParkTrack(const ParkView& park, Track& track)
+{
+    track.clear();
+    for (size_t i = 0; i < park.pointCount(); ++i)
+    {
+        const ParkPoint& point {park.points()[i]};
+        track.addPoint({{point.position[0], point.position[1], point.position[2]}, {point.handle[0], point.handle[1], point.handle[2]}, point.bank});
+    }
+    track.setClosed(park.header().closed != 0);
+    track.update();
+}
+
+// One line per record, with enough digits to read the same floats back
+inline void exportPark(const ParkView& park, std::ostream& out)
+{
+    const ParkHeader& header {park.header()};
+    out << std::setprecision(std::numeric_limits<float>::max_digits10);
+    out << "park " << header.version << '\n'
+        << "economy " << header.cash << ' ' << header.time << '\n'
+        << "terrain " << park.terrain() << ' ' << header.terrainSize << '\n'
+        << "closed " << header.closed << '\n';
+    for (size_t i = 0; i < park.pointCount(); ++i)
+    {
+        const ParkPoint& p {park.points()[i]};
+        out << "point " << p.position[0] << ' ' << p.position[1] << ' ' << p.position[2] << ' '
+            << p.bank << ' ' << p.handle[0] << ' ' << p.handle[1] << ' ' << p.handle[2] << '\n';
+    }
+    for (size_t i = 0; i < park.meshCount(); ++i)
+        out << "mesh " << i << ' ' << park.meshName(i) << '\n';
+    for (size_t i = 0; i < park.entityCount(); ++i)
+    {
+        const ParkEntity& e {park.entities()[i]};
+        out << "entity " << int(e.type) << ' ' << e.mesh << ' ' << e.cost
+            << ' ' << e.position[0] << ' ' << e.position[1] << ' ' << e.position[2]
+            << ' ' << e.orientation[0] << ' ' << e.orientation[1] << ' ' << e.orientation[2] << ' ' << e.orientation[3]
+            << ' ' << e.scale[0] << ' ' << e.scale[1] << ' ' << e.scale[2] << '\n';
+    }
+}
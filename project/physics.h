@@ -0,0 +1,209 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the dynamics of the trains. A train is a mass that slides
+along the track, pulled by gravity and slowed by rolling friction and air
+drag, integrated at a fixed timestep. The forces felt by the riders are
+reported in their own frame. The state of all the trains is stored in
+contiguous arrays and nothing here needs Ogre, so the rides can be simulated
+without a window, much faster than real time.
+*/
+
+#pragma once
+
+#include "track.h"
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+struct TrainParameters
+{
+    float mass = 6000;              // Kilograms of the empty train
+    float passengerMass = 0;        // Kilograms of the load
+    float rollingFriction = 0.003f; // Coefficient of the wheels on the rails
+    float dragArea = 2.0f;          // Drag coefficient times the frontal area, in square meters
+    Vec3 wind;                      // Meters per second
+    float speed = 0;                // Meters per second when it is dispatched
+};
+
+// Force of the seat on the riders over their weight, 1 vertical when resting on a flat track
+struct GForce
+{
+    float vertical = 0;     // Along the up of the riders, positive pushes them into the seat
+    float lateral = 0;      // Towards their right
+    float longitudinal = 0; // Forward, positive pushes them into the seat back
+};
+
+class TrainSimulation
+{
+    public:
+        static constexpr float GRAVITY = 9.81f;
+        static constexpr float AIR_DENSITY = 1.225f;
+
+        explicit TrainSimulation(const Track& track, float timestep = 1.0f / 240) :
+            track{track},
+            timestep{timestep}
+        {}
+
+        size_t addTrain(const TrainParameters&, float distance = 0);
+        void clear();
+
+        // One step of every train
+        void step();
+        // As many fixed steps as fit in the elapsed time, the rest is kept for the next call
+        size_t advance(double seconds);
+
+        size_t size() const { return distances.size(); }
+        double getTime() const { return time; }
+        float getTimestep() const { return timestep; }
+
+        float distance(size_t train) const { return distances[train]; }
+        float speed(size_t train) const { return speeds[train]; }
+        float acceleration(size_t train) const { return accelerations[train]; }
+        GForce gforce(size_t train) const { return {verticals[train], laterals[train], longitudinals[train]}; }
+        int laps(size_t train) const { return lapCounts[train]; }
+        bool stopped(size_t train) const { return speeds[train] == 0 && accelerations[train] == 0; }
+
+        // Controls used by the block system and the tools
+        void setSpeed(size_t train, float speed) { speeds[train] = speed; }
+        void setDistance(size_t train, float distance) { distances[train] = distance; }
+
+    private:
+        const Track& track;
+        float timestep;
+        double time = 0;
+        double pending = 0;
+
+        // Structure of arrays, one entry per train
+        std::vector<float> distances;
+        std::vector<float> speeds;
+        std::vector<float> accelerations;
+        std::vector<float> masses;
+        std::vector<float> frictions;
+        std::vector<float> drags; // Drag force over mass per squared speed
+        std::vector<Vec3> winds;
+        std::vector<float> verticals;
+        std::vector<float> laterals;
+        std::vector<float> longitudinals;
+        std::vector<int> lapCounts;
+};
+
+inline size_t TrainSimulation::addTrain(const TrainParameters& parameters, float distance)
+{
+    float mass {parameters.mass + parameters.passengerMass};
+    distances.push_back(distance);
+    speeds.push_back(parameters.speed);
+    accelerations.push_back(0);
+    masses.push_back(mass);
+    frictions.push_back(parameters.rollingFriction);
+    drags.push_back(0.5f * AIR_DENSITY * parameters.dragArea / mass);
+    winds.push_back(parameters.wind);
+    verticals.push_back(1);
+    laterals.push_back(0);
+    longitudinals.push_back(0);
+    lapCounts.push_back(0);
+    return distances.size() - 1;
+}
+
+inline void TrainSimulation::clear()
+{
+    for (auto* values : {&distances, &speeds, &accelerations, &masses, &frictions, &drags, &verticals, &laterals, &longitudinals})
+        values->clear();
+    winds.clear();
+    lapCounts.clear();
+    time = 0;
+    pending = 0;
+}
+
+inline void TrainSimulation::step()
+{
+    const Vec3 gravity {0, -GRAVITY, 0};
+    float length {track.length()};
+    bool closed {track.isClosed()};
+
+    for (size_t i = 0; i < distances.size(); ++i)
+    {
+        TrackSample frame {track.sample(distances[i])};
+        float v {speeds[i]};
+
+        // The rails supply whatever keeps the train on the curve; friction grows with that force
+        Vec3 centripetal {frame.curvature * (v * v)};
+        Vec3 gravityAcross {gravity - frame.tangent * frame.tangent.dot(gravity)};
+        float support {(centripetal - gravityAcross).length()};
+
+        Vec3 air {frame.tangent * v - winds[i]};
+        float drag {drags[i] * air.length() * air.dot(frame.tangent)};
+        float pull {frame.tangent.dot(gravity) - drag};
+        float friction {frictions[i] * support};
+
+        float a;
+        if (v > 0)
+            a = pull - friction;
+        else if (v < 0)
+            a = pull + friction;
+        else
+            a = std::fabs(pull) > friction ? pull - std::copysign(friction, pull) : 0; // Static friction holds it
+
+        // Semi-implicit Euler, friction stops the train instead of reversing it
+        float next {v + a * timestep};
+        if (v != 0 && (next > 0) != (v > 0) && std::fabs(pull) <= friction)
+            next = 0;
+        speeds[i] = next;
+        accelerations[i] = a;
+        distances[i] += next * timestep;
+
+        if (closed && length > 0)
+        {
+            if (distances[i] >= length)
+            {
+                distances[i] -= length;
+                ++lapCounts[i];
+            }
+            else if (distances[i] < 0)
+            {
+                distances[i] += length;
+                --lapCounts[i];
+            }
+        }
+        else if (distances[i] <= 0 || distances[i] >= length)
+        {
+            // End of an open track
+            distances[i] = std::min(std::max(distances[i], 0.0f), length);
+            speeds[i] = 0;
+            accelerations[i] = 0;
+        }
+
+        // Acceleration of the riders minus gravity, in their frame
+        Vec3 felt {(frame.tangent * a + centripetal - gravity) / GRAVITY};
+        verticals[i] = felt.dot(frame.normal);
+        laterals[i] = felt.dot(frame.tangent.cross(frame.normal));
+        longitudinals[i] = felt.dot(frame.tangent);
+    }
+    time += timestep;
+}
+
+inline size_t TrainSimulation::advance(double seconds)
+{
+    pending += seconds;
+    size_t steps {0};
+    while (pending >= timestep)
+    {
+        step();
+        pending -= timestep;
+        ++steps;
+    }
+    return steps;
+}
@@ -0,0 +1,151 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the frame profiler used to compare the rendering cost of
+the scene before and after an optimization is switched on or off.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+
+class FrameProfiler
+{
+    public:
+        struct Averages
+        {
+            double frameTime = 0; // Milliseconds
+            double batches = 0;   // Draw calls per frame
+            double triangles = 0;
+        };
+
+        explicit FrameProfiler(size_t window = 120) : window{window} {}
+
+        void addFrame(double frameTimeMs, size_t batches, size_t triangles)
+        {
+            // Outside a comparison keep a rolling window as the next baseline
+            if (!comparing && frames >= window)
+            {
+                previous = averages();
+                reset();
+            }
+            current.frameTime += frameTimeMs;
+            current.batches += batches;
+            current.triangles += triangles;
+            ++frames;
+        }
+
+        // The frames recorded until now become the baseline of the comparison
+        void startComparison(const std::string& name)
+        {
+            label = name;
+            baseline = frames >= window / 2 ? averages() : previous;
+            comparing = true;
+            reset();
+        }
+
+        bool comparisonReady() const { return comparing && frames >= window; }
+
+        std::string finishComparison()
+        {
+            Averages after {averages()};
+            std::ostringstream report;
+            report << label << ": draw calls " << baseline.batches << " -> " << after.batches
+                   << " (" << percent(baseline.batches, after.batches) << "%), frame time "
+                   << baseline.frameTime << " ms -> " << after.frameTime << " ms ("
+                   << percent(baseline.frameTime, after.frameTime) << "%), triangles "
+                   << baseline.triangles << " -> " << after.triangles;
+            comparing = false;
+            reset();
+            return report.str();
+        }
+
+        Averages averages() const
+        {
+            if (frames == 0)
+                return {};
+            return {current.frameTime / frames, current.batches / frames, current.triangles / frames};
+        }
+
+        void reset()
+        {
+            current = {};
+            frames = 0;
+        }
+
+    private:
+        static double percent(double before, double after)
+        {
+            return before > 0 ? 100.0 * (after - before) / before : 0;
+        }
+
+        size_t window;
+        size_t frames = 0;
+        Averages current;
+        Averages previous;
+        Averages baseline;
+        std::string label;
+        bool comparing = false;
+};
+
+// Frame times in buckets of a millisecond, to compare whole runs and not only their averages
+class FrameTimeHistogram
+{
+    public:
+        static constexpr size_t BUCKETS = 100; // The last one also holds the slower frames
+
+        void add(double frameTimeMs)
+        {
+            size_t bucket {frameTimeMs > 0 ? size_t(frameTimeMs) : 0};
+            ++counts[bucket < BUCKETS ? bucket : BUCKETS - 1];
+            ++frames;
+            total += frameTimeMs;
+        }
+
+        // Upper bound in milliseconds of the bucket holding the given fraction of the frames
+        double percentile(double fraction) const
+        {
+            size_t seen {0};
+            for (size_t i = 0; i < BUCKETS; ++i)
+            {
+                seen += counts[i];
+                if (seen > 0 && seen >= fraction * frames)
+                    return double(i + 1);
+            }
+            return double(BUCKETS);
+        }
+
+        std::string report() const
+        {
+            std::ostringstream report;
+            report << "Frames: " << frames << ", mean " << (frames > 0 ? total / frames : 0) << " ms, p50 < "
+                   << percentile(0.5) << " ms, p95 < " << percentile(0.95) << " ms, p99 < " << percentile(0.99) << " ms\n";
+            for (size_t i = 0; i < BUCKETS; ++i)
+            {
+                if (counts[i] == 0)
+                    continue;
+                report << (i + 1 < BUCKETS ? "" : ">=") << i << " ms: " << counts[i] << '\n';
+            }
+            return report.str();
+        }
+
+    private:
+        size_t counts[BUCKETS] {};
+        size_t frames = 0;
+        double total = 0;
+};
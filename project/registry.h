@@ -0,0 +1,192 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the registry of the objects placed in the park. Objects
+are referenced by generational handles: a handle of a destroyed object is
+detected as stale instead of reaching a reused slot. The data of the live
+objects is stored densely so bulk queries only walk contiguous arrays.
+A retired object keeps its slot, so undo can bring it back with the same
+handle, until the slot is released.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Ogre { class SceneNode; }
+
+enum class EntityType : uint8_t
+{
+    World,
+    Rail,
+    Decoration,
+    Count
+};
+
+struct EntityHandle
+{
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const EntityHandle& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+};
+
+class EntityRegistry
+{
+    public:
+        EntityHandle create(EntityType, int cost, Ogre::SceneNode*);
+        void destroy(EntityHandle);
+        bool valid(EntityHandle) const;
+        // Alive or retired, the slot still belongs to the handle
+        bool reserved(EntityHandle handle) const { return handle.index < slots.size() && slots[handle.index].generation == handle.generation; }
+
+        // Remove the object but keep its handle reserved
+        void retire(EntityHandle);
+        // Bring a retired object back under the same handle
+        void restore(EntityHandle, EntityType, int cost, Ogre::SceneNode*);
+        // Give the slot of a retired object back, its handle becomes stale
+        void release(EntityHandle);
+
+        // Lookups, the handle must be valid
+        EntityType type(EntityHandle handle) const { return types[dense(handle)]; }
+        int cost(EntityHandle handle) const { return costs[dense(handle)]; }
+        Ogre::SceneNode* node(EntityHandle handle) const { return nodes[dense(handle)]; }
+        int& pickProxy(EntityHandle handle) { return pickProxies[dense(handle)]; }
+
+        // Dense arrays of the live objects, in no particular order
+        size_t size() const { return nodes.size(); }
+        const std::vector<EntityType>& getTypes() const { return types; }
+        const std::vector<int>& getCosts() const { return costs; }
+        const std::vector<Ogre::SceneNode*>& getNodes() const { return nodes; }
+        EntityHandle handleAt(size_t i) const { return {denseToSlot[i], slots[denseToSlot[i]].generation}; }
+
+        // Bulk queries kept up to date on every create and destroy
+        size_t count(EntityType type) const { return counts[static_cast<size_t>(type)]; }
+        long totalValue() const { return value; }
+
+    private:
+        struct Slot
+        {
+            uint32_t dense;      // Position in the dense arrays while alive, next free slot when free, NO_SLOT when retired
+            uint32_t generation; // Incremented on every destroy
+        };
+        static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+        uint32_t dense(EntityHandle handle) const { return slots[handle.index].dense; }
+        void push(uint32_t, EntityType, int, Ogre::SceneNode*);
+
+        std::vector<Slot> slots;
+        uint32_t freeSlot = NO_SLOT;
+
+        // Dense storage
+        std::vector<EntityType> types;
+        std::vector<int> costs;
+        std::vector<Ogre::SceneNode*> nodes;
+        std::vector<int> pickProxies;
+        std::vector<uint32_t> denseToSlot;
+
+        size_t counts[static_cast<size_t>(EntityType::Count)] = {};
+        long value = 0;
+};
+
+inline EntityHandle EntityRegistry::create(EntityType type, int cost, Ogre::SceneNode* node)
+{
+    uint32_t index {freeSlot};
+    if (index == NO_SLOT)
+    {
+        index = slots.size();
+        slots.push_back(Slot{0, 0});
+    }
+    else
+        freeSlot = slots[index].dense;
+
+    push(index, type, cost, node);
+    return {index, slots[index].generation};
+}
+
+inline void EntityRegistry::push(uint32_t index, EntityType type, int cost, Ogre::SceneNode* node)
+{
+    slots[index].dense = nodes.size();
+    types.push_back(type);
+    costs.push_back(cost);
+    nodes.push_back(node);
+    pickProxies.push_back(-1);
+    denseToSlot.push_back(index);
+
+    ++counts[static_cast<size_t>(type)];
+    value += cost;
+}
+
+inline void EntityRegistry::destroy(EntityHandle handle)
+{
+    if (!valid(handle))
+        return;
+    retire(handle);
+    release(handle);
+}
+
+inline void EntityRegistry::retire(EntityHandle handle)
+{
+    if (!valid(handle))
+        return;
+
+    uint32_t removed {dense(handle)};
+    --counts[static_cast<size_t>(types[removed])];
+    value -= costs[removed];
+
+    // Move the last object into the hole
+    uint32_t last = nodes.size() - 1;
+    types[removed] = types[last];
+    costs[removed] = costs[last];
+    nodes[removed] = nodes[last];
+    pickProxies[removed] = pickProxies[last];
+    denseToSlot[removed] = denseToSlot[last];
+    slots[denseToSlot[removed]].dense = removed;
+
+    types.pop_back();
+    costs.pop_back();
+    nodes.pop_back();
+    pickProxies.pop_back();
+    denseToSlot.pop_back();
+    slots[handle.index].dense = NO_SLOT;
+}
+
+inline void EntityRegistry::restore(EntityHandle handle, EntityType type, int cost, Ogre::SceneNode* node)
+{
+    if (handle.index < slots.size() && slots[handle.index].generation == handle.generation && slots[handle.index].dense == NO_SLOT)
+        push(handle.index, type, cost, node);
+}
+
+inline void EntityRegistry::release(EntityHandle handle)
+{
+    if (handle.index < slots.size() && slots[handle.index].generation == handle.generation && slots[handle.index].dense == NO_SLOT)
+    {
+        ++slots[handle.index].generation;
+        slots[handle.index].dense = freeSlot;
+        freeSlot = handle.index;
+    }
+}
+
+inline bool EntityRegistry::valid(EntityHandle handle) const
+{
+    if (handle.index >= slots.size() || slots[handle.index].generation != handle.generation)
+        return false;
+    uint32_t position {slots[handle.index].dense};
+    return position < denseToSlot.size() && denseToSlot[position] == handle.index;
+}
@@ -0,0 +1,226 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the recording and the replay of the input of a session.
+The log starts with the seed of the random generator and is followed by the
+events, each one stamped with the frame it arrived in. The numbers are stored
+as variable length integers, so a long session of mouse motion stays small.
+*/
+
+#pragma once
+
+#include "OgreInput.h"
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct InputLogHeader
+{
+    uint32_t seed = 0;          // Seed of the random generator
+    float frameDelta = 1.0f / 60; // Seconds of every frame on replay
+    uint32_t width = 0;         // Size of the window when it was recorded
+    uint32_t height = 0;
+};
+
+class InputRecorder
+{
+    public:
+        InputRecorder(const std::string& path, const InputLogHeader& header) :
+            file{path, std::ios::binary}
+        {
+            if (!file)
+                throw std::runtime_error{"Error writing input log " + path};
+            file.write(MAGIC, sizeof(MAGIC));
+            number(VERSION);
+            number(header.seed);
+            file.write(reinterpret_cast<const char*>(&header.frameDelta), sizeof(float));
+            number(header.width);
+            number(header.height);
+        }
+
+        void record(uint32_t frame, const OgreBites::KeyboardEvent& evt)
+        {
+            stamp(frame, evt.type);
+            signedNumber(evt.keysym.sym);
+            number(evt.keysym.mod);
+            number(evt.repeat);
+        }
+
+        void record(uint32_t frame, const OgreBites::MouseButtonEvent& evt)
+        {
+            stamp(frame, evt.type);
+            signedNumber(evt.x);
+            signedNumber(evt.y);
+            number(evt.button);
+            number(evt.clicks);
+        }
+
+        void record(uint32_t frame, const OgreBites::MouseMotionEvent& evt)
+        {
+            stamp(frame, evt.type);
+            signedNumber(evt.x);
+            signedNumber(evt.y);
+            signedNumber(evt.xrel);
+            signedNumber(evt.yrel);
+        }
+
+        void record(uint32_t frame, const OgreBites::MouseWheelEvent& evt)
+        {
+            stamp(frame, evt.type);
+            signedNumber(evt.y);
+        }
+
+        static constexpr char MAGIC[4] {'R', 'C', 'E', 'I'};
+        static constexpr uint32_t VERSION = 1;
+
+    private:
+        // Frames are stored as the difference with the previous event
+        void stamp(uint32_t frame, int type)
+        {
+            number(frame - lastFrame);
+            lastFrame = frame;
+            number(type);
+        }
+
+        void number(uint64_t value)
+        {
+            do
+            {
+                char byte = value & 0x7f;
+                value >>= 7;
+                file.put(value != 0 ? byte | 0x80 : byte);
+            } while (value != 0);
+        }
+
+        // Zigzag, small negative numbers also take one byte
+        void signedNumber(int64_t value)
+        {
+            number((uint64_t(value) << 1) ^ uint64_t(value >> 63));
+        }
+
+        std::ofstream file;
+        uint32_t lastFrame = 0;
+};
+
+class InputPlayer
+{
+    public:
+        explicit InputPlayer(const std::string& path)
+        {
+            std::ifstream file {path, std::ios::binary};
+            if (!file)
+                throw std::runtime_error{"Error opening input log " + path};
+            data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+            if (data.size() < sizeof(InputRecorder::MAGIC) || std::string(data.begin(), data.begin() + 4) != std::string(InputRecorder::MAGIC, 4))
+                throw std::runtime_error{"Not an input log " + path};
+            cursor = sizeof(InputRecorder::MAGIC);
+            if (number() != InputRecorder::VERSION)
+                throw std::runtime_error{"Unsupported version of the input log " + path};
+            header.seed = number();
+            if (cursor + sizeof(float) > data.size())
+                throw std::runtime_error{"Truncated input log " + path};
+            std::copy(data.begin() + cursor, data.begin() + cursor + sizeof(float), reinterpret_cast<char*>(&header.frameDelta));
+            cursor += sizeof(float);
+            header.width = number();
+            header.height = number();
+            readStamp();
+        }
+
+        const InputLogHeader& getHeader() const { return header; }
+        bool finished() const { return done; }
+
+        // The next event of the frame, false once the events of that frame are over
+        bool next(uint32_t frame, OgreBites::Event& event)
+        {
+            if (done || nextFrame != frame)
+                return false;
+
+            event.type = nextType;
+            switch (nextType)
+            {
+                case OgreBites::KEYDOWN:
+                case OgreBites::KEYUP:
+                    event.key.keysym.sym = signedNumber();
+                    event.key.keysym.mod = number();
+                    event.key.repeat = number();
+                    break;
+                case OgreBites::MOUSEBUTTONDOWN:
+                case OgreBites::MOUSEBUTTONUP:
+                    event.button.x = signedNumber();
+                    event.button.y = signedNumber();
+                    event.button.button = number();
+                    event.button.clicks = number();
+                    break;
+                case OgreBites::MOUSEMOTION:
+                    event.motion.x = signedNumber();
+                    event.motion.y = signedNumber();
+                    event.motion.xrel = signedNumber();
+                    event.motion.yrel = signedNumber();
+                    event.motion.windowID = 0;
+                    break;
+                case OgreBites::MOUSEWHEEL:
+                    event.wheel.y = signedNumber();
+                    break;
+                default:
+                    throw std::runtime_error{"Corrupt input log"};
+            }
+            readStamp();
+            return true;
+        }
+
+    private:
+        void readStamp()
+        {
+            if (cursor >= data.size())
+            {
+                done = true;
+                return;
+            }
+            nextFrame += number();
+            nextType = number();
+        }
+
+        uint64_t number()
+        {
+            uint64_t value {0};
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                if (cursor >= data.size())
+                    throw std::runtime_error{"Truncated input log"};
+                uint8_t byte = data[cursor++];
+                value |= uint64_t(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                    break;
+            }
+            return value;
+        }
+
+        int64_t signedNumber()
+        {
+            uint64_t value {number()};
+            return int64_t(value >> 1) ^ -int64_t(value & 1);
+        }
+
+        std::vector<char> data;
+        size_t cursor = 0;
+        InputLogHeader header;
+        uint32_t nextFrame = 0;
+        int nextType = 0;
+        bool done = false;
+};
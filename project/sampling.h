@@ -0,0 +1,382 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the batched sampling of a cubic Bezier segment. Positions,
+tangents, curvature, torsion and the rotation minimizing frame are computed
+over structure of arrays buffers, several samples per instruction with SSE or
+AVX2 when the compiler targets them. All the paths run the same template with
+the same operations in the same order, so the scalar fallback gives the same
+numbers bit for bit.
+*/
+
+#pragma once
+
+#include "vec3.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define RCE_SSE 1
+#endif
+#if defined(__AVX2__)
+#define RCE_AVX2 1
+#endif
+
+enum class SimdLevel
+{
+    Scalar,
+    SSE,
+    AVX2
+};
+
+// Widest path the compiler was allowed to use, build with -march=native to get AVX2
+constexpr SimdLevel bestSimdLevel()
+{
+#if defined(RCE_AVX2)
+    return SimdLevel::AVX2;
+#elif defined(RCE_SSE)
+    return SimdLevel::SSE;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+inline const char* simdName(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::AVX2: return "AVX2";
+        case SimdLevel::SSE: return "SSE";
+        default: return "scalar";
+    }
+}
+
+struct BezierCurve
+{
+    Vec3 b0, b1, b2, b3;
+};
+
+// Every array holds one value per sample plus padding up to a whole AVX2 register
+struct SampleArrays
+{
+    static constexpr size_t PADDING = 8;
+
+    std::vector<float> t;          // Curve parameter, the input
+    std::vector<float> px, py, pz; // Position
+    std::vector<float> tx, ty, tz; // Unit tangent
+    std::vector<float> kx, ky, kz; // Curvature vector dT/ds, its length is 1 / radius
+    std::vector<float> torsion;    // How fast the curve leaves its osculating plane
+    std::vector<float> nx, ny, nz; // Rotation minimizing normal
+
+    size_t size() const { return count; }
+
+    // The padding repeats the last parameter, so the extra lanes compute harmless values.
+    // The reflections read the next sample of every lane, so the last register group starts
+    // at most one sample before the end and reads a whole register past it
+    void resize(size_t samples)
+    {
+        count = samples;
+        size_t padded {(samples + PADDING) / PADDING * PADDING + PADDING};
+        for (std::vector<float>* array : {&t, &px, &py, &pz, &tx, &ty, &tz, &kx, &ky, &kz, &torsion, &nx, &ny, &nz})
+            array->resize(padded);
+        for (std::vector<float>& array : rotation)
+            array.resize(padded);
+    }
+
+    void padParameters()
+    {
+        std::fill(t.begin() + count, t.end(), count > 0 ? t[count - 1] : 0.0f);
+    }
+
+    // Rotation from each normal to the next one, row major, see rotationMinimizingFrames()
+    std::vector<float> rotation[9];
+
+    private:
+        size_t count = 0;
+};
+
+// Lanes of floats with the few operations the kernels need. Only plain IEEE
+// operations are used, never fused multiply add or approximations
+struct ScalarLanes
+{
+    static constexpr size_t WIDTH = 1;
+    float v;
+
+    ScalarLanes(float f) : v{f} {}
+    static ScalarLanes load(const float* p) { return *p; }
+    void store(float* p) const { *p = v; }
+
+    friend ScalarLanes operator+(ScalarLanes a, ScalarLanes b) { return a.v + b.v; }
+    friend ScalarLanes operator-(ScalarLanes a, ScalarLanes b) { return a.v - b.v; }
+    friend ScalarLanes operator*(ScalarLanes a, ScalarLanes b) { return a.v * b.v; }
+    friend ScalarLanes operator/(ScalarLanes a, ScalarLanes b) { return a.v / b.v; }
+    friend ScalarLanes sqrt(ScalarLanes a) { return std::sqrt(a.v); }
+    // a > b ? then : otherwise, lane by lane
+    friend ScalarLanes ifGreater(ScalarLanes a, ScalarLanes b, ScalarLanes then, ScalarLanes otherwise) { return a.v > b.v ? then : otherwise; }
+};
+
+#if defined(RCE_SSE)
+struct SseLanes
+{
+    static constexpr size_t WIDTH = 4;
+    __m128 v;
+
+    SseLanes(__m128 m) : v{m} {}
+    SseLanes(float f) : v{_mm_set1_ps(f)} {}
+    static SseLanes load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+
+    friend SseLanes operator+(SseLanes a, SseLanes b) { return _mm_add_ps(a.v, b.v); }
+    friend SseLanes operator-(SseLanes a, SseLanes b) { return _mm_sub_ps(a.v, b.v); }
+    friend SseLanes operator*(SseLanes a, SseLanes b) { return _mm_mul_ps(a.v, b.v); }
+    friend SseLanes operator/(SseLanes a, SseLanes b) { return _mm_div_ps(a.v, b.v); }
+    friend SseLanes sqrt(SseLanes a) { return _mm_sqrt_ps(a.v); }
+    friend SseLanes ifGreater(SseLanes a, SseLanes b, SseLanes then, SseLanes otherwise)
+    {
+        __m128 mask {_mm_cmpgt_ps(a.v, b.v)};
+        return _mm_or_ps(_mm_and_ps(mask, then.v), _mm_andnot_ps(mask, otherwise.v));
+    }
+};
+#endif
+
+#if defined(RCE_AVX2)
+struct AvxLanes
+{
+    static constexpr size_t WIDTH = 8;
+    __m256 v;
+
+    AvxLanes(__m256 m) : v{m} {}
+    AvxLanes(float f) : v{_mm256_set1_ps(f)} {}
+    static AvxLanes load(const float* p) { return _mm256_loadu_ps(p); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+    friend AvxLanes operator+(AvxLanes a, AvxLanes b) { return _mm256_add_ps(a.v, b.v); }
+    friend AvxLanes operator-(AvxLanes a, AvxLanes b) { return _mm256_sub_ps(a.v, b.v); }
+    friend AvxLanes operator*(AvxLanes a, AvxLanes b) { return _mm256_mul_ps(a.v, b.v); }
+    friend AvxLanes operator/(AvxLanes a, AvxLanes b) { return _mm256_div_ps(a.v, b.v); }
+    friend AvxLanes sqrt(AvxLanes a) { return _mm256_sqrt_ps(a.v); }
+    friend AvxLanes ifGreater(AvxLanes a, AvxLanes b, AvxLanes then, AvxLanes otherwise)
+    {
+        return _mm256_blendv_ps(otherwise.v, then.v, _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ));
+    }
+};
+#endif
+
+// Three components of lanes, so the kernels read like the Vec3 code
+template<typename F>
+struct LaneVec3
+{
+    F x, y, z;
+
+    LaneVec3(F x, F y, F z) : x{x}, y{y}, z{z} {}
+    explicit LaneVec3(const Vec3& v) : x{v.x}, y{v.y}, z{v.z} {}
+    static LaneVec3 load(const float* x, const float* y, const float* z, size_t i) { return {F::load(x + i), F::load(y + i), F::load(z + i)}; }
+    void store(float* px, float* py, float* pz, size_t i) const { x.store(px + i); y.store(py + i); z.store(pz + i); }
+
+    LaneVec3 operator+(const LaneVec3& v) const { return {x + v.x, y + v.y, z + v.z}; }
+    LaneVec3 operator-(const LaneVec3& v) const { return {x - v.x, y - v.y, z - v.z}; }
+    LaneVec3 operator*(F f) const { return {x * f, y * f, z * f}; }
+    LaneVec3 operator/(F f) const { return {x / f, y / f, z / f}; }
+    F dot(const LaneVec3& v) const { return x * v.x + y * v.y + z * v.z; }
+    LaneVec3 cross(const LaneVec3& v) const { return {y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x}; }
+};
+
+template<typename F>
+LaneVec3<F> ifGreater(F a, F b, const LaneVec3<F>& then, const LaneVec3<F>& otherwise)
+{
+    return {ifGreater(a, b, then.x, otherwise.x), ifGreater(a, b, then.y, otherwise.y), ifGreater(a, b, then.z, otherwise.z)};
+}
+
+template<typename F>
+void positionKernel(const BezierCurve& curve, const float* t, size_t count, float* x, float* y, float* z)
+{
+    LaneVec3<F> b0 {curve.b0}, b1 {curve.b1}, b2 {curve.b2}, b3 {curve.b3};
+    for (size_t i = 0; i < count; i += F::WIDTH)
+    {
+        F s {F::load(t + i)};
+        F u {F(1) - s};
+        (b0 * (u * u * u) + b1 * (F(3) * u * u * s) + b2 * (F(3) * u * s * s) + b3 * (s * s * s)).store(x, y, z, i);
+    }
+}
+
+template<typename F>
+void derivativeKernel(const BezierCurve& curve, SampleArrays& out, size_t count)
+{
+    LaneVec3<F> b0 {curve.b0}, b1 {curve.b1}, b2 {curve.b2}, b3 {curve.b3};
+    LaneVec3<F> d3 {LaneVec3<F>{(curve.b3 - curve.b2 * 3 + curve.b1 * 3 - curve.b0) * 6}};
+    LaneVec3<F> chord {LaneVec3<F>{(curve.b3 - curve.b0).normalised()}}; // Tangent of a degenerate segment
+    F zero {0};
+
+    for (size_t i = 0; i < count; i += F::WIDTH)
+    {
+        F s {F::load(out.t.data() + i)};
+        F u {F(1) - s};
+        LaneVec3<F> position {b0 * (u * u * u) + b1 * (F(3) * u * u * s) + b2 * (F(3) * u * s * s) + b3 * (s * s * s)};
+        LaneVec3<F> d1 {(b1 - b0) * (F(3) * u * u) + (b2 - b1) * (F(6) * u * s) + (b3 - b2) * (F(3) * s * s)};
+        LaneVec3<F> d2 {(b2 - b1 * F(2) + b0) * (F(6) * u) + (b3 - b2 * F(2) + b1) * (F(6) * s)};
+
+        // Zero speed lanes divide by zero and are replaced afterwards
+        F speed2 {d1.dot(d1)};
+        F inverseSpeed2 {F(1) / speed2};
+        LaneVec3<F> tangent {ifGreater(speed2, zero, d1 * sqrt(inverseSpeed2), chord)};
+        LaneVec3<F> curvature {ifGreater(speed2, zero, (d2 - tangent * tangent.dot(d2)) * inverseSpeed2, LaneVec3<F>{zero, zero, zero})};
+        LaneVec3<F> binormal {d1.cross(d2)};
+        F area2 {binormal.dot(binormal)};
+        F torsion {ifGreater(area2, F(1e-12f), binormal.dot(d3) / area2, zero)};
+
+        position.store(out.px.data(), out.py.data(), out.pz.data(), i);
+        tangent.store(out.tx.data(), out.ty.data(), out.tz.data(), i);
+        curvature.store(out.kx.data(), out.ky.data(), out.kz.data(), i);
+        torsion.store(out.torsion.data() + i);
+    }
+}
+
+// The two reflections between consecutive samples only depend on the positions and
+// tangents, so they are built for all the samples at once as a single rotation
+// I - s1 v1 v1' - s2 v2 v2' + s1 s2 (v2 . v1) v2 v1'
+template<typename F>
+void reflectionKernel(SampleArrays& out, size_t count)
+{
+    F epsilon {1e-12f};
+    F zero {0};
+    for (size_t k = 0; k < count; k += F::WIDTH)
+    {
+        LaneVec3<F> p0 {LaneVec3<F>::load(out.px.data(), out.py.data(), out.pz.data(), k)};
+        LaneVec3<F> p1 {LaneVec3<F>::load(out.px.data(), out.py.data(), out.pz.data(), k + 1)};
+        LaneVec3<F> t0 {LaneVec3<F>::load(out.tx.data(), out.ty.data(), out.tz.data(), k)};
+        LaneVec3<F> t1 {LaneVec3<F>::load(out.tx.data(), out.ty.data(), out.tz.data(), k + 1)};
+
+        LaneVec3<F> v1 {p1 - p0};
+        F c1 {v1.dot(v1)};
+        F s1 {ifGreater(c1, epsilon, F(2) / c1, zero)};
+        LaneVec3<F> reflected {t0 - v1 * (s1 * v1.dot(t0))};
+        LaneVec3<F> v2 {t1 - reflected};
+        F c2 {v2.dot(v2)};
+        F s2 {ifGreater(c2, epsilon, F(2) / c2, zero)};
+        F s12 {s1 * s2 * v2.dot(v1)};
+
+        F a[3] {v1.x, v1.y, v1.z};
+        F b[3] {v2.x, v2.y, v2.z};
+        for (int row = 0; row < 3; ++row)
+        {
+            for (int column = 0; column < 3; ++column)
+            {
+                F m {F(row == column ? 1.0f : 0.0f) - s1 * a[row] * a[column] - s2 * b[row] * b[column] + s12 * b[row] * a[column]};
+                m.store(out.rotation[row * 3 + column].data() + k);
+            }
+        }
+    }
+}
+
+// Removes the rounding left by the propagation: perpendicular to the tangent and unit length
+template<typename F>
+void normalKernel(SampleArrays& out, size_t count)
+{
+    for (size_t k = 0; k < count; k += F::WIDTH)
+    {
+        LaneVec3<F> tangent {LaneVec3<F>::load(out.tx.data(), out.ty.data(), out.tz.data(), k)};
+        LaneVec3<F> normal {LaneVec3<F>::load(out.nx.data(), out.ny.data(), out.nz.data(), k)};
+        normal = normal - tangent * tangent.dot(normal);
+        (normal / sqrt(normal.dot(normal))).store(out.nx.data(), out.ny.data(), out.nz.data(), k);
+    }
+}
+
+// Positions only, for the arc length tables. The arrays hold count values plus padding
+inline void bezierPositions(const BezierCurve& curve, const float* t, size_t count, float* x, float* y, float* z, SimdLevel level = bestSimdLevel())
+{
+    switch (level)
+    {
+#if defined(RCE_AVX2)
+        case SimdLevel::AVX2: positionKernel<AvxLanes>(curve, t, count, x, y, z); return;
+#endif
+#if defined(RCE_SSE)
+        case SimdLevel::SSE: positionKernel<SseLanes>(curve, t, count, x, y, z); return;
+#endif
+        default: positionKernel<ScalarLanes>(curve, t, count, x, y, z);
+    }
+}
+
+// Position, tangent, curvature and torsion at the parameters in out.t
+inline void evaluateBezier(const BezierCurve& curve, SampleArrays& out, SimdLevel level = bestSimdLevel())
+{
+    out.padParameters();
+    switch (level)
+    {
+#if defined(RCE_AVX2)
+        case SimdLevel::AVX2: derivativeKernel<AvxLanes>(curve, out, out.size()); return;
+#endif
+#if defined(RCE_SSE)
+        case SimdLevel::SSE: derivativeKernel<SseLanes>(curve, out, out.size()); return;
+#endif
+        default: derivativeKernel<ScalarLanes>(curve, out, out.size());
+    }
+}
+
+// Rotation minimizing frame by double reflection, starting from the given normal.
+// The rotations are batched, only their chaining is sequential: three independent
+// dot products per sample
+inline void rotationMinimizingFrames(SampleArrays& out, const Vec3& first, SimdLevel level = bestSimdLevel())
+{
+    size_t count {out.size()};
+    if (count == 0)
+        return;
+
+    // Pairs (k, k + 1) for k < count - 1, the last register reads the padding
+    if (count > 1)
+    {
+        switch (level)
+        {
+#if defined(RCE_AVX2)
+            case SimdLevel::AVX2: reflectionKernel<AvxLanes>(out, count - 1); break;
+#endif
+#if defined(RCE_SSE)
+            case SimdLevel::SSE: reflectionKernel<SseLanes>(out, count - 1); break;
+#endif
+            default: reflectionKernel<ScalarLanes>(out, count - 1);
+        }
+    }
+
+    const std::vector<float>* m {out.rotation};
+    float x {first.x};
+    float y {first.y};
+    float z {first.z};
+    out.nx[0] = x;
+    out.ny[0] = y;
+    out.nz[0] = z;
+    for (size_t k = 0; k + 1 < count; ++k)
+    {
+        float nx {m[0][k] * x + m[1][k] * y + m[2][k] * z};
+        float ny {m[3][k] * x + m[4][k] * y + m[5][k] * z};
+        float nz {m[6][k] * x + m[7][k] * y + m[8][k] * z};
+        x = out.nx[k + 1] = nx;
+        y = out.ny[k + 1] = ny;
+        z = out.nz[k + 1] = nz;
+    }
+
+    switch (level)
+    {
+#if defined(RCE_AVX2)
+        case SimdLevel::AVX2: normalKernel<AvxLanes>(out, count); break;
+#endif
+#if defined(RCE_SSE)
+        case SimdLevel::SSE: normalKernel<SseLanes>(out, count); break;
+#endif
+        default: normalKernel<ScalarLanes>(out, count);
+    }
+}
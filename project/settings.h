@@ -28,6 +28,7 @@ textures, frames, and fonts.
 #include <OgreTextureManager.h>
 #include <OgreImage.h>
 #include <OgreDataStream.h>
+#include <OgreStreamSerialiser.h>
 #include <OgreConfigFile.h>
 #include <Terrain/OgreTerrain.h>
 #include <Terrain/OgreTerrainGroup.h>
@@ -50,6 +51,11 @@ struct Settings
 {
     static const fs::path MUSIC_PATH;
     static const fs::path FX_PATH;
+    static const size_t JOURNAL_MEMORY; // Bytes the undo/redo journal may use
+    static const fs::path TRACK_FILE; // Track saved for rce-sim
+    static const fs::path PARK_FILE; // Park saved and loaded in build mode
+    static const fs::path TERRAIN_CACHE; // Terrains saved with their derived data, see terraincache.h
+    static const float REPLAY_FRAME_DELTA; // Seconds every frame advances the clocks on replay
     static sf::Music ambience,mainMenu;
     static std::unordered_map<std::string, sf::SoundBuffer> soundBuffers;
     static std::unordered_map<std::string, sf::Sound> sounds;
@@ -68,6 +74,11 @@ std::unordered_map<std::string, sf::SoundBuffer> Settings::soundBuffers;
 std::unordered_map<std::string, sf::Sound> Settings::sounds{};
 const fs::path Settings::MUSIC_PATH{"assets/music/"};
 const fs::path Settings::FX_PATH{"assets/fx/"};
+const size_t Settings::JOURNAL_MEMORY{1024 * 1024};
+const fs::path Settings::TRACK_FILE{"park.track"};
+const fs::path Settings::PARK_FILE{"park.rcep"};
+const fs::path Settings::TERRAIN_CACHE{"cache/terrain"};
+const float Settings::REPLAY_FRAME_DELTA{1.0f / 60};
 sf::Music Settings::ambience{};
 sf::Music Settings::mainMenu{};
 
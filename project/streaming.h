@@ -0,0 +1,381 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the streaming of the resources. Reading the files and
+decoding the images is done by the threads of the WorkQueue through the
+ResourceBackgroundQueue, a few resources at a time so the priorities hold.
+What needs the render system, creating the buffers and the textures, is done
+on the main thread with a small budget every frame.
+
+The resources are streamed by groups, one for each scene of the game. A group
+that is left is unloaded whole, and what of it was still being prepared is
+unloaded as soon as it is ready instead of being loaded.
+
+The textures cooked by the cook-assets target are used instead of the images
+they were made from when the graphics card reads block compressed textures.
+*/
+
+#pragma once
+
+#include "Ogre.h"
+#include "OgreRTShaderSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+// Lower values load first
+enum LoadPriority
+{
+    LOAD_MENU,  // Needed before the menu is shown
+    LOAD_WORLD, // Needed by play()
+    LOAD_REST
+};
+
+class ResourceStreamer
+{
+    public:
+        // Resources prepared at once in the background, and seconds of the main thread update() may spend finishing them
+        explicit ResourceStreamer(size_t inFlight = 4, double frameBudget = 0.006);
+
+        void add(const Ogre::String& type, const Ogre::String& name, const Ogre::String& group, int priority);
+        // Meshes and materials of the group, the textures come with their materials. A group added already
+        // keeps its requests, the ones left are moved up to the priority when it is sooner
+        void addGroup(const Ogre::String& group, int priority);
+        // Drops what is left of the group and unloads it, it can be added again later
+        void unloadGroup(const Ogre::String& group);
+        // Sends more requests to the background and finishes the prepared ones, called once per frame
+        void update();
+        // Blocks until every resource up to the priority is loaded
+        void finish(int priority = LOAD_REST);
+
+        bool finished() const { return loaded == total; }
+        bool failed(const Ogre::String& group) const { return failedGroups.count(group) > 0; } // A resource of it could not be loaded
+        float progress() const { return total == 0 ? 1.0f : float(loaded) / total; }
+        const Ogre::String& getCurrent() const { return current; } // Last resource loaded
+        double getSeconds() const { return seconds; } // From the first add() to the last load
+
+    private:
+        struct Request
+        {
+            Ogre::String type;
+            Ogre::String name;
+            Ogre::String group;
+            int priority;
+            uint64_t order; // Same priority keeps the order of add()
+            Ogre::BackgroundProcessTicket ticket;
+            bool dropped; // Its group was unloaded while it was prepared
+        };
+
+        struct Later
+        {
+            bool operator()(const Request& a, const Request& b) const { return a.priority != b.priority ? a.priority > b.priority : a.order > b.order; }
+        };
+
+        void promote(const Ogre::String& group, int priority);
+        void drop(const Ogre::String& group);
+        void send();
+        void complete(Request&);
+        bool completeReady(); // Finishes one prepared resource, false if none is ready
+
+        size_t inFlight;
+        double frameBudget;
+        std::priority_queue<Request, std::vector<Request>, Later> pending;
+        std::deque<Request> preparing; // In the background, in the order they were sent
+        std::set<Ogre::String> groups; // Added and not unloaded since
+        std::set<Ogre::String> failedGroups;
+        size_t total = 0;
+        size_t loaded = 0;
+        uint64_t added = 0;
+        Ogre::String current;
+        std::chrono::steady_clock::time_point start;
+        double seconds = 0;
+};
+
+inline ResourceStreamer::ResourceStreamer(size_t inFlight, double frameBudget) :
+    inFlight{inFlight},
+    frameBudget{frameBudget}
+{}
+
+inline void ResourceStreamer::add(const Ogre::String& type, const Ogre::String& name, const Ogre::String& group, int priority)
+{
+    if (total == loaded)
+        start = std::chrono::steady_clock::now();
+    pending.push({type, name, group, priority, added++, 0, false});
+    ++total;
+}
+
+inline void ResourceStreamer::addGroup(const Ogre::String& group, int priority)
+{
+    if (!groups.insert(group).second)
+    {
+        promote(group, priority);
+        return;
+    }
+    for (const Ogre::String& name : *Ogre::ResourceGroupManager::getSingleton().findResourceNames(group, "*.mesh"))
+        add("Mesh", name, group, priority);
+    auto materials {Ogre::MaterialManager::getSingleton().getResourceIterator()};
+    while (materials.hasMoreElements())
+    {
+        Ogre::ResourcePtr material {materials.getNext()};
+        if (material->getGroup() == group)
+            add("Material", material->getName(), group, priority);
+    }
+}
+
+// The queue is rebuilt, the order of add() is kept among the same priority
+inline void ResourceStreamer::promote(const Ogre::String& group, int priority)
+{
+    std::vector<Request> kept;
+    for (; !pending.empty(); pending.pop())
+        kept.push_back(pending.top());
+    for (Request& request : kept)
+    {
+        if (request.group == group)
+            request.priority = std::min(request.priority, priority);
+        pending.push(request);
+    }
+    for (Request& request : preparing)
+    {
+        if (request.group == group)
+            request.priority = std::min(request.priority, priority);
+    }
+}
+
+// What is left of the group is counted as done without loading it
+inline void ResourceStreamer::drop(const Ogre::String& group)
+{
+    std::vector<Request> kept;
+    for (; !pending.empty(); pending.pop())
+    {
+        if (pending.top().group == group)
+            ++loaded; // Counted as done, nothing waits for it anymore
+        else
+            kept.push_back(pending.top());
+    }
+    for (Request& request : kept)
+        pending.push(request);
+    for (Request& request : preparing)
+        request.dropped |= request.group == group;
+    if (total == loaded)
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline void ResourceStreamer::unloadGroup(const Ogre::String& group)
+{
+    drop(group);
+    Ogre::ResourceGroupManager::getSingleton().unloadResourceGroup(group);
+    groups.erase(group);
+}
+
+inline void ResourceStreamer::send()
+{
+    while (preparing.size() < inFlight && !pending.empty())
+    {
+        Request request {pending.top()};
+        pending.pop();
+        request.ticket = Ogre::ResourceBackgroundQueue::getSingleton().prepare(request.type, request.name, request.group);
+        preparing.push_back(request);
+    }
+}
+
+// The prepared data is turned into render system objects, already loaded resources are skipped.
+// A resource that fails, in the background or here, drops the rest of its group instead of stopping the game
+inline void ResourceStreamer::complete(Request& request)
+{
+    Ogre::ResourceManager* manager {Ogre::ResourceGroupManager::getSingleton()._getResourceManager(request.type)};
+    current = request.name;
+    try
+    {
+        if (request.dropped)
+            manager->unload(request.name, request.group); // Frees the prepared data
+        else
+            manager->load(request.name, request.group);
+    }
+    catch (const Ogre::Exception& e)
+    {
+        Ogre::LogManager::getSingleton().logError("Streaming of group " + request.group + " failed: " + e.getDescription());
+        failedGroups.insert(request.group);
+        drop(request.group);
+    }
+    if (++loaded == total)
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline bool ResourceStreamer::completeReady()
+{
+    Ogre::ResourceBackgroundQueue& queue {Ogre::ResourceBackgroundQueue::getSingleton()};
+    for (auto request {preparing.begin()}; request != preparing.end(); ++request)
+    {
+        if (queue.isProcessComplete(request->ticket))
+        {
+            complete(*request);
+            preparing.erase(request);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void ResourceStreamer::update()
+{
+    if (finished())
+        return;
+
+    auto begin {std::chrono::steady_clock::now()};
+    send();
+    while (completeReady() && std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() < frameBudget)
+        send();
+}
+
+// The responses of the WorkQueue are handled here too, there are no frames while waiting
+inline void ResourceStreamer::finish(int priority)
+{
+    auto waiting = [this, priority]
+    {
+        if (!pending.empty() && pending.top().priority <= priority)
+            return true;
+        return std::any_of(preparing.begin(), preparing.end(), [priority](const Request& request) { return request.priority <= priority; });
+    };
+    while (waiting())
+    {
+        send();
+        Ogre::Root::getSingleton().getWorkQueue()->processResponses();
+        if (!completeReady())
+            std::this_thread::yield();
+    }
+}
+
+// Bytes of the loaded textures, meshes and materials of each group, most of it is memory of the graphics card
+inline std::map<Ogre::String, size_t> groupMemory()
+{
+    std::map<Ogre::String, size_t> bytes;
+    for (const char* type : {"Texture", "Mesh", "Material"})
+    {
+        auto resources {Ogre::ResourceGroupManager::getSingleton()._getResourceManager(type)->getResourceIterator()};
+        while (resources.hasMoreElements())
+        {
+            Ogre::ResourcePtr resource {resources.getNext()};
+            if (resource->isLoaded())
+                bytes[resource->getGroup()] += resource->getSize();
+        }
+    }
+    return bytes;
+}
+
+// Resident memory of the process now, so what an unload frees shows up; 0 where it is not known
+inline size_t residentBytes()
+{
+#if defined(__linux__)
+    std::ifstream statm {"/proc/self/statm"};
+    size_t pages {0};
+    size_t resident {0};
+    if (!(statm >> pages >> resident))
+        return 0;
+    return resident * size_t(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+// One line with the megabytes of every loaded group and the resident memory of the process
+inline std::string memoryReport()
+{
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(1);
+    for (const auto& group : groupMemory())
+        report << group.first << ' ' << group.second / 1048576.0 << " MB, ";
+    report << "RSS " << residentBytes() / 1048576.0 << " MB";
+    return report.str();
+}
+
+// Name of the cooked copy of a texture when there is one and the graphics card reads it, the name itself otherwise
+inline Ogre::String cookedTexture(const Ogre::String& name)
+{
+    Ogre::String base;
+    Ogre::String extension;
+    Ogre::StringUtil::splitBaseFilename(name, base, extension);
+    Ogre::String cooked {base + ".dds"};
+    if (extension == "dds" || !Ogre::Root::getSingleton().getRenderSystem()->getCapabilities()->hasCapability(Ogre::RSC_TEXTURE_COMPRESSION_DXT)
+        || !Ogre::ResourceGroupManager::getSingleton().resourceExistsInAnyGroup(cooked))
+        return name;
+    return cooked;
+}
+
+// Points the texture units of every material at the cooked textures, called once the scripts are parsed; the number of units changed
+inline size_t preferCookedTextures()
+{
+    namespace RTShader = Ogre::RTShader;
+    RTShader::ShaderGenerator* shadergen {RTShader::ShaderGenerator::getSingletonPtr()};
+    const Ogre::String& scheme {RTShader::ShaderGenerator::DEFAULT_SCHEME_NAME};
+    size_t changed {0};
+    auto materials {Ogre::MaterialManager::getSingleton().getResourceIterator()};
+    while (materials.hasMoreElements())
+    {
+        Ogre::MaterialPtr material {Ogre::static_pointer_cast<Ogre::Material>(materials.getNext())};
+        // The normal maps of the RTSS only get their units when the technique is generated
+        Ogre::Technique* source {nullptr};
+        if (shadergen->hasShaderBasedTechnique(material->getName(), material->getGroup(), Ogre::MaterialManager::DEFAULT_SCHEME_NAME, scheme))
+        {
+            shadergen->validateMaterial(scheme, material->getName(), material->getGroup());
+            for (Ogre::Technique* technique : material->getTechniques())
+            {
+                if (technique->getSchemeName() == Ogre::MaterialManager::DEFAULT_SCHEME_NAME)
+                    source = technique;
+            }
+        }
+
+        for (Ogre::Technique* technique : material->getTechniques())
+        {
+            for (Ogre::Pass* pass : technique->getPasses())
+            {
+                const Ogre::Pass* sourcePass {source != nullptr && technique->getSchemeName() == scheme ? source->getPass(pass->getIndex()) : nullptr};
+                for (unsigned short i = 0; i < pass->getNumTextureUnitStates(); ++i)
+                {
+                    Ogre::TextureUnitState* unit {pass->getTextureUnitState(i)};
+                    if (unit->getContentType() != Ogre::TextureUnitState::CONTENT_NAMED || unit->getNumFrames() != 1)
+                        continue;
+                    Ogre::String cooked {cookedTexture(unit->getTextureName())};
+                    if (cooked == unit->getTextureName())
+                        continue;
+                    // Units after the ones of the script are the normal map, which would take the old name when the lights change
+                    if (sourcePass != nullptr && i >= sourcePass->getNumTextureUnitStates())
+                    {
+                        for (RTShader::SubRenderState* state : shadergen->getRenderState(scheme, *material, pass->getIndex())->getSubRenderStates())
+                        {
+                            if (state->getType() == "NormalMap")
+                                state->setParameter("texture", cooked);
+                        }
+                    }
+                    unit->setTextureName(cooked, unit->getTextureType());
+                    ++changed;
+                }
+            }
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,211 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the batch simulation of a ride: one train is simulated for
+every combination of a grid of parameters, in parallel, and the worst cases
+of all the rides are gathered to check that the ride is safe.
+*/
+
+#pragma once
+
+#include "physics.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct SweepGrid
+{
+    std::vector<float> masses {6000};
+    std::vector<float> passengerMasses {0, 1500, 3000};
+    std::vector<float> frictions {0.002f, 0.003f, 0.005f};
+    std::vector<Vec3> winds {{0, 0, 0}};
+    float speed = 0;       // Speed of the train when it is dispatched
+    float maxTime = 600;   // Seconds before a ride that does not finish is given up
+
+    size_t size() const { return masses.size() * passengerMasses.size() * frictions.size() * winds.size(); }
+    TrainParameters at(size_t) const;
+};
+
+struct RideResult
+{
+    TrainParameters parameters;
+    float maxVertical = 0;
+    float minVertical = std::numeric_limits<float>::infinity();
+    float maxLateral = 0;      // Absolute
+    float maxLongitudinal = 0; // Absolute
+    float minCrestSpeed = std::numeric_limits<float>::infinity();
+    float lapTime = -1; // Seconds to the end of the track or around it, negative if it never got there
+    bool rolledBack = false; // Did not make it over a crest and rolled back into the valley
+};
+
+struct SweepSummary
+{
+    size_t rides = 0;
+    size_t completed = 0;
+    size_t rollbacks = 0;
+    float maxVertical = 0;
+    float minVertical = std::numeric_limits<float>::infinity();
+    float maxLateral = 0;
+    float maxLongitudinal = 0;
+    float minCrestSpeed = std::numeric_limits<float>::infinity();
+    size_t slowestCrestRide = 0;
+    // Lap times of the completed rides
+    float lapMin = 0;
+    float lapMean = 0;
+    float lapMedian = 0;
+    float lap95 = 0;
+    float lapMax = 0;
+
+    std::string report() const;
+};
+
+inline TrainParameters SweepGrid::at(size_t index) const
+{
+    TrainParameters parameters;
+    parameters.wind = winds[index % winds.size()];
+    index /= winds.size();
+    parameters.rollingFriction = frictions[index % frictions.size()];
+    index /= frictions.size();
+    parameters.passengerMass = passengerMasses[index % passengerMasses.size()];
+    index /= passengerMasses.size();
+    parameters.mass = masses[index];
+    parameters.speed = speed;
+    return parameters;
+}
+
+// Called after every step of a ride, to record its telemetry
+typedef std::function<void(const TrainSimulation&)> RideObserver;
+
+// Runs one train from the start until it finishes a lap, reaches the end, rolls back or stalls
+inline RideResult simulateRide(const Track& track, const TrainParameters& parameters, float maxTime, float timestep = 1.0f / 240, const RideObserver& observer = nullptr)
+{
+    RideResult result;
+    result.parameters = parameters;
+
+    TrainSimulation simulation {track, timestep};
+    simulation.addTrain(parameters);
+    float rising {0};
+    float height {track.position(0).y};
+    float stalled {0};
+
+    while (simulation.getTime() < maxTime)
+    {
+        simulation.step();
+        if (observer)
+            observer(simulation);
+        GForce g {simulation.gforce(0)};
+        result.maxVertical = std::max(result.maxVertical, g.vertical);
+        result.minVertical = std::min(result.minVertical, g.vertical);
+        result.maxLateral = std::max(result.maxLateral, std::fabs(g.lateral));
+        result.maxLongitudinal = std::max(result.maxLongitudinal, std::fabs(g.longitudinal));
+
+        // A crest is where the train stops climbing
+        float speed {simulation.speed(0)};
+        float nextHeight {track.position(simulation.distance(0)).y};
+        if (rising > 0 && nextHeight < height)
+            result.minCrestSpeed = std::min(result.minCrestSpeed, speed);
+        if (nextHeight != height)
+            rising = nextHeight - height;
+        height = nextHeight;
+
+        if (speed < 0)
+        {
+            result.rolledBack = true;
+            result.minCrestSpeed = 0;
+            break;
+        }
+        if (simulation.laps(0) > 0 || (!track.isClosed() && simulation.distance(0) >= track.length()))
+        {
+            result.lapTime = simulation.getTime();
+            break;
+        }
+        stalled = speed == 0 ? stalled + timestep : 0;
+        if (stalled > 1)
+        {
+            result.minCrestSpeed = 0;
+            break;
+        }
+    }
+    return result;
+}
+
+// Every ride of the grid across the pool. The results, when given, are in grid order
+inline SweepSummary runSweep(const Track& track, const SweepGrid& grid, ThreadPool& pool, std::vector<RideResult>* rides = nullptr)
+{
+    std::vector<RideResult> results(grid.size());
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        // Each ride writes only its own entry, nothing is shared while they run
+        pool.submit([&track, &grid, &results, i] { results[i] = simulateRide(track, grid.at(i), grid.maxTime); });
+    }
+    pool.wait();
+
+    SweepSummary summary;
+    summary.rides = results.size();
+    std::vector<float> laps;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const RideResult& ride {results[i]};
+        summary.maxVertical = std::max(summary.maxVertical, ride.maxVertical);
+        summary.minVertical = std::min(summary.minVertical, ride.minVertical);
+        summary.maxLateral = std::max(summary.maxLateral, ride.maxLateral);
+        summary.maxLongitudinal = std::max(summary.maxLongitudinal, ride.maxLongitudinal);
+        if (ride.minCrestSpeed < summary.minCrestSpeed)
+        {
+            summary.minCrestSpeed = ride.minCrestSpeed;
+            summary.slowestCrestRide = i;
+        }
+        if (ride.rolledBack)
+            ++summary.rollbacks;
+        if (ride.lapTime >= 0)
+            laps.push_back(ride.lapTime);
+    }
+
+    summary.completed = laps.size();
+    if (!laps.empty())
+    {
+        std::sort(laps.begin(), laps.end());
+        double sum {0};
+        for (float lap : laps)
+            sum += lap;
+        summary.lapMin = laps.front();
+        summary.lapMax = laps.back();
+        summary.lapMean = sum / laps.size();
+        summary.lapMedian = laps[laps.size() / 2];
+        summary.lap95 = laps[std::min(laps.size() - 1, size_t(std::ceil(0.95 * laps.size())) - 1)];
+    }
+
+    if (rides != nullptr)
+        *rides = std::move(results);
+    return summary;
+}
+
+inline std::string SweepSummary::report() const
+{
+    std::ostringstream out;
+    out << "Rides: " << rides << ", completed " << completed << ", rolled back " << rollbacks << '\n'
+        << "Vertical g: " << minVertical << " to " << maxVertical << '\n'
+        << "Lateral g: " << maxLateral << ", longitudinal g: " << maxLongitudinal << '\n'
+        << "Slowest crest: " << (std::isinf(minCrestSpeed) ? 0 : minCrestSpeed) << " m/s (ride " << slowestCrestRide << ")\n"
+        << "Lap time: min " << lapMin << " s, mean " << lapMean << " s, median " << lapMedian
+        << " s, 95% " << lap95 << " s, max " << lapMax << " s\n";
+    return out.str();
+}
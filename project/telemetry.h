@@ -0,0 +1,220 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the telemetry of a ride. The simulation thread publishes
+a sample per step into a fixed ring buffer without locks or allocations, and
+the render thread drains it into a history of fixed size that keeps the
+minimum and maximum of every column of the graphs, however long the ride.
+*/
+
+#pragma once
+
+#include "physics.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <thread>
+#include <vector>
+
+struct TelemetrySample
+{
+    float time;
+    float distance;
+    float speed;
+    float acceleration;
+    float vertical;
+    float lateral;
+};
+
+// Single producer, single consumer. Capacity is a power of two
+template<typename T, size_t Capacity>
+class RingBuffer
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "The capacity must be a power of two");
+
+    public:
+        // Producer only. A full buffer drops the sample instead of waiting
+        bool push(const T& item)
+        {
+            size_t tail {write.load(std::memory_order_relaxed)};
+            if (tail - read.load(std::memory_order_acquire) == Capacity)
+                return false;
+            items[tail & (Capacity - 1)] = item;
+            write.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer only
+        bool pop(T& item)
+        {
+            size_t head {read.load(std::memory_order_relaxed)};
+            if (head == write.load(std::memory_order_acquire))
+                return false;
+            item = items[head & (Capacity - 1)];
+            read.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        std::array<T, Capacity> items;
+        alignas(64) std::atomic<size_t> write {0}; // Each index on its own cache line
+        alignas(64) std::atomic<size_t> read {0};
+};
+
+// Columns of min/max per channel. When they are full, pairs of columns are merged
+// and every column covers twice the samples, so memory and drawing cost stay fixed
+class TelemetryHistory
+{
+    public:
+        enum Channel
+        {
+            Speed,
+            Acceleration,
+            Vertical,
+            Lateral,
+            CHANNELS
+        };
+
+        struct Column
+        {
+            float min;
+            float max;
+        };
+
+        explicit TelemetryHistory(size_t columns = 256) : capacity{columns}
+        {
+            for (std::vector<Column>& channel : data)
+                channel.reserve(capacity);
+            clear();
+        }
+
+        void add(const TelemetrySample& sample)
+        {
+            float values[CHANNELS] {sample.speed, sample.acceleration, sample.vertical, sample.lateral};
+            for (int c = 0; c < CHANNELS; ++c)
+            {
+                open[c].min = std::min(open[c].min, values[c]);
+                open[c].max = std::max(open[c].max, values[c]);
+            }
+            last = sample;
+            if (++pending < samplesPerColumn)
+                return;
+
+            if (data[0].size() == capacity)
+                halve();
+            for (int c = 0; c < CHANNELS; ++c)
+            {
+                data[c].push_back(open[c]);
+                open[c] = empty();
+            }
+            pending = 0;
+        }
+
+        void clear()
+        {
+            for (int c = 0; c < CHANNELS; ++c)
+            {
+                data[c].clear();
+                open[c] = empty();
+            }
+            samplesPerColumn = 1;
+            pending = 0;
+            last = {};
+        }
+
+        const std::vector<Column>& columns(Channel channel) const { return data[channel]; }
+        size_t getCapacity() const { return capacity; }
+        const TelemetrySample& latest() const { return last; }
+
+    private:
+        static Column empty() { return {std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()}; }
+
+        void halve()
+        {
+            for (std::vector<Column>& channel : data)
+            {
+                for (size_t i = 0; i < channel.size() / 2; ++i)
+                    channel[i] = {std::min(channel[2 * i].min, channel[2 * i + 1].min), std::max(channel[2 * i].max, channel[2 * i + 1].max)};
+                channel.resize(channel.size() / 2);
+            }
+            samplesPerColumn *= 2;
+        }
+
+        size_t capacity;
+        std::vector<Column> data[CHANNELS];
+        Column open[CHANNELS];
+        size_t samplesPerColumn;
+        size_t pending;
+        TelemetrySample last;
+};
+
+// A train running along a copy of the track in real time on its own thread
+class RideSession
+{
+    public:
+        typedef RingBuffer<TelemetrySample, 4096> Buffer;
+
+        RideSession(const Track& track, const TrainParameters& parameters) :
+            track{track},
+            simulation{this->track}
+        {
+            simulation.addTrain(parameters);
+            worker = std::thread{&RideSession::run, this};
+        }
+
+        ~RideSession()
+        {
+            running = false;
+            worker.join();
+        }
+
+        RideSession(const RideSession&) = delete;
+        RideSession& operator=(const RideSession&) = delete;
+
+        Buffer& getSamples() { return samples; }
+
+    private:
+        void run()
+        {
+            auto last {std::chrono::steady_clock::now()};
+            double pending {0};
+            while (running)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                auto now {std::chrono::steady_clock::now()};
+                pending += std::chrono::duration<double>(now - last).count();
+                last = now;
+
+                // Every fixed step is published, a full buffer only loses samples
+                while (pending >= simulation.getTimestep())
+                {
+                    simulation.step();
+                    pending -= simulation.getTimestep();
+                    GForce g {simulation.gforce(0)};
+                    samples.push({float(simulation.getTime()), simulation.distance(0), simulation.speed(0), simulation.acceleration(0), g.vertical, g.lateral});
+                }
+            }
+        }
+
+        Track track;
+        TrainSimulation simulation;
+        Buffer samples;
+        std::atomic<bool> running {true};
+        std::thread worker;
+};
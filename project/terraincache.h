@@ -0,0 +1,98 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the cache of the terrains. A terrain imported from its
+heightmap is saved with its derived data, blend maps and composite map, in a
+file named after a hash of everything it was made from: the heightmap, the
+import settings, the lighting and the layer textures. A later launch with the
+same inputs reads that file and generates nothing; any change gives another
+name, so an old file is never read by mistake. Each heightmap keeps only its
+latest file.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+// Changed when the code that makes the terrain changes what is saved, like the blend maps
+static constexpr uint32_t TERRAIN_CACHE_VERSION = 1;
+
+// FNV-1a of 64 bits
+class ContentHash
+{
+    public:
+        void add(const void* data, size_t size)
+        {
+            const unsigned char* bytes {static_cast<const unsigned char*>(data)};
+            for (size_t i = 0; i < size; ++i)
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+
+        template<typename T>
+        void add(const T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "Only plain values are hashed by their bytes");
+            add(&value, sizeof value);
+        }
+
+        // The length first, so two strings never hash like their concatenation
+        void add(const std::string& text)
+        {
+            add(text.size());
+            add(text.data(), text.size());
+        }
+
+        uint64_t value() const { return hash; }
+
+        std::string hex() const
+        {
+            std::ostringstream text;
+            text << std::hex << std::setw(16) << std::setfill('0') << hash;
+            return text.str();
+        }
+
+    private:
+        uint64_t hash {14695981039346656037ull};
+};
+
+// Files of the terrain are the prefix, the place in the grid and ".dat"
+inline std::string terrainCachePrefix(const std::filesystem::path& directory, const std::string& heightmap, const ContentHash& key)
+{
+    return (directory / (heightmap + "_" + key.hex())).generic_string();
+}
+
+// Removes the files of the heightmap made from other inputs, the number removed
+inline size_t removeStaleTerrainCaches(const std::filesystem::path& directory, const std::string& heightmap, const ContentHash& key)
+{
+    std::error_code error;
+    size_t removed {0};
+    std::string current {heightmap + "_" + key.hex()};
+    for (const auto& entry : std::filesystem::directory_iterator{directory, error})
+    {
+        std::string name {entry.path().filename().string()};
+        if (name.compare(0, heightmap.size() + 1, heightmap + "_") == 0 && name.compare(0, current.size(), current) != 0
+            && entry.path().extension() == ".dat" && std::filesystem::remove(entry.path(), error))
+            ++removed;
+    }
+    return removed;
+}
@@ -0,0 +1,196 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the thread pool used by the batch jobs. Every worker has
+its own queue and takes the newest task from it; a worker that runs out of
+tasks steals the oldest ones from the others, so uneven tasks still keep
+every core busy.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+    public:
+        typedef std::function<void()> Task;
+
+        explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Tasks submitted by a worker go to its own queue, the others are spread over all of them
+        void submit(Task);
+        // Blocks until every submitted task has finished, running tasks meanwhile
+        void wait();
+
+        size_t size() const { return workers.size(); }
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        bool take(size_t queue, Task&);
+        void run(size_t index);
+        void finish();
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<size_t> queued {0};  // Tasks waiting in the queues
+        std::atomic<size_t> pending {0}; // Tasks submitted and not finished
+        std::atomic<size_t> nextQueue {0};
+        std::mutex sleepMutex;
+        std::condition_variable wakeUp;
+        std::condition_variable idle;
+        bool stopping = false;
+
+        static thread_local ThreadPool* currentPool;
+        static thread_local size_t currentQueue;
+};
+
+inline thread_local ThreadPool* ThreadPool::currentPool {nullptr};
+inline thread_local size_t ThreadPool::currentQueue {0};
+
+inline ThreadPool::ThreadPool(size_t threads)
+{
+    threads = std::max<size_t>(1, threads);
+    for (size_t i = 0; i < threads; ++i)
+        queues.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < threads; ++i)
+        workers.emplace_back(&ThreadPool::run, this, i);
+}
+
+inline ThreadPool::~ThreadPool()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock {sleepMutex};
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+inline void ThreadPool::submit(Task task)
+{
+    size_t queue {currentPool == this ? currentQueue : nextQueue++ % queues.size()};
+    ++pending;
+    {
+        // Counted under the sleep lock so a worker going to sleep cannot miss it, and before
+        // the push so the count never drops below zero when the task is taken at once
+        std::lock_guard<std::mutex> lock {sleepMutex};
+        ++queued;
+    }
+    {
+        std::lock_guard<std::mutex> lock {queues[queue]->mutex};
+        queues[queue]->tasks.push_back(std::move(task));
+    }
+    wakeUp.notify_one();
+}
+
+// Newest task of the own queue, or the oldest task of another one
+inline bool ThreadPool::take(size_t queue, Task& task)
+{
+    if (queue < queues.size())
+    {
+        std::lock_guard<std::mutex> lock {queues[queue]->mutex};
+        if (!queues[queue]->tasks.empty())
+        {
+            task = std::move(queues[queue]->tasks.back());
+            queues[queue]->tasks.pop_back();
+            --queued;
+            return true;
+        }
+    }
+    for (size_t i = 1; i <= queues.size(); ++i)
+    {
+        Queue& victim {*queues[(queue + i) % queues.size()]};
+        std::lock_guard<std::mutex> lock {victim.mutex};
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void ThreadPool::finish()
+{
+    if (--pending == 0)
+    {
+        std::lock_guard<std::mutex> lock {sleepMutex};
+        idle.notify_all();
+    }
+}
+
+inline void ThreadPool::run(size_t index)
+{
+    currentPool = this;
+    currentQueue = index;
+    Task task;
+    while (true)
+    {
+        if (take(index, task))
+        {
+            task();
+            task = nullptr;
+            finish();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock {sleepMutex};
+        wakeUp.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping)
+            return;
+    }
+}
+
+inline void ThreadPool::wait()
+{
+    // The waiting thread works as well instead of only blocking
+    Task task;
+    size_t queue {currentPool == this ? currentQueue : queues.size()};
+    while (pending > 0)
+    {
+        if (take(queue, task))
+        {
+            task();
+            task = nullptr;
+            finish();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock {sleepMutex};
+        idle.wait(lock, [this] { return pending == 0 || queued > 0; });
+    }
+}
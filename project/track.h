@@ -0,0 +1,376 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the track of the roller coaster. The circuit is a chain of
+cubic Bezier segments through the control points, whose handles are derived
+Catmull-Rom style unless a point sets its own. Every segment keeps a table of
+samples uniform in arc length with the position and the rider frame, so the
+track is queried by distance in constant time. It does not depend on Ogre so
+the simulation can use it without a window.
+*/
+
+#pragma once
+
+#include "vec3.h"
+#include "sampling.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct ControlPoint
+{
+    Vec3 position;
+    Vec3 handle;    // Outgoing Bezier handle, zero to derive it from the neighbours
+    float bank = 0; // Radians around the tangent measured from the vertical, positive to the right
+};
+
+struct TrackSample
+{
+    Vec3 position;
+    Vec3 tangent;   // Direction of travel
+    Vec3 normal;    // Up of the riders, banking included
+    Vec3 curvature; // dT/ds, its length is 1 / radius
+    float torsion;  // Radians per meter the curve turns out of its plane
+};
+
+class Track
+{
+    public:
+        static constexpr float SPACING = 0.25f; // Meters between the samples of a segment
+        static constexpr float BUCKET = 1.0f;   // Meters covered by each entry of the segment index
+
+        explicit Track(bool closed = false) : closed{closed} {}
+
+        // Edits mark the segments around the point as dirty, update() rebuilds them
+        void insertPoint(size_t index, const ControlPoint&);
+        void addPoint(const ControlPoint& point) { insertPoint(points.size(), point); }
+        void setPoint(size_t index, const ControlPoint&);
+        void removePoint(size_t index);
+        void setClosed(bool);
+        void clear();
+
+        const ControlPoint& getPoint(size_t index) const { return points[index]; }
+        size_t pointCount() const { return points.size(); }
+        bool isClosed() const { return closed; }
+
+        // Rebuilds the tables of the dirty segments, returns how many were rebuilt
+        size_t update();
+
+        // Constant time queries. The distance wraps on a closed track and is clamped on an open one
+        float length() const { return total; }
+        TrackSample sample(float s) const;
+        Vec3 position(float s) const;
+
+        size_t segmentCount() const { return segments.size(); }
+        size_t segmentAt(float s) const;
+        float segmentStart(size_t segment) const { return segments[segment].start; }
+        float segmentLength(size_t segment) const { return segments[segment].length; }
+        // Changes every time the segment is rebuilt, so the users of the tables know what to refresh
+        uint32_t segmentRevision(size_t segment) const { return segments[segment].revision; }
+        const std::vector<TrackSample>& segmentSamples(size_t segment) const { return segments[segment].samples; }
+
+    private:
+        struct Segment
+        {
+            std::vector<TrackSample> samples; // Uniform in arc length, both ends included
+            float start = 0;
+            float length = 0;
+            float inverseStep = 0;
+            uint32_t revision = 0;
+            bool dirty = true;
+        };
+
+        size_t expectedSegments() const;
+        void fitSegments(size_t at);
+        void markDirty(size_t point);
+        Vec3 handleOf(size_t point) const;
+        static Vec3 referenceNormal(const Vec3& tangent);
+        static Vec3 rotate(const Vec3& v, const Vec3& axis, float angle);
+        void build(size_t segment);
+        void index();
+        float wrap(float s) const;
+
+        std::vector<ControlPoint> points;
+        std::vector<Segment> segments; // Segment i goes from point i to point i + 1
+        std::vector<uint32_t> buckets; // First segment of every BUCKET meters
+        float total = 0;
+        bool closed;
+        bool reindex = false;
+        uint32_t revisions = 0;
+        SampleArrays scratch; // Reused by build(), no allocations once it has grown
+        std::vector<float> arc;
+};
+
+inline size_t Track::expectedSegments() const
+{
+    if (closed && points.size() >= 3)
+        return points.size();
+    return points.size() >= 2 ? points.size() - 1 : 0;
+}
+
+// Keeps one segment per pair of points, adding or removing them at the edited point
+inline void Track::fitSegments(size_t at)
+{
+    size_t expected {expectedSegments()};
+    while (segments.size() < expected)
+        segments.insert(segments.begin() + std::min(at, segments.size()), Segment{});
+    while (segments.size() > expected)
+        segments.erase(segments.begin() + std::min(at, segments.size() - 1));
+    reindex = true;
+}
+
+// A point shapes the two segments that end in it and, through the handles, the neighbours of those
+inline void Track::markDirty(size_t point)
+{
+    long n = segments.size();
+    for (long i = long(point) - 2; i <= long(point) + 1; ++i)
+    {
+        long segment {i};
+        if (closed && n > 0)
+            segment = ((i % n) + n) % n;
+        if (segment >= 0 && segment < n)
+            segments[segment].dirty = true;
+    }
+}
+
+inline void Track::insertPoint(size_t index, const ControlPoint& point)
+{
+    index = std::min(index, points.size());
+    points.insert(points.begin() + index, point);
+    fitSegments(index);
+    markDirty(index);
+}
+
+inline void Track::setPoint(size_t index, const ControlPoint& point)
+{
+    points[index] = point;
+    markDirty(index);
+}
+
+inline void Track::removePoint(size_t index)
+{
+    points.erase(points.begin() + index);
+    fitSegments(index);
+    markDirty(index);
+    if (index > 0)
+        markDirty(index - 1);
+}
+
+inline void Track::setClosed(bool close)
+{
+    if (closed == close)
+        return;
+    closed = close;
+    fitSegments(segments.size());
+    for (Segment& segment : segments)
+        segment.dirty = true;
+}
+
+inline void Track::clear()
+{
+    points.clear();
+    segments.clear();
+    buckets.clear();
+    total = 0;
+}
+
+inline size_t Track::update()
+{
+    size_t rebuilt {0};
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        if (segments[i].dirty)
+        {
+            build(i);
+            ++rebuilt;
+        }
+    }
+    if (rebuilt > 0 || reindex)
+        index();
+    return rebuilt;
+}
+
+// Bezier handle of the point, Catmull-Rom tangent divided by three when it is not set
+inline Vec3 Track::handleOf(size_t point) const
+{
+    if (points[point].handle != Vec3{})
+        return points[point].handle;
+
+    size_t n {points.size()};
+    bool loop {closed && n >= 3};
+    if (!loop && point == 0)
+        return (points[1].position - points[0].position) / 3;
+    if (!loop && point == n - 1)
+        return (points[n - 1].position - points[n - 2].position) / 3;
+    return (points[(point + 1) % n].position - points[(point + n - 1) % n].position) / 6;
+}
+
+// Up of an unbanked rider: the vertical made perpendicular to the tangent
+inline Vec3 Track::referenceNormal(const Vec3& tangent)
+{
+    Vec3 normal {Vec3{0, 1, 0} - tangent * tangent.y};
+    if (normal.length() < 1e-3f)
+        normal = Vec3{1, 0, 0} - tangent * tangent.x; // Vertical tangent
+    return normal.normalised();
+}
+
+// Rotation of a vector perpendicular to the axis
+inline Vec3 Track::rotate(const Vec3& v, const Vec3& axis, float angle)
+{
+    return v * std::cos(angle) + axis.cross(v) * std::sin(angle);
+}
+
+inline void Track::build(size_t i)
+{
+    Segment& segment {segments[i]};
+    size_t next {(i + 1) % points.size()};
+    BezierCurve curve;
+    curve.b0 = points[i].position;
+    curve.b1 = curve.b0 + handleOf(i);
+    curve.b3 = points[next].position;
+    curve.b2 = curve.b3 - handleOf(next);
+
+    // Arc length against the curve parameter, measured on a finer polyline
+    float chord {(curve.b1 - curve.b0).length() + (curve.b2 - curve.b1).length() + (curve.b3 - curve.b2).length()};
+    size_t steps {std::max<size_t>(16, size_t(std::ceil(4 * chord / SPACING)))};
+    scratch.resize(steps + 1);
+    for (size_t k = 0; k <= steps; ++k)
+        scratch.t[k] = float(k) / steps;
+    scratch.padParameters();
+    bezierPositions(curve, scratch.t.data(), steps + 1, scratch.px.data(), scratch.py.data(), scratch.pz.data());
+    arc.assign(steps + 1, 0);
+    for (size_t k = 1; k <= steps; ++k)
+    {
+        Vec3 d {scratch.px[k] - scratch.px[k - 1], scratch.py[k] - scratch.py[k - 1], scratch.pz[k] - scratch.pz[k - 1]};
+        arc[k] = arc[k - 1] + d.length();
+    }
+
+    segment.length = arc[steps];
+    size_t count {std::max<size_t>(1, size_t(std::ceil(segment.length / SPACING)))};
+    float step {segment.length / count};
+    segment.inverseStep = step > 0 ? 1 / step : 0;
+
+    // Parameters of the samples at equal distances along the curve
+    scratch.resize(count + 1);
+    size_t cursor {0};
+    for (size_t k = 0; k <= count; ++k)
+    {
+        float target {k * step};
+        while (cursor + 1 < steps && arc[cursor + 1] < target)
+            ++cursor;
+        float span {arc[cursor + 1] - arc[cursor]};
+        float t {(cursor + (span > 0 ? (target - arc[cursor]) / span : 0)) / steps};
+        scratch.t[k] = std::min(t, 1.0f);
+    }
+
+    // Frames, curvature and torsion in batches, then the rotation minimizing frame so the riders do not twist
+    evaluateBezier(curve, scratch);
+    rotationMinimizingFrames(scratch, referenceNormal({scratch.tx[0], scratch.ty[0], scratch.tz[0]}));
+
+    // Twist left by the frame at the end is spread along the segment, then the banking is added
+    Vec3 endTangent {scratch.tx[count], scratch.ty[count], scratch.tz[count]};
+    Vec3 endNormal {scratch.nx[count], scratch.ny[count], scratch.nz[count]};
+    Vec3 endReference {referenceNormal(endTangent)};
+    float twist {std::atan2(endTangent.dot(endNormal.cross(endReference)), endNormal.dot(endReference))};
+    float bank0 {points[i].bank};
+    float bank1 {points[next].bank};
+    segment.samples.resize(count + 1);
+    for (size_t k = 0; k <= count; ++k)
+    {
+        float u {float(k) / count};
+        float smooth {u * u * (3 - 2 * u)};
+        TrackSample& sample {segment.samples[k]};
+        sample.position = {scratch.px[k], scratch.py[k], scratch.pz[k]};
+        sample.tangent = {scratch.tx[k], scratch.ty[k], scratch.tz[k]};
+        sample.normal = rotate({scratch.nx[k], scratch.ny[k], scratch.nz[k]}, sample.tangent, twist * u + bank0 + (bank1 - bank0) * smooth);
+        sample.curvature = {scratch.kx[k], scratch.ky[k], scratch.kz[k]};
+        sample.torsion = scratch.torsion[k];
+    }
+
+    segment.revision = ++revisions;
+    segment.dirty = false;
+}
+
+// Start of every segment and the table that finds the segment of a distance without searching
+inline void Track::index()
+{
+    total = 0;
+    for (Segment& segment : segments)
+    {
+        segment.start = total;
+        total += segment.length;
+    }
+
+    buckets.assign(size_t(total / BUCKET) + 1, 0);
+    size_t segment {0};
+    for (size_t b = 0; b < buckets.size(); ++b)
+    {
+        while (segment + 1 < segments.size() && segments[segment + 1].start <= b * BUCKET)
+            ++segment;
+        buckets[b] = segment;
+    }
+    reindex = false;
+}
+
+inline float Track::wrap(float s) const
+{
+    if (closed && segments.size() == points.size())
+    {
+        s = std::fmod(s, total);
+        return s < 0 ? s + total : s;
+    }
+    return std::min(std::max(s, 0.0f), total);
+}
+
+inline size_t Track::segmentAt(float s) const
+{
+    s = wrap(s);
+    size_t segment {buckets[std::min(size_t(s / BUCKET), buckets.size() - 1)]};
+    while (segment + 1 < segments.size() && segments[segment + 1].start <= s)
+        ++segment;
+    return segment;
+}
+
+inline TrackSample Track::sample(float s) const
+{
+    if (segments.empty() || total <= 0)
+        return {};
+
+    s = wrap(s);
+    const Segment& segment {segments[segmentAt(s)]};
+    float f {(s - segment.start) * segment.inverseStep};
+    size_t last {segment.samples.size() - 2};
+    size_t k {std::min(size_t(std::max(f, 0.0f)), last)};
+    float w {std::min(f - k, 1.0f)};
+
+    const TrackSample& a {segment.samples[k]};
+    const TrackSample& b {segment.samples[k + 1]};
+    return {lerp(a.position, b.position, w), lerp(a.tangent, b.tangent, w).normalised(), lerp(a.normal, b.normal, w).normalised(), lerp(a.curvature, b.curvature, w), a.torsion + (b.torsion - a.torsion) * w};
+}
+
+inline Vec3 Track::position(float s) const
+{
+    if (segments.empty() || total <= 0)
+        return {};
+
+    s = wrap(s);
+    const Segment& segment {segments[segmentAt(s)]};
+    float f {(s - segment.start) * segment.inverseStep};
+    size_t k {std::min(size_t(std::max(f, 0.0f)), segment.samples.size() - 2)};
+    return lerp(segment.samples[k].position, segment.samples[k + 1].position, std::min(f - k, 1.0f));
+}
@@ -0,0 +1,131 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the reading and writing of the track files. A track file
+is plain text, one entry per line, and '#' starts a comment:
+
+    closed 1
+    point x y z [bank [hx hy hz]]
+    station distance
+    brake distance trim
+    chain start end speed
+
+The points are given in meters in track order, the bank in radians and the
+optional handle is the outgoing Bezier handle of the point. The last three
+entries are the layout of the ride for the operations simulation: hold points
+and chain lifts, at distances along the track in meters and speeds in meters
+per second.
+*/
+
+#pragma once
+
+#include "track.h"
+#include "operations.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// The layout entries are skipped when no layout is given
+inline void loadTrack(const std::string& path, Track& track, RideLayout* layout = nullptr)
+{
+    std::ifstream file {path};
+    if (!file)
+        throw std::runtime_error{"Error opening track " + path};
+
+    track.clear();
+    if (layout != nullptr)
+        *layout = {};
+    std::string line;
+    for (size_t number = 1; std::getline(file, line); ++number)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields {line};
+        std::string key;
+        if (!(fields >> key))
+            continue;
+
+        if (key == "closed")
+        {
+            int closed;
+            if (!(fields >> closed))
+                throw std::runtime_error{path + ":" + std::to_string(number) + ": expected closed 0 or 1"};
+            track.setClosed(closed != 0);
+        }
+        else if (key == "point")
+        {
+            ControlPoint point;
+            if (!(fields >> point.position.x >> point.position.y >> point.position.z))
+                throw std::runtime_error{path + ":" + std::to_string(number) + ": expected point x y z"};
+            if (fields >> point.bank)
+                fields >> point.handle.x >> point.handle.y >> point.handle.z;
+            track.addPoint(point);
+        }
+        else if (key == "station" || key == "brake")
+        {
+            HoldPoint hold;
+            hold.kind = key == "station" ? HoldPoint::Station : HoldPoint::Brake;
+            if (!(fields >> hold.distance) || (hold.kind == HoldPoint::Brake && !(fields >> hold.trimSpeed)))
+                throw std::runtime_error{path + ":" + std::to_string(number) + ": expected " + (key == "station" ? "station distance" : "brake distance trim")};
+            if (layout != nullptr)
+                layout->holds.push_back(hold);
+        }
+        else if (key == "chain")
+        {
+            Chain chain;
+            if (!(fields >> chain.start >> chain.end >> chain.speed))
+                throw std::runtime_error{path + ":" + std::to_string(number) + ": expected chain start end speed"};
+            if (layout != nullptr)
+                layout->chains.push_back(chain);
+        }
+        else
+            throw std::runtime_error{path + ":" + std::to_string(number) + ": unknown entry " + key};
+    }
+    track.update();
+}
+
+inline void saveTrack(const std::string& path, const Track& track, const RideLayout* layout = nullptr)
+{
+    std::ofstream file {path};
+    if (!file)
+        throw std::runtime_error{"Error writing track " + path};
+
+    file.precision(9); // Enough to read back the same floats
+    file << "# Roller Coaster Engine track\n";
+    file << "closed " << (track.isClosed() ? 1 : 0) << '\n';
+    for (size_t i = 0; i < track.pointCount(); ++i)
+    {
+        const ControlPoint& point {track.getPoint(i)};
+        file << "point " << point.position.x << ' ' << point.position.y << ' ' << point.position.z;
+        if (point.bank != 0 || point.handle != Vec3{})
+            file << ' ' << point.bank;
+        if (point.handle != Vec3{})
+            file << ' ' << point.handle.x << ' ' << point.handle.y << ' ' << point.handle.z;
+        file << '\n';
+    }
+
+    if (layout == nullptr)
+        return;
+    for (const HoldPoint& hold : layout->holds)
+    {
+        if (hold.kind == HoldPoint::Station)
+            file << "station " << hold.distance << '\n';
+        else
+            file << "brake " << hold.distance << ' ' << hold.trimSpeed << '\n';
+    }
+    for (const Chain& chain : layout->chains)
+        file << "chain " << chain.start << ' ' << chain.end << ' ' << chain.speed << '\n';
+}
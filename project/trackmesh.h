@@ -0,0 +1,175 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the renderable of the track. Every segment of the track
+owns one section of a ManualObject per material; when a segment changes only
+its sections are uploaded again, once the worker thread has extruded it.
+*/
+
+#pragma once
+
+#include "Ogre.h"
+#include "extrusion.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class TrackMesh
+{
+    public:
+        TrackMesh(Ogre::SceneManager*, Ogre::SceneNode* parent);
+
+        // Requests the segments changed since the last call and uploads the finished ones
+        void sync(const Track&);
+
+    private:
+        struct Slot
+        {
+            size_t section; // First of the consecutive sections, one per material
+            Ogre::AxisAlignedBox bounds;
+        };
+
+        size_t allocate();
+        void upload(size_t section, const ExtrudedPart&, bool create, const char* material);
+        void updateBounds();
+
+        Ogre::ManualObject* object;
+        TrackExtruder extruder;
+        std::unordered_map<uint32_t, Slot> slots; // Uploaded segments by revision
+        std::unordered_set<uint32_t> requested;   // Revisions on the worker
+        std::vector<size_t> freeSections;          // Slots of removed segments, reused before adding sections
+        std::unordered_set<uint32_t> current;      // Revisions of the track, kept to avoid reallocating each frame
+};
+
+inline TrackMesh::TrackMesh(Ogre::SceneManager* scnMgr, Ogre::SceneNode* parent) :
+    object{scnMgr->createManualObject("Track")}
+{
+    object->setDynamic(true);
+    parent->createChildSceneNode()->attachObject(object);
+}
+
+inline void TrackMesh::sync(const Track& track)
+{
+    current.clear();
+    for (size_t i = 0; i < track.segmentCount(); ++i)
+    {
+        uint32_t revision {track.segmentRevision(i)};
+        current.insert(revision);
+        if (!slots.count(revision) && requested.insert(revision).second)
+            extruder.request(revision, track.segmentSamples(i), track.segmentLength(i));
+    }
+
+    // Jobs of segments edited again before the worker reached them
+    for (auto revision {requested.begin()}; revision != requested.end();)
+    {
+        if (!current.count(*revision))
+        {
+            extruder.drop(*revision);
+            revision = requested.erase(revision);
+        }
+        else
+            ++revision;
+    }
+
+    bool changed {false};
+    ExtrudedSegment segment;
+    while (extruder.collect(segment))
+    {
+        requested.erase(segment.revision);
+        if (!current.count(segment.revision))
+            continue;
+
+        bool create {freeSections.empty()};
+        Slot slot {create ? allocate() : freeSections.back()};
+        if (!create)
+            freeSections.pop_back();
+        const TrackStyle& style {extruder.getStyle()};
+        for (size_t m = 0; m < segment.parts.size(); ++m)
+            upload(slot.section + m, segment.parts[m], create, style.materials[m]);
+        slot.bounds = Ogre::AxisAlignedBox(segment.min.x, segment.min.y, segment.min.z, segment.max.x, segment.max.y, segment.max.z);
+        slots[segment.revision] = slot;
+        changed = true;
+    }
+
+    // The old geometry stays on screen until every replacement is uploaded
+    if (requested.empty())
+    {
+        for (auto slot {slots.begin()}; slot != slots.end();)
+        {
+            if (!current.count(slot->first))
+            {
+                for (size_t m = 0; m < extruder.getStyle().materials.size(); ++m)
+                {
+                    object->beginUpdate(slot->second.section + m);
+                    object->end(); // An updated section may stay empty, it is not rendered
+                }
+                freeSections.push_back(slot->second.section);
+                slot = slots.erase(slot);
+                changed = true;
+            }
+            else
+                ++slot;
+        }
+    }
+
+    if (changed)
+        updateBounds();
+}
+
+inline size_t TrackMesh::allocate()
+{
+    return object->getNumSections();
+}
+
+inline void TrackMesh::upload(size_t section, const ExtrudedPart& part, bool create, const char* material)
+{
+    if (create)
+        object->begin(material, Ogre::RenderOperation::OT_TRIANGLE_LIST);
+    else
+        object->beginUpdate(section);
+
+    object->estimateVertexCount(part.vertexCount());
+    object->estimateIndexCount(part.indices.size());
+    for (size_t i = 0; i < part.vertices.size(); i += ExtrudedPart::STRIDE)
+    {
+        const float* v {&part.vertices[i]};
+        object->position(v[0], v[1], v[2]);
+        object->normal(v[3], v[4], v[5]);
+        object->textureCoord(v[6], v[7]);
+    }
+    for (uint32_t index : part.indices)
+        object->index(index);
+
+    // A new section without data is discarded, keep a degenerate triangle so the slot layout holds
+    if (create && part.indices.empty())
+    {
+        object->position(0, 0, 0);
+        object->normal(0, 1, 0);
+        object->textureCoord(0, 0);
+        object->triangle(0, 0, 0);
+    }
+    object->end();
+}
+
+inline void TrackMesh::updateBounds()
+{
+    Ogre::AxisAlignedBox bounds;
+    for (const auto& slot : slots)
+        bounds.merge(slot.second.bounds);
+    object->setBoundingBox(bounds);
+    if (object->getParentSceneNode() != nullptr)
+        object->getParentSceneNode()->needUpdate();
+}
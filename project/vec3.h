@@ -0,0 +1,57 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the small vector type of the code that does not depend on
+Ogre: the track, the physics and the tools that run without a window.
+*/
+
+#pragma once
+
+#include <cmath>
+
+struct Vec3
+{
+    float x = 0;
+    float y = 0;
+    float z = 0;
+
+    Vec3() = default;
+    Vec3(float x, float y, float z) : x{x}, y{y}, z{z} {}
+
+    Vec3 operator+(const Vec3& v) const { return {x + v.x, y + v.y, z + v.z}; }
+    Vec3 operator-(const Vec3& v) const { return {x - v.x, y - v.y, z - v.z}; }
+    Vec3 operator-() const { return {-x, -y, -z}; }
+    Vec3 operator*(float f) const { return {x * f, y * f, z * f}; }
+    Vec3 operator/(float f) const { return {x / f, y / f, z / f}; }
+    Vec3& operator+=(const Vec3& v) { x += v.x; y += v.y; z += v.z; return *this; }
+    Vec3& operator-=(const Vec3& v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+    bool operator==(const Vec3& v) const { return x == v.x && y == v.y && z == v.z; }
+    bool operator!=(const Vec3& v) const { return !(*this == v); }
+
+    float dot(const Vec3& v) const { return x * v.x + y * v.y + z * v.z; }
+    Vec3 cross(const Vec3& v) const { return {y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x}; }
+    float length() const { return std::sqrt(dot(*this)); }
+    Vec3 normalised() const
+    {
+        float l {length()};
+        return l > 0 ? *this / l : *this;
+    }
+};
+
+inline Vec3 lerp(const Vec3& a, const Vec3& b, float t)
+{
+    return a + (b - a) * t;
+}
@@ -0,0 +1,201 @@
+/*
+Computer Graphics B2023
+Roller Coaster Engine
+
+Author: Alejandro Mujica
+alejandro.j.mujic4@gmail.com
+
+Author: Anthony Dugarte
+toonny1998@gmail.com
+
+Author: Kevin Márquez
+marquezberriosk@gmail.com
+
+Author: Lewis Ochoa
+lewis8a@gmail.com
+
+This file contains the reordering of triangle lists for the vertex caches of
+the graphics card. The triangles are put in the order of Tom Forsyth's linear
+speed algorithm: each vertex scores by its place in a simulated cache and by
+how few triangles still use it, and the best triangle around the cache goes
+next. Then the vertices are put in the order they are first used, so they are
+fetched from memory in sequence.
+
+The cost of a list is measured as the vertices a FIFO cache of the usual size
+would transform per triangle: 3 is no reuse at all, 0.5 is the best possible
+on a large regular grid.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Entries of the cache simulated while ordering, and of the FIFO the cost is measured with
+static constexpr size_t VERTEX_CACHE_SIZE = 32;
+static constexpr size_t VERTEX_FIFO_SIZE = 16;
+
+namespace vertexcache
+{
+    static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    // Scores from the paper, a vertex of the last triangle is not worth more than one a bit older
+    inline float score(int cachePosition, uint32_t trianglesLeft)
+    {
+        if (trianglesLeft == 0)
+            return -1.0f;
+        float value {0};
+        if (cachePosition >= 3)
+            value = std::pow(1.0f - float(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+        else if (cachePosition >= 0)
+            value = 0.75f;
+        return value + 2.0f / std::sqrt(float(trianglesLeft)); // Lonely vertices go first, they would be loaded again later
+    }
+}
+
+// Vertices a FIFO cache transforms per triangle
+template<typename Index>
+float cacheMissRatio(const Index* indices, size_t count, size_t vertexCount, size_t cacheSize = VERTEX_FIFO_SIZE)
+{
+    if (count < 3)
+        return 0;
+    std::vector<size_t> stamp(vertexCount, 0); // Miss count when the vertex entered the cache, 0 if never
+    size_t misses {0};
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t& entered {stamp[indices[i]]};
+        if (entered == 0 || misses - entered >= cacheSize)
+        {
+            ++misses;
+            entered = misses;
+        }
+    }
+    return float(misses) / (count / 3);
+}
+
+// Reorders the triangles in place, each one keeps its winding
+template<typename Index>
+void optimiseVertexCache(Index* indices, size_t count, size_t vertexCount)
+{
+    using namespace vertexcache;
+    size_t triangleCount {count / 3};
+    if (triangleCount < 2)
+        return;
+
+    // Triangles of every vertex, packed
+    std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+        ++firstTriangle[indices[i] + 1];
+    for (size_t v = 0; v < vertexCount; ++v)
+        firstTriangle[v + 1] += firstTriangle[v];
+    std::vector<uint32_t> trianglesOf(triangleCount * 3);
+    std::vector<uint32_t> trianglesLeft(vertexCount, 0);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        for (size_t k = 0; k < 3; ++k)
+        {
+            Index v {indices[t * 3 + k]};
+            trianglesOf[firstTriangle[v] + trianglesLeft[v]++] = uint32_t(t);
+        }
+    }
+
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        vertexScore[v] = score(-1, trianglesLeft[v]);
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    std::vector<Index> ordered(triangleCount * 3);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    cache.reserve(VERTEX_CACHE_SIZE + 3);
+    nextCache.reserve(VERTEX_CACHE_SIZE + 3);
+
+    // The first triangle is the best of all, later ones the best around the cache
+    uint32_t best {uint32_t(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin())};
+    size_t cursor {0}; // Triangles before it are all emitted, for when the cache has nothing left
+    for (size_t out = 0; out < triangleCount; ++out)
+    {
+        if (best == NONE)
+        {
+            while (emitted[cursor])
+                ++cursor;
+            best = uint32_t(cursor);
+        }
+        emitted[best] = true;
+        for (size_t k = 0; k < 3; ++k)
+        {
+            Index v {indices[best * 3 + k]};
+            ordered[out * 3 + k] = v;
+
+            // The triangle no longer counts for its vertices
+            uint32_t* begin {&trianglesOf[firstTriangle[v]]};
+            uint32_t* end {begin + trianglesLeft[v]};
+            *std::find(begin, end, best) = *(end - 1);
+            --trianglesLeft[v];
+        }
+
+        // Its vertices go to the front, the rest keep their order and the ones pushed out of the cache score as outside again
+        nextCache.assign(indices + best * 3, indices + best * 3 + 3);
+        for (uint32_t v : cache)
+        {
+            if (v != nextCache[0] && v != nextCache[1] && v != nextCache[2])
+                nextCache.push_back(v);
+        }
+        for (size_t i = 0; i < nextCache.size(); ++i)
+        {
+            uint32_t v {nextCache[i]};
+            cachePosition[v] = i < VERTEX_CACHE_SIZE ? int(i) : -1;
+            vertexScore[v] = score(cachePosition[v], trianglesLeft[v]);
+        }
+        if (nextCache.size() > VERTEX_CACHE_SIZE)
+            nextCache.resize(VERTEX_CACHE_SIZE);
+        cache.swap(nextCache);
+
+        // Only the triangles around the cache change their score
+        best = NONE;
+        float bestScore {-1};
+        for (uint32_t v : cache)
+        {
+            for (uint32_t i = firstTriangle[v]; i < firstTriangle[v] + trianglesLeft[v]; ++i)
+            {
+                uint32_t t {trianglesOf[i]};
+                triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+    }
+    std::copy(ordered.begin(), ordered.end(), indices);
+}
+
+// Order of the vertices by first use, remap[old] is the new place; vertices no triangle uses go last
+template<typename Index>
+std::vector<uint32_t> optimiseVertexFetch(Index* indices, size_t count, size_t vertexCount)
+{
+    std::vector<uint32_t> remap(vertexCount, vertexcache::NONE);
+    uint32_t next {0};
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t& place {remap[indices[i]]};
+        if (place == vertexcache::NONE)
+            place = next++;
+        indices[i] = Index(place);
+    }
+    for (uint32_t& place : remap)
+    {
+        if (place == vertexcache::NONE)
+            place = next++;
+    }
+    return remap;
+}